@@ -1,4 +1,4 @@
-QT       += core gui serialport
+QT       += core gui serialport concurrent
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
@@ -13,17 +13,64 @@ INCLUDEPATH += src/
 
 SOURCES += \
     src/main.cpp \
+    src/controllers/captureengine.cpp \
+    src/controllers/capturerecorder.cpp \
+    src/controllers/chunksource.cpp \
+    src/controllers/headlesscapture.cpp \
+    src/controllers/historyexporter.cpp \
     src/controllers/mainwindow.cpp \
+    src/controllers/perfmonitor.cpp \
+    src/controllers/selectioncopier.cpp \
     src/controllers/serialhandler.cpp \
+    src/controllers/updatescheduler.cpp \
+    src/models/capturefile.cpp \
+    src/models/chunklog.cpp \
+    src/models/coldhistory.cpp \
+    src/models/historyfiltermodel.cpp \
     src/models/historymodel.cpp \
-    src/utils/loghandler.cpp
+    src/models/historysearch.cpp \
+    src/models/historystore.cpp \
+    src/utils/bytesearch.cpp \
+    src/utils/captureclock.cpp \
+    src/utils/cpufeatures.cpp \
+    src/utils/framedecoder.cpp \
+    src/utils/hexformat.cpp \
+    src/utils/latencyhistogram.cpp \
+    src/utils/loghandler.cpp \
+    src/utils/timeformat.cpp \
+    src/utils/transmitqueue.cpp \
+    src/views/historydelegate.cpp
 
 HEADERS += \
+    src/controllers/captureengine.h \
+    src/controllers/capturerecorder.h \
+    src/controllers/chunksource.h \
+    src/controllers/headlesscapture.h \
+    src/controllers/historyexporter.h \
     src/controllers/mainwindow.h \
+    src/controllers/perfmonitor.h \
+    src/controllers/selectioncopier.h \
     src/controllers/serialhandler.h \
+    src/controllers/updatescheduler.h \
+    src/models/capturefile.h \
+    src/models/chunklog.h \
+    src/models/coldhistory.h \
+    src/models/historyfiltermodel.h \
     src/models/historymodel.h \
+    src/models/historysearch.h \
+    src/models/historystore.h \
+    src/utils/bytesearch.h \
+    src/utils/captureclock.h \
     src/utils/commonconfig.h \
-    src/utils/loghandler.h
+    src/utils/cpufeatures.h \
+    src/utils/framedecoder.h \
+    src/utils/hexformat.h \
+    src/utils/latencyhistogram.h \
+    src/utils/loghandler.h \
+    src/utils/ringbuffer.h \
+    src/utils/timeformat.h \
+    src/utils/transmitqueue.h \
+    src/views/historydelegate.h
 
 FORMS += \
     src/views/mainwindow.ui
@@ -0,0 +1,8 @@
+# qmake benchmarks.pro && make, then run each <name>_bench
+TEMPLATE = subdirs
+
+SUBDIRS += \
+    framedecoder \
+    hexformat \
+    historymodel \
+    loopback
@@ -0,0 +1,17 @@
+TEMPLATE = app
+TARGET = framedecoder_bench
+
+QT += core
+QT -= gui widgets
+
+CONFIG += console c++11
+CONFIG -= app_bundle
+
+INCLUDEPATH += ../../src/
+
+SOURCES += \
+    main.cpp \
+    ../../src/utils/framedecoder.cpp
+
+HEADERS += \
+    ../../src/utils/framedecoder.h
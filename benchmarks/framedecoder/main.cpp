@@ -0,0 +1,146 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "utils/framedecoder.h"
+
+// Throughput of the built-in frame decoders on encoded random frames, fed in reads
+// of a fixed size like the serial reader does. "ports" is how many ports at
+// 3 Mbaud (10 bits per character) one core could decode at the same time.
+// usage: framedecoder_bench [bytes per read, default 64]
+
+namespace {
+
+constexpr int INPUT_SIZE = 1024 * 1024;
+constexpr double MIN_SECONDS = 0.5;
+constexpr double WIRE_BYTES_PER_S = 3000000 / 10.0;
+
+std::vector<char> randomPayload(std::mt19937 &_random)
+{
+    std::vector<char> payload(8 + _random() % 120);
+    for (auto &c : payload)
+        c = char(_random());
+    return payload;
+}
+
+std::vector<char> slipStream(std::mt19937 &_random)
+{
+    std::vector<char> stream {};
+    while (stream.size() < INPUT_SIZE) {
+        for (const auto c : randomPayload(_random)) {
+            if (quint8(c) == 0xC0) {
+                stream.push_back(char(0xDB));
+                stream.push_back(char(0xDC));
+            } else if (quint8(c) == 0xDB) {
+                stream.push_back(char(0xDB));
+                stream.push_back(char(0xDD));
+            } else {
+                stream.push_back(c);
+            }
+        }
+        stream.push_back(char(0xC0));
+    }
+    return stream;
+}
+
+std::vector<char> cobsStream(std::mt19937 &_random)
+{
+    std::vector<char> stream {};
+    while (stream.size() < INPUT_SIZE) {
+        auto code = stream.size();
+        stream.push_back(1);
+        for (const auto c : randomPayload(_random)) {
+            if (c == 0 || stream[code] == char(0xFF)) {
+                code = stream.size();
+                stream.push_back(1);
+            }
+            if (c != 0) {
+                stream.push_back(c);
+                stream[code]++;
+            }
+        }
+        stream.push_back(0);
+    }
+    return stream;
+}
+
+std::vector<char> lengthStream(std::mt19937 &_random)
+{
+    std::vector<char> stream {};
+    while (stream.size() < INPUT_SIZE) {
+        const auto payload = randomPayload(_random);
+        stream.push_back(char(payload.size() >> 8));
+        stream.push_back(char(payload.size()));
+        stream.insert(stream.end(), payload.begin(), payload.end());
+    }
+    return stream;
+}
+
+// frames back to back without gaps, as the driver buffers them; Modbus RTU splits them by the CRC
+std::vector<char> modbusStream(std::mt19937 &_random)
+{
+    std::vector<char> stream {};
+    while (stream.size() < INPUT_SIZE) {
+        quint16 crc = 0xFFFF;
+        for (const auto c : randomPayload(_random)) {
+            stream.push_back(c);
+            crc ^= quint8(c);
+            for (int bit = 0; bit < 8; ++bit)
+                crc = (crc & 1) ? quint16((crc >> 1) ^ 0xA001) : quint16(crc >> 1);
+        }
+        stream.push_back(char(crc & 0xFF));
+        stream.push_back(char(crc >> 8));
+    }
+    return stream;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    const int readSize = argc > 1 ? std::max(atoi(argv[1]), 1) : 64;
+
+    std::mt19937 random(42);
+    const struct {
+        const char *spec;
+        std::vector<char> stream;
+    } inputs[] {
+        {"slip", slipStream(random)},
+        {"cobs", cobsStream(random)},
+        {"modbus-rtu", modbusStream(random)},
+        {"length:size=2", lengthStream(random)},
+    };
+
+    printf("%-14s %10s %10s %8s\n", "decoder", "MB/s", "frames", "ports");
+    for (const auto &input : inputs) {
+        const auto decoder = FrameDecoder::create(input.spec);
+        QVector<int> frameStarts {};
+        frameStarts.reserve(readSize + 1);
+
+        using Clock = std::chrono::steady_clock;
+        long long bytes = 0;
+        const auto start = Clock::now();
+        double elapsed = 0;
+        do {
+            const auto length = int(input.stream.size());
+            for (int offset = 0; offset < length; offset += readSize) {
+                frameStarts.clear();
+                decoder->decode(input.stream.data() + offset, std::min(readSize, length - offset), 0, &frameStarts);
+            }
+            bytes += length;
+            elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+        } while (elapsed < MIN_SECONDS);
+
+        const auto stats = decoder->takeStats();
+        const auto bytesPerSecond = bytes / elapsed;
+        printf("%-14s %10.1f %10llu %8.0f\n", input.spec, bytesPerSecond / 1e6, stats.totalFrames, bytesPerSecond / WIRE_BYTES_PER_S);
+        if (stats.totalErrors > 0)
+            printf("%-14s %llu errors, the generated stream is broken\n", input.spec, stats.totalErrors);
+        delete decoder;
+    }
+
+    return 0;
+}
@@ -0,0 +1,16 @@
+TEMPLATE = app
+TARGET = hexformat_bench
+
+CONFIG += console c++11
+CONFIG -= qt app_bundle
+
+INCLUDEPATH += ../../src/
+
+SOURCES += \
+    main.cpp \
+    ../../src/utils/cpufeatures.cpp \
+    ../../src/utils/hexformat.cpp
+
+HEADERS += \
+    ../../src/utils/cpufeatures.h \
+    ../../src/utils/hexformat.h
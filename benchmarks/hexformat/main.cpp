@@ -0,0 +1,69 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "utils/hexformat.h"
+
+// Throughput of the Hex/String formatting kernels, in GB/s of input bytes.
+// usage: hexformat_bench [bytes per line, default 16]
+
+namespace {
+
+constexpr int INPUT_SIZE = 1024 * 1024;
+constexpr double MIN_SECONDS = 0.5;
+
+template <typename Function>
+double measure(Function _function)
+{
+    using Clock = std::chrono::steady_clock;
+
+    long long bytes = 0;
+    const auto start = Clock::now();
+    double elapsed = 0;
+    do {
+        bytes += _function();
+        elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    } while (elapsed < MIN_SECONDS);
+
+    return bytes / elapsed / 1e9;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    const int bytesPerLine = argc > 1 ? atoi(argv[1]) : 16;
+
+    std::vector<char> input(INPUT_SIZE);
+    std::mt19937 random(42);
+    for (auto &c : input)
+        c = char(random());
+
+    std::vector<char> output(size_t(std::max(hexformat::hexBufferSize(INPUT_SIZE, bytesPerLine),
+                                             hexformat::asciiBufferSize(INPUT_SIZE, bytesPerLine))));
+
+    printf("%-8s %-8s %10s\n", "kernel", "column", "GB/s");
+    for (const auto kernel : {hexformat::Kernel::Scalar, hexformat::Kernel::Sse, hexformat::Kernel::Avx2}) {
+        if (!hexformat::isSupported(kernel)) {
+            printf("%-8s unsupported on this CPU\n", hexformat::toString(kernel));
+            continue;
+        }
+
+        const auto hex = measure([&]() {
+            hexformat::formatHex(input.data(), INPUT_SIZE, bytesPerLine, output.data(), kernel);
+            return INPUT_SIZE;
+        });
+        const auto ascii = measure([&]() {
+            hexformat::formatAscii(input.data(), INPUT_SIZE, bytesPerLine, output.data(), kernel);
+            return INPUT_SIZE;
+        });
+
+        printf("%-8s %-8s %10.2f\n", hexformat::toString(kernel), "hex", hex);
+        printf("%-8s %-8s %10.2f\n", hexformat::toString(kernel), "string", ascii);
+    }
+
+    return 0;
+}
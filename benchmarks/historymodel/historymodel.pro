@@ -0,0 +1,34 @@
+TEMPLATE = app
+TARGET = historymodel_bench
+
+QT += core gui concurrent
+QT -= widgets
+
+CONFIG += console c++11
+CONFIG -= app_bundle
+
+INCLUDEPATH += ../../src/
+
+SOURCES += \
+    main.cpp \
+    ../../src/models/capturefile.cpp \
+    ../../src/models/chunklog.cpp \
+    ../../src/models/coldhistory.cpp \
+    ../../src/models/historymodel.cpp \
+    ../../src/models/historystore.cpp \
+    ../../src/utils/captureclock.cpp \
+    ../../src/utils/cpufeatures.cpp \
+    ../../src/utils/hexformat.cpp \
+    ../../src/utils/latencyhistogram.cpp
+
+HEADERS += \
+    ../../src/models/capturefile.h \
+    ../../src/models/chunklog.h \
+    ../../src/models/coldhistory.h \
+    ../../src/models/historymodel.h \
+    ../../src/models/historystore.h \
+    ../../src/utils/captureclock.h \
+    ../../src/utils/commonconfig.h \
+    ../../src/utils/cpufeatures.h \
+    ../../src/utils/hexformat.h \
+    ../../src/utils/latencyhistogram.h
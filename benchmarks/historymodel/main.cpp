@@ -0,0 +1,579 @@
+#include <QCoreApplication>
+#include <QEventLoop>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <random>
+#include <vector>
+
+#include "models/historymodel.h"
+
+// HistoryModel hot paths driven by synthetic serial traffic, one JSON object per line:
+//   {"benchmark":"appendData","profile":"lines","ops":...,"bytes":...,"mb_per_s":...,
+//    "realtime_factor":...,"allocs_per_byte":...,"p50_ns":...,"p99_ns":...,"max_ns":...}
+// realtime_factor is the throughput relative to the line rate of the profile.
+// usage: historymodel_bench [seconds per benchmark, default 1] [profile]
+
+namespace {
+
+std::atomic<unsigned long long> s_allocations {0};
+
+} // namespace
+
+// Qt containers allocate with malloc() rather than operator new, so the allocations
+// are counted there; glibc allows replacing malloc in the executable.
+#if defined(__GLIBC__)
+extern "C" {
+void *__libc_malloc(size_t _size);
+void *__libc_calloc(size_t _count, size_t _size);
+void *__libc_realloc(void *_ptr, size_t _size);
+void __libc_free(void *_ptr);
+
+void *malloc(size_t _size)
+{
+    s_allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_malloc(_size);
+}
+
+void *calloc(size_t _count, size_t _size)
+{
+    s_allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_calloc(_count, _size);
+}
+
+void *realloc(void *_ptr, size_t _size)
+{
+    s_allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_realloc(_ptr, _size);
+}
+
+void free(void *_ptr)
+{
+    __libc_free(_ptr);
+}
+}
+#else
+// elsewhere only operator new is seen, Qt's own allocations are missing from the counts
+void *operator new(size_t _size)
+{
+    s_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *ptr = std::malloc(_size ? _size : 1))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *_ptr) noexcept
+{
+    std::free(_ptr);
+}
+#endif
+
+// the private hot paths of the model, HistoryModel befriends this class
+class HistoryModelBenchmark
+{
+public:
+    using Segment = HistoryModel::Segment;
+
+    static QString formattedHexString(const HistoryModel &_model, const QByteArray &_data)
+    {
+        return _model.formattedHexString(_data);
+    }
+
+    static QString formattedString(const HistoryModel &_model, const QByteArray &_data)
+    {
+        return _model.formattedString(_data);
+    }
+
+    static QList<QByteArray> splitDataByLength(const QByteArray &_data, int _chunkLength, int _firstChunkLength)
+    {
+        return HistoryModel::splitDataByLength(_data, _chunkLength, _firstChunkLength);
+    }
+
+    static QList<QByteArray> splitData(const QByteArray &_data, bool _limitByLength, int _chunkLength, int _firstChunkLength)
+    {
+        return HistoryModel::splitData(_data, _limitByLength, _chunkLength, _firstChunkLength);
+    }
+
+    static void segmentData(const char *_data, int _length, bool _limitByLength, int _chunkLength, int _firstChunkLength,
+                            QVector<Segment> *_segments)
+    {
+        HistoryModel::segmentData(_data, _length, _limitByLength, _chunkLength, _firstChunkLength, _segments);
+    }
+};
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr qint64 SECOND = 1000000000;
+constexpr qint64 BATCH_INTERVAL = 16 * 1000000; // the UpdateScheduler flush interval, ns
+constexpr size_t MAX_SAMPLES = 1 << 22; // latencies kept per benchmark, reserved up front
+
+struct Read {
+    HistoryModel::DataDirection direction;
+    QByteArray data;
+    qint64 timestamp; // last byte, ns from the start of the profile
+};
+
+struct Profile {
+    const char *name;
+    int baudRate;
+    std::vector<Read> reads;
+    qint64 bytes;
+    qint64 duration; // ns, the reads repeat after this
+};
+
+// walks the reads of a profile forever, with timestamps that keep increasing
+class Cursor
+{
+public:
+    explicit Cursor(const Profile &_profile) : m_profile(_profile) {}
+
+    const Read &peek() const { return m_profile.reads[m_index]; }
+    qint64 timestamp() const { return peek().timestamp + m_cycle * m_profile.duration; }
+
+    void next()
+    {
+        if (++m_index == m_profile.reads.size()) {
+            m_index = 0;
+            m_cycle++;
+        }
+    }
+
+private:
+    const Profile &m_profile;
+    size_t m_index {};
+    qint64 m_cycle {};
+};
+
+// Latencies and allocations of one benchmark, the samples are reserved up front
+// so recording them does not show up in the allocation counts.
+class Measurement
+{
+public:
+    explicit Measurement(double _seconds) : m_budget(qint64(_seconds * SECOND))
+    {
+        m_samples.reserve(MAX_SAMPLES);
+        m_allocations = s_allocations;
+    }
+
+    bool running() const { return m_elapsed < m_budget && m_samples.size() < MAX_SAMPLES; }
+
+    template <typename Function>
+    void measure(qint64 _bytes, Function _function)
+    {
+        const auto start = Clock::now();
+        _function();
+        const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+
+        m_samples.push_back(ns);
+        m_elapsed += ns;
+        m_bytes += _bytes;
+    }
+
+    // setup work in between, not measured and not counted
+    template <typename Function>
+    void exclude(Function _function)
+    {
+        const auto allocations = s_allocations.load();
+        _function();
+        m_allocations += s_allocations - allocations;
+    }
+
+    void report(const char *_benchmark, const Profile &_profile)
+    {
+        const auto allocations = s_allocations - m_allocations;
+        std::sort(m_samples.begin(), m_samples.end());
+        const auto percentile = [&](double _p) {
+            return m_samples.empty() ? 0LL : (long long)m_samples[std::min(m_samples.size() - 1, size_t(_p * m_samples.size()))];
+        };
+
+        const auto seconds = double(m_elapsed) / SECOND;
+        const auto bytesPerSecond = seconds > 0 ? m_bytes / seconds : 0;
+        const auto lineRate = _profile.baudRate / 10.0;
+        printf("{\"benchmark\":\"%s\",\"profile\":\"%s\",\"ops\":%zu,\"bytes\":%lld,\"seconds\":%.3f,"
+               "\"mb_per_s\":%.3f,\"realtime_factor\":%.1f,\"allocs_per_byte\":%.4f,\"allocs_per_op\":%.2f,"
+               "\"p50_ns\":%lld,\"p90_ns\":%lld,\"p99_ns\":%lld,\"p999_ns\":%lld,\"max_ns\":%lld}\n",
+               _benchmark, _profile.name, m_samples.size(), (long long)m_bytes, seconds,
+               bytesPerSecond / 1e6, bytesPerSecond / lineRate,
+               m_bytes ? double(allocations) / m_bytes : 0.0,
+               m_samples.empty() ? 0.0 : double(allocations) / m_samples.size(),
+               percentile(0.5), percentile(0.9), percentile(0.99), percentile(0.999),
+               m_samples.empty() ? 0LL : (long long)m_samples.back());
+        fflush(stdout);
+    }
+
+private:
+    std::vector<qint64> m_samples {};
+    qint64 m_budget;
+    qint64 m_elapsed {};
+    qint64 m_bytes {};
+    unsigned long long m_allocations {};
+};
+
+// splits _stream into reads of _minRead.._maxRead bytes, timed by the baud rate,
+// _gap is added whenever the stream had a burst boundary at that offset
+Profile makeProfile(const char *_name, int _baudRate, const QByteArray &_stream, const std::vector<int> &_bursts,
+                    int _minRead, int _maxRead, qint64 _gap, std::mt19937 &_random)
+{
+    const qint64 byteTime = 10 * SECOND / _baudRate;
+    std::uniform_int_distribution<int> readLength(_minRead, _maxRead);
+
+    Profile profile {_name, _baudRate, {}, _stream.length(), 0};
+    qint64 time = 0;
+    int burst = 0;
+    auto direction = HistoryModel::A_TO_PC;
+    for (int offset = 0; offset < _stream.length();) {
+        // a burst boundary ends a read and switches the direction
+        auto length = std::min(readLength(_random), _stream.length() - offset);
+        if (burst < int(_bursts.size()) && offset + length >= _bursts[size_t(burst)]) {
+            length = _bursts[size_t(burst)] - offset;
+            burst++;
+        }
+
+        time += length * byteTime;
+        profile.reads.push_back(Read {direction, _stream.mid(offset, length), time});
+        offset += length;
+
+        if (burst > 0 && offset == _bursts[size_t(burst - 1)]) {
+            time += _gap;
+            direction = direction == HistoryModel::A_TO_PC ? HistoryModel::B_TO_PC : HistoryModel::A_TO_PC;
+        }
+    }
+    profile.duration = time + _gap;
+    return profile;
+}
+
+std::vector<Profile> makeProfiles()
+{
+    std::mt19937 random(42);
+    std::vector<Profile> profiles {};
+
+    // line oriented ASCII at 115200 baud, as a USB adapter delivers it
+    {
+        QByteArray stream {};
+        std::uniform_int_distribution<int> lineLength(10, 100);
+        std::uniform_int_distribution<int> printable(0x20, 0x7e);
+        while (stream.length() < 1024 * 1024) {
+            const auto length = lineLength(random);
+            for (int i = 0; i < length; ++i)
+                stream.append(char(printable(random)));
+            stream.append('\n');
+        }
+        profiles.push_back(makeProfile("lines", 115200, stream, {}, 1, 64, 0, random));
+    }
+
+    // binary bursts at 921600 baud, alternating directions with 5 ms in between
+    {
+        QByteArray stream {};
+        std::vector<int> bursts {};
+        std::uniform_int_distribution<int> burstLength(256, 4096);
+        while (stream.length() < 4 * 1024 * 1024) {
+            const auto length = burstLength(random);
+            for (int i = 0; i < length; ++i)
+                stream.append(char(random()));
+            bursts.push_back(stream.length());
+        }
+        profiles.push_back(makeProfile("binary", 921600, stream, bursts, 512, 4096, 5 * 1000000, random));
+    }
+
+    // single byte reads at 3 Mbaud
+    {
+        QByteArray stream {};
+        std::uniform_int_distribution<int> printable(0x20, 0x7e);
+        std::uniform_int_distribution<int> newline(0, 40);
+        while (stream.length() < 256 * 1024)
+            stream.append(newline(random) ? char(printable(random)) : '\n');
+        profiles.push_back(makeProfile("tiny", 3000000, stream, {}, 1, 1, 0, random));
+    }
+
+    return profiles;
+}
+
+// the MainWindow defaults
+void configure(HistoryModel &_model, int _capacity)
+{
+    _model.setHistoryCapacity(_capacity);
+    _model.setNewlineAfterCount(16);
+    _model.setNewlineAfterCountEnabled(true);
+    _model.setNewlineAfterDuration(500);
+    _model.setNewlineAfterDurationEnabled(true);
+}
+
+void appendRead(HistoryModel &_model, Cursor &_cursor)
+{
+    const auto &read = _cursor.peek();
+    _model.appendChunks({HistoryModel::Chunk {read.direction, read.data.constData(), read.data.length(), _cursor.timestamp(), 0, HistoryModel::Unframed, false}});
+    _cursor.next();
+}
+
+void fill(HistoryModel &_model, Cursor &_cursor, int _rows)
+{
+    while (_model.rowCount() < _rows)
+        appendRead(_model, _cursor);
+}
+
+// a flush interval of reads per call, for histories too big to fill a read at a time
+void fillBatched(HistoryModel &_model, Cursor &_cursor, int _rows)
+{
+    QVector<HistoryModel::Chunk> batch {};
+    qint64 batchEnd = _cursor.timestamp() + BATCH_INTERVAL;
+    while (_model.rowCount() < _rows) {
+        batch.clear();
+        while (_cursor.timestamp() < batchEnd) {
+            const auto &read = _cursor.peek();
+            batch.append(HistoryModel::Chunk {read.direction, read.data.constData(), read.data.length(), _cursor.timestamp(), 0, HistoryModel::Unframed, false});
+            _cursor.next();
+        }
+        batchEnd += BATCH_INTERVAL;
+        _model.appendChunks(batch);
+    }
+}
+
+qint64 rowBytes(const HistoryModel &_model, int _from, int _count)
+{
+    qint64 bytes = 0;
+    for (int row = _from; row < _from + _count; ++row)
+        bytes += _model.rowData(row).length();
+    return bytes;
+}
+
+// the same settings again, so the model rebuilds its rows from the chunk log;
+// returns the ns the workers took
+qint64 resegment(HistoryModel &_model)
+{
+    QEventLoop loop {};
+    qint64 nsecs = 0;
+    const auto connection = QObject::connect(&_model, &HistoryModel::resegmented, [&](qint64, qint64 _nsecs) {
+        nsecs = _nsecs;
+        loop.quit();
+    });
+    _model.setNewlineAfterCount(_model.newlineAfterCount() + 1);
+    _model.setNewlineAfterCount(_model.newlineAfterCount() - 1);
+    loop.exec();
+    QObject::disconnect(connection);
+    return nsecs;
+}
+
+// a million rows rebuilt after a settings change, wall clock and on the workers
+void benchmarkResegment(const Profile &_profile)
+{
+    constexpr int ROWS = 1000000;
+
+    HistoryModel model {};
+    configure(model, ROWS);
+    model.setChunkLogSize(512 * 1024 * 1024);
+    Cursor cursor(_profile);
+    fillBatched(model, cursor, ROWS);
+
+    const auto start = Clock::now();
+    const auto workerNsecs = resegment(model);
+    const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+    printf("{\"benchmark\":\"resegment\",\"profile\":\"%s\",\"rows\":%d,\"seconds\":%.3f,\"worker_seconds\":%.3f}\n",
+           _profile.name, model.rowCount(), double(ns) / SECOND, double(workerNsecs) / SECOND);
+    fflush(stdout);
+}
+
+void benchmarkAppendData(const Profile &_profile, double _seconds)
+{
+    HistoryModel model {};
+    configure(model, 10000);
+
+    Measurement measurement(_seconds);
+    Cursor cursor(_profile);
+    while (measurement.running()) {
+        const auto &read = cursor.peek();
+        measurement.measure(read.data.length(), [&]() {
+            model.appendData(read.direction, read.data);
+        });
+        cursor.next();
+    }
+    measurement.report("appendData", _profile);
+}
+
+// what the UpdateScheduler does: every read of one flush interval in one call
+void benchmarkAppendChunks(const Profile &_profile, double _seconds)
+{
+    HistoryModel model {};
+    configure(model, 10000);
+
+    Measurement measurement(_seconds);
+    Cursor cursor(_profile);
+    QVector<HistoryModel::Chunk> batch {};
+    qint64 batchEnd = BATCH_INTERVAL;
+    while (measurement.running()) {
+        batch.clear();
+        qint64 bytes = 0;
+        while (cursor.timestamp() < batchEnd) {
+            const auto &read = cursor.peek();
+            batch.append(HistoryModel::Chunk {read.direction, read.data.constData(), read.data.length(), cursor.timestamp(), 0, HistoryModel::Unframed, false});
+            bytes += read.data.length();
+            cursor.next();
+        }
+        batchEnd += BATCH_INTERVAL;
+
+        if (!batch.isEmpty()) {
+            measurement.measure(bytes, [&]() {
+                model.appendChunks(batch);
+            });
+        }
+    }
+    measurement.report("appendChunks", _profile);
+}
+
+void benchmarkSplitData(const Profile &_profile, double _seconds)
+{
+    Measurement measurement(_seconds);
+    for (size_t i = 0; measurement.running(); i = (i + 1) % _profile.reads.size()) {
+        const auto &data = _profile.reads[i].data;
+        measurement.measure(data.length(), [&]() {
+            volatile auto count = HistoryModelBenchmark::splitData(data, true, 16, 16).length();
+            Q_UNUSED(count)
+        });
+    }
+    measurement.report("splitData", _profile);
+}
+
+// the rows of appendData(), without the QByteArray copies, reused like the model does
+void benchmarkSegmentData(const Profile &_profile, double _seconds)
+{
+    QVector<HistoryModelBenchmark::Segment> segments {};
+    Measurement measurement(_seconds);
+    for (size_t i = 0; measurement.running(); i = (i + 1) % _profile.reads.size()) {
+        const auto &data = _profile.reads[i].data;
+        measurement.measure(data.length(), [&]() {
+            segments.clear();
+            HistoryModelBenchmark::segmentData(data.constData(), data.length(), true, 16, 16, &segments);
+            volatile auto count = segments.size();
+            Q_UNUSED(count)
+        });
+    }
+    measurement.report("segmentData", _profile);
+}
+
+void benchmarkSplitDataByLength(const Profile &_profile, double _seconds)
+{
+    Measurement measurement(_seconds);
+    for (size_t i = 0; measurement.running(); i = (i + 1) % _profile.reads.size()) {
+        const auto &data = _profile.reads[i].data;
+        measurement.measure(data.length(), [&]() {
+            volatile auto count = HistoryModelBenchmark::splitDataByLength(data, 16, 16).length();
+            Q_UNUSED(count)
+        });
+    }
+    measurement.report("splitDataByLength", _profile);
+}
+
+// the rows a capture of the profile leaves in the table
+std::vector<QByteArray> captureRows(const Profile &_profile)
+{
+    HistoryModel model {};
+    configure(model, 10000);
+    Cursor cursor(_profile);
+    fill(model, cursor, 10000);
+
+    std::vector<QByteArray> rows {};
+    for (int row = 0; row < model.rowCount(); ++row) {
+        const auto data = model.rowData(row);
+        rows.push_back(QByteArray(data.constData(), data.length()));
+    }
+    return rows;
+}
+
+template <typename Format>
+void benchmarkFormat(const char *_name, const Profile &_profile, double _seconds, Format _format)
+{
+    HistoryModel model {};
+    configure(model, 10000);
+    const auto rows = captureRows(_profile);
+
+    Measurement measurement(_seconds);
+    for (size_t i = 0; measurement.running(); i = (i + 1) % rows.size()) {
+        measurement.measure(rows[i].length(), [&]() {
+            volatile auto length = _format(model, rows[i]).length();
+            Q_UNUSED(length)
+        });
+    }
+    measurement.report(_name, _profile);
+}
+
+// evicting the oldest rows, 64 at a time
+void benchmarkRemoveRows(const Profile &_profile, double _seconds)
+{
+    constexpr int ROWS = 20000;
+    constexpr int REMOVE = 64;
+
+    HistoryModel model {};
+    configure(model, ROWS);
+
+    Measurement measurement(_seconds);
+    Cursor cursor(_profile);
+    while (measurement.running()) {
+        qint64 bytes = 0;
+        measurement.exclude([&]() {
+            fill(model, cursor, ROWS);
+            bytes = rowBytes(model, 0, REMOVE);
+        });
+        measurement.measure(bytes, [&]() {
+            model.removeRows(0, REMOVE);
+        });
+    }
+    measurement.report("removeRows", _profile);
+}
+
+// shrinking a full history by half and growing it back
+void benchmarkSetHistoryCapacity(const Profile &_profile, double _seconds)
+{
+    constexpr int ROWS = 20000;
+
+    HistoryModel model {};
+    configure(model, ROWS);
+
+    Measurement measurement(_seconds);
+    Cursor cursor(_profile);
+    while (measurement.running()) {
+        qint64 bytes = 0;
+        measurement.exclude([&]() {
+            fill(model, cursor, ROWS);
+            bytes = rowBytes(model, 0, ROWS / 2);
+        });
+        measurement.measure(bytes, [&]() {
+            model.setHistoryCapacity(ROWS / 2);
+        });
+        measurement.measure(0, [&]() {
+            model.setHistoryCapacity(ROWS);
+        });
+    }
+    measurement.report("setHistoryCapacity", _profile);
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    // re-segmenting finishes through the event loop
+    QCoreApplication app(argc, argv);
+    const double seconds = argc > 1 ? atof(argv[1]) : 1.0;
+    const QByteArray only = argc > 2 ? argv[2] : "";
+
+    for (const auto &profile : makeProfiles()) {
+        if (!only.isEmpty() && only != profile.name)
+            continue;
+
+        benchmarkAppendData(profile, seconds);
+        benchmarkAppendChunks(profile, seconds);
+        benchmarkSplitData(profile, seconds);
+        benchmarkSegmentData(profile, seconds);
+        benchmarkSplitDataByLength(profile, seconds);
+        benchmarkFormat("formattedHexString", profile, seconds, &HistoryModelBenchmark::formattedHexString);
+        benchmarkFormat("formattedString", profile, seconds, &HistoryModelBenchmark::formattedString);
+        benchmarkRemoveRows(profile, seconds);
+        benchmarkSetHistoryCapacity(profile, seconds);
+        benchmarkResegment(profile);
+    }
+
+    return 0;
+}
@@ -0,0 +1,50 @@
+TEMPLATE = app
+TARGET = loopback_bench
+
+QT += core gui serialport concurrent
+QT -= widgets
+
+CONFIG += console c++11
+CONFIG -= app_bundle
+
+# openpty()
+LIBS += -lutil
+
+INCLUDEPATH += ../../src/
+
+SOURCES += \
+    main.cpp \
+    ../../src/controllers/capturerecorder.cpp \
+    ../../src/controllers/chunksource.cpp \
+    ../../src/controllers/serialhandler.cpp \
+    ../../src/controllers/updatescheduler.cpp \
+    ../../src/models/capturefile.cpp \
+    ../../src/models/chunklog.cpp \
+    ../../src/models/coldhistory.cpp \
+    ../../src/models/historymodel.cpp \
+    ../../src/models/historystore.cpp \
+    ../../src/utils/captureclock.cpp \
+    ../../src/utils/cpufeatures.cpp \
+    ../../src/utils/framedecoder.cpp \
+    ../../src/utils/hexformat.cpp \
+    ../../src/utils/latencyhistogram.cpp \
+    ../../src/utils/transmitqueue.cpp
+
+HEADERS += \
+    ../../src/controllers/capturerecorder.h \
+    ../../src/controllers/chunksource.h \
+    ../../src/controllers/serialhandler.h \
+    ../../src/controllers/updatescheduler.h \
+    ../../src/models/capturefile.h \
+    ../../src/models/chunklog.h \
+    ../../src/models/coldhistory.h \
+    ../../src/models/historymodel.h \
+    ../../src/models/historystore.h \
+    ../../src/utils/captureclock.h \
+    ../../src/utils/commonconfig.h \
+    ../../src/utils/cpufeatures.h \
+    ../../src/utils/framedecoder.h \
+    ../../src/utils/hexformat.h \
+    ../../src/utils/latencyhistogram.h \
+    ../../src/utils/ringbuffer.h \
+    ../../src/utils/transmitqueue.h
@@ -0,0 +1,479 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QFile>
+#include <QThread>
+#include <QTimer>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <pty.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "controllers/serialhandler.h"
+#include "controllers/updatescheduler.h"
+#include "models/historymodel.h"
+#include "utils/captureclock.h"
+#include "utils/ringbuffer.h"
+
+// End-to-end loopback without hardware: every port is the slave side of a pseudo terminal,
+// the harness plays the device on the master side. Traffic is written at a fixed rate and
+// every write is timed until its last byte is visible in a HistoryModel row, through the
+// same SerialHandler -> UpdateScheduler -> HistoryModel path as the GUI.
+// One JSON object per port is printed at the end:
+//   {"port":"A","device":"/dev/pts/3","written":...,"visible":...,"lost":...,"p50_ns":...,...}
+// Bytes are counted without the newlines the rows drop. Linux only.
+
+namespace {
+
+constexpr qint64 SECOND = 1000000000;
+constexpr size_t MAX_MARKS = 1 << 20; // writes in flight per port
+
+enum Pattern {
+    RandomPattern, // any byte
+    LinesPattern // printable lines of 10..100 characters
+};
+
+// end of one write on the master side
+struct WriteMark {
+    quint64 rowBytes; // bytes written so far, without newlines
+    qint64 timestamp; // capture clock when write() returned
+};
+
+class LoopbackPort
+{
+public:
+    LoopbackPort(const char *_name, HistoryModel::DataDirection _direction, HistoryModel::DataDirection _forwardDirection)
+        : m_name(_name)
+        , m_handler(_direction, _forwardDirection)
+        , m_direction(_direction)
+        , m_forwardDirection(_forwardDirection)
+    {
+    }
+
+    ~LoopbackPort()
+    {
+        if (m_master >= 0)
+            ::close(m_master);
+        if (m_slave >= 0)
+            ::close(m_slave);
+    }
+
+    bool open(QString *_error)
+    {
+        if (openpty(&m_master, &m_slave, nullptr, nullptr, nullptr) != 0) {
+            *_error = QString("openpty: %1").arg(strerror(errno));
+            return false;
+        }
+
+        // no echo, no line discipline, the master sees exactly what the port writes
+        termios settings {};
+        tcgetattr(m_slave, &settings);
+        cfmakeraw(&settings);
+        tcsetattr(m_slave, TCSANOW, &settings);
+
+        fcntl(m_master, F_SETFL, fcntl(m_master, F_GETFL) | O_NONBLOCK);
+        m_device = QString::fromLocal8Bit(ptsname(m_master));
+        return true;
+    }
+
+    const char *name() const { return m_name; }
+    QString device() const { return m_device; }
+    SerialHandler &handler() { return m_handler; }
+    int master() const { return m_master; }
+
+    bool ownsDirection(HistoryModel::DataDirection _dir) const
+    {
+        return _dir == m_direction || _dir == m_forwardDirection;
+    }
+
+    void setTraffic(qint64 _rate, int _chunk, Pattern _pattern, const QByteArray &_script, quint32 _seed)
+    {
+        m_rate = _rate;
+        m_chunk = std::max(_chunk, 1);
+        m_pattern = _pattern;
+        m_script = _script;
+        m_random.seed(_seed);
+    }
+
+    // generator thread: writes what is due _elapsed ns after the start,
+    // returns the ns until the next write is due, -1 if the port is silent
+    qint64 writeDue(qint64 _elapsed)
+    {
+        if (m_rate <= 0)
+            return -1;
+
+        const auto due = quint64(double(m_rate) * _elapsed / SECOND);
+        for (;;) {
+            if (m_pendingOffset == m_pending.length()) {
+                if (due < m_generated + quint64(m_chunk))
+                    break;
+                generateChunk();
+            }
+
+            // the marks are the only record of a write, hold back until the GUI caught up
+            if (m_marks.size() == m_marks.capacity())
+                return SECOND / 1000;
+
+            const auto written = ::write(m_master, m_pending.constData() + m_pendingOffset, size_t(m_pending.length() - m_pendingOffset));
+            if (written < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    m_writeStalls++; // the port is not read fast enough and the pty buffer is full
+                    return SECOND / 1000;
+                }
+                m_writeErrors++;
+                return SECOND / 1000;
+            }
+
+            const auto timestamp = captureclock::now();
+            const auto newlines = std::count(m_pending.constData() + m_pendingOffset, m_pending.constData() + m_pendingOffset + written, '\n');
+            m_pendingOffset += int(written);
+            m_written += quint64(written);
+            m_rowBytesWritten += quint64(written - newlines);
+            m_marks.push(WriteMark {m_rowBytesWritten, timestamp});
+        }
+
+        return qint64(double(m_generated + quint64(m_chunk)) * SECOND / m_rate) - _elapsed;
+    }
+
+    // generator thread: consumes what the bridge forwarded to this port
+    void drain()
+    {
+        char buffer[4096];
+        for (;;) {
+            const auto read = ::read(m_master, buffer, sizeof(buffer));
+            if (read <= 0)
+                break;
+            m_received += quint64(read);
+        }
+    }
+
+    bool hasPendingWrite() const { return m_pendingOffset < m_pending.length(); }
+
+    // GUI thread: _bytes more row bytes of this port became visible
+    void addVisible(quint64 _bytes, qint64 _now)
+    {
+        m_visible += _bytes;
+        while (const auto mark = m_marks.front()) {
+            if (mark->rowBytes > m_visible)
+                break;
+            m_latencies.push_back(_now - mark->timestamp);
+            m_marks.pop();
+        }
+    }
+
+    void report(qint64 _seconds)
+    {
+        std::sort(m_latencies.begin(), m_latencies.end());
+        const auto percentile = [&](double _p) {
+            return m_latencies.empty() ? 0LL : (long long)m_latencies[std::min(m_latencies.size() - 1, size_t(_p * m_latencies.size()))];
+        };
+
+        const auto lost = m_rowBytesWritten > m_visible ? m_rowBytesWritten - m_visible : 0;
+        printf("{\"port\":\"%s\",\"device\":\"%s\",\"rate\":%lld,\"seconds\":%lld,\"stream_bytes\":%llu,\"written\":%llu,\"visible\":%llu,\"lost\":%llu,"
+               "\"received\":%llu,\"write_stalls\":%llu,\"write_errors\":%llu,\"read_stalls\":%llu,\"writes\":%zu,"
+               "\"p50_ns\":%lld,\"p90_ns\":%lld,\"p99_ns\":%lld,\"p999_ns\":%lld,\"max_ns\":%lld}\n",
+               m_name, qPrintable(m_device), (long long)m_rate, (long long)_seconds,
+               (unsigned long long)m_written, (unsigned long long)m_rowBytesWritten, (unsigned long long)m_visible, (unsigned long long)lost,
+               (unsigned long long)m_received, (unsigned long long)m_writeStalls, (unsigned long long)m_writeErrors,
+               (unsigned long long)m_handler.stallCount(), m_latencies.size(),
+               percentile(0.5), percentile(0.9), percentile(0.99), percentile(0.999),
+               m_latencies.empty() ? 0LL : (long long)m_latencies.back());
+        fflush(stdout);
+    }
+
+private:
+    void generateChunk()
+    {
+        m_pending.resize(m_chunk);
+        auto out = m_pending.data();
+
+        if (!m_script.isEmpty()) {
+            for (int i = 0; i < m_chunk; ++i) {
+                out[i] = m_script.at(m_scriptOffset);
+                m_scriptOffset = (m_scriptOffset + 1) % m_script.length();
+            }
+        } else if (m_pattern == LinesPattern) {
+            std::uniform_int_distribution<int> printable(0x20, 0x7e);
+            std::uniform_int_distribution<int> lineLength(10, 100);
+            for (int i = 0; i < m_chunk; ++i) {
+                if (m_lineLeft == 0) {
+                    m_lineLeft = lineLength(m_random);
+                    out[i] = '\n';
+                } else {
+                    out[i] = char(printable(m_random));
+                    m_lineLeft--;
+                }
+            }
+        } else {
+            for (int i = 0; i < m_chunk; ++i)
+                out[i] = char(m_random());
+        }
+
+        m_pendingOffset = 0;
+        m_generated += quint64(m_chunk);
+    }
+
+private:
+    const char *m_name;
+    SerialHandler m_handler;
+    const HistoryModel::DataDirection m_direction;
+    const HistoryModel::DataDirection m_forwardDirection;
+    int m_master {-1};
+    int m_slave {-1}; // kept open so the pty outlives the port being closed
+    QString m_device {};
+
+    // generator thread
+    qint64 m_rate {}; // bytes per second
+    int m_chunk {64};
+    Pattern m_pattern {RandomPattern};
+    QByteArray m_script {};
+    int m_scriptOffset {};
+    int m_lineLeft {};
+    std::mt19937 m_random {};
+    QByteArray m_pending {};
+    int m_pendingOffset {};
+    quint64 m_generated {};
+    quint64 m_written {};
+    quint64 m_rowBytesWritten {};
+    quint64 m_received {};
+    quint64 m_writeStalls {};
+    quint64 m_writeErrors {};
+
+    SpscQueue<WriteMark> m_marks {MAX_MARKS};
+
+    // GUI thread
+    quint64 m_visible {};
+    std::vector<qint64> m_latencies {};
+};
+
+// writes the scripted traffic of all ports from one thread, so a run is repeatable
+class TrafficGenerator
+{
+public:
+    explicit TrafficGenerator(const std::vector<LoopbackPort *> &_ports) : m_ports(_ports) {}
+    ~TrafficGenerator() { stop(); }
+
+    void start()
+    {
+        m_running = true;
+        m_thread = std::thread([this]() { run(); });
+    }
+
+    void stop()
+    {
+        m_running = false;
+        if (m_thread.joinable())
+            m_thread.join();
+    }
+
+private:
+    void run()
+    {
+        const auto start = captureclock::now();
+        std::vector<pollfd> fds(m_ports.size());
+
+        while (m_running) {
+            const auto elapsed = captureclock::now() - start;
+            qint64 wait = SECOND / 100; // keeps draining while all ports are silent
+            for (size_t i = 0; i < m_ports.size(); ++i) {
+                const auto due = m_ports[i]->writeDue(elapsed);
+                if (due >= 0)
+                    wait = std::min(wait, due);
+                m_ports[i]->drain();
+
+                fds[i].fd = m_ports[i]->master();
+                fds[i].events = POLLIN | (m_ports[i]->hasPendingWrite() ? POLLOUT : 0);
+                fds[i].revents = 0;
+            }
+
+            if (wait > 0) {
+                const timespec timeout {time_t(wait / SECOND), long(wait % SECOND)};
+                ppoll(fds.data(), fds.size(), &timeout, nullptr);
+            }
+        }
+
+        for (const auto port : m_ports)
+            port->drain();
+    }
+
+private:
+    const std::vector<LoopbackPort *> m_ports;
+    std::atomic<bool> m_running {false};
+    std::thread m_thread {};
+};
+
+// follows the rows the way HistorySearch does, and credits new bytes to their port
+class RowObserver
+{
+public:
+    explicit RowObserver(const std::vector<LoopbackPort *> &_ports) : m_ports(_ports) {}
+
+    void update(const HistoryModel &_history)
+    {
+        const auto now = captureclock::now();
+        _history.visitRows(m_nextSerial, std::numeric_limits<qint64>::max(), [&](qint64 _serial, HistoryModel::DataDirection _dir, qint64, const char *, int _length, bool _newest) {
+            if (_serial > m_nextSerial)
+                m_unseenRows += _serial - m_nextSerial; // evicted before they were seen
+
+            const auto grown = _serial == m_newestSerial ? _length - m_newestLength : _length;
+            for (const auto port : m_ports) {
+                if (port->ownsDirection(_dir))
+                    port->addVisible(quint64(grown), now);
+            }
+
+            if (_newest) {
+                m_newestSerial = _serial;
+                m_newestLength = _length;
+                m_nextSerial = _serial;
+            } else {
+                m_newestSerial = -1;
+                m_nextSerial = _serial + 1;
+            }
+        });
+    }
+
+    qint64 unseenRows() const { return m_unseenRows; }
+
+private:
+    const std::vector<LoopbackPort *> m_ports;
+    qint64 m_nextSerial {};
+    qint64 m_newestSerial {-1};
+    int m_newestLength {};
+    qint64 m_unseenRows {};
+};
+
+QByteArray readScript(const QString &_path)
+{
+    if (_path.isEmpty())
+        return QByteArray();
+
+    QFile file(_path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        fprintf(stderr, "%s: %s\n", qPrintable(_path), qPrintable(file.errorString()));
+        exit(1);
+    }
+    return file.readAll();
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser {};
+    parser.setApplicationDescription("Serial Spy loopback: end-to-end latency from a pty write to a visible history row.");
+    parser.addHelpOption();
+
+    const QCommandLineOption rateAOption("rate-a", "Bytes per second written to port A.", "bytes", "11520");
+    const QCommandLineOption rateBOption("rate-b", "Bytes per second written to port B.", "bytes", "0");
+    const QCommandLineOption chunkOption("chunk", "Bytes per write.", "bytes", "64");
+    const QCommandLineOption patternOption("pattern", "random or lines.", "pattern", "random");
+    const QCommandLineOption scriptAOption("script-a", "File replayed to port A instead of the pattern.", "file");
+    const QCommandLineOption scriptBOption("script-b", "File replayed to port B instead of the pattern.", "file");
+    const QCommandLineOption secondsOption("seconds", "Duration of the traffic.", "seconds", "5");
+    const QCommandLineOption drainOption("drain-ms", "Time for the last rows to show up afterwards.", "ms", "500");
+    const QCommandLineOption baudOption("baud", "Baud rate the ports are opened with.", "rate", "115200");
+    const QCommandLineOption bridgeOption("bridge", "Forward A <-> B.");
+    const QCommandLineOption flushOption("flush-ms", "UpdateScheduler flush interval.", "ms", "16");
+    const QCommandLineOption capacityOption("capacity", "History rows.", "rows", "1000000");
+    const QCommandLineOption countOption("newline-after-bytes", "Split rows after this many bytes, 0 disables.", "bytes", "16");
+    const QCommandLineOption seedOption("seed", "Seed of the random traffic.", "seed", "1");
+    parser.addOptions({rateAOption, rateBOption, chunkOption, patternOption, scriptAOption, scriptBOption, secondsOption,
+                       drainOption, baudOption, bridgeOption, flushOption, capacityOption, countOption, seedOption});
+    parser.process(app);
+
+    const auto pattern = parser.value(patternOption) == "lines" ? LinesPattern : RandomPattern;
+    const auto seconds = parser.value(secondsOption).toLongLong();
+    const auto baudRate = parser.value(baudOption).toInt();
+    const auto seed = parser.value(seedOption).toUInt();
+
+    LoopbackPort portA("A", HistoryModel::A_TO_PC, HistoryModel::A_TO_B);
+    LoopbackPort portB("B", HistoryModel::B_TO_PC, HistoryModel::B_TO_A);
+    const std::vector<LoopbackPort *> ports {&portA, &portB};
+
+    QString error {};
+    for (const auto port : ports) {
+        if (!port->open(&error)) {
+            fprintf(stderr, "%s\n", qPrintable(error));
+            return 1;
+        }
+    }
+    portA.setTraffic(parser.value(rateAOption).toLongLong(), parser.value(chunkOption).toInt(), pattern,
+                     readScript(parser.value(scriptAOption)), seed);
+    portB.setTraffic(parser.value(rateBOption).toLongLong(), parser.value(chunkOption).toInt(), pattern,
+                     readScript(parser.value(scriptBOption)), seed + 1);
+
+    // the GUI pipeline without the widgets
+    HistoryModel history {};
+    const auto newlineAfterCount = parser.value(countOption).toInt();
+    history.setHistoryCapacity(parser.value(capacityOption).toInt());
+    history.setNewlineAfterCount(newlineAfterCount);
+    history.setNewlineAfterCountEnabled(newlineAfterCount > 0);
+    history.setNewlineAfterDuration(500);
+    history.setNewlineAfterDurationEnabled(true);
+
+    UpdateScheduler scheduler(history);
+    scheduler.setFlushInterval(parser.value(flushOption).toInt());
+
+    QThread ioThread {};
+    ioThread.setObjectName("serial-io");
+    for (const auto port : ports) {
+        port->handler().moveToThread(&ioThread);
+        scheduler.addSource(&port->handler());
+    }
+    ioThread.start(QThread::TimeCriticalPriority);
+    portA.handler().setPeer(&portB.handler());
+    portB.handler().setPeer(&portA.handler());
+
+    for (const auto port : ports) {
+        port->handler().setForwardingEnabled(parser.isSet(bridgeOption));
+        if (!port->handler().open(port->device(), baudRate)) {
+            fprintf(stderr, "%s: %s\n", qPrintable(port->device()), qPrintable(port->handler().errorString()));
+            ioThread.quit();
+            ioThread.wait();
+            return 1;
+        }
+    }
+
+    RowObserver observer(ports);
+    QObject::connect(&scheduler, &UpdateScheduler::flushed, [&]() {
+        observer.update(history);
+    });
+
+    TrafficGenerator generator(ports);
+    generator.start();
+
+    QTimer::singleShot(int(seconds * 1000), [&]() {
+        generator.stop();
+        QTimer::singleShot(parser.value(drainOption).toInt(), [&]() {
+            scheduler.flush();
+            observer.update(history);
+            app.quit();
+        });
+    });
+
+    app.exec();
+
+    for (const auto port : ports)
+        port->handler().close();
+    ioThread.quit();
+    ioThread.wait();
+
+    for (const auto port : ports)
+        port->report(seconds);
+    if (observer.unseenRows() > 0)
+        fprintf(stderr, "%lld rows were evicted before they were seen, raise --capacity\n", (long long)observer.unseenRows());
+
+    return 0;
+}
@@ -0,0 +1,396 @@
+#include "captureengine.h"
+#include <QDebug>
+#include <QMutexLocker>
+#include <cerrno>
+#include <cstring>
+
+#ifdef Q_OS_LINUX
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <termios.h>
+#include <unistd.h>
+#endif
+
+#include "utils/captureclock.h"
+
+constexpr size_t CapturePort::MAX_READ_SIZE;
+constexpr quint64 CaptureEngine::WAKE_TOKEN;
+
+#ifdef Q_OS_LINUX
+namespace {
+
+speed_t toSpeed(qint32 _baudRate)
+{
+    static const struct { qint32 baudRate; speed_t speed; } speeds[] {
+        {1200, B1200}, {2400, B2400}, {4800, B4800}, {9600, B9600}, {19200, B19200},
+        {38400, B38400}, {57600, B57600}, {115200, B115200}, {230400, B230400},
+        {460800, B460800}, {500000, B500000}, {576000, B576000}, {921600, B921600},
+        {1000000, B1000000}, {1152000, B1152000}, {1500000, B1500000}, {2000000, B2000000},
+        {2500000, B2500000}, {3000000, B3000000}, {3500000, B3500000}, {4000000, B4000000},
+    };
+    for (const auto &entry : speeds) {
+        if (entry.baudRate == _baudRate)
+            return entry.speed;
+    }
+    return B0;
+}
+
+// raw 8N1, non-blocking; -1 and *_error set on failure
+int openRaw(const QString &_name, qint32 _baudRate, QString *_error)
+{
+    const auto path = _name.startsWith('/') ? _name : "/dev/" + _name;
+    const auto speed = toSpeed(_baudRate);
+    if (speed == B0) {
+        *_error = QString("%1: unsupported baud rate %2").arg(path).arg(_baudRate);
+        return -1;
+    }
+
+    const auto fd = ::open(path.toLocal8Bit().constData(), O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) {
+        *_error = QString("%1: %2").arg(path, strerror(errno));
+        return -1;
+    }
+
+    termios tio {};
+    if (tcgetattr(fd, &tio) == 0) {
+        cfmakeraw(&tio);
+        tio.c_cflag |= CLOCAL | CREAD;
+        tio.c_cc[VMIN] = 0;
+        tio.c_cc[VTIME] = 0;
+        cfsetispeed(&tio, speed);
+        cfsetospeed(&tio, speed);
+    }
+    if (tcsetattr(fd, TCSANOW, &tio) != 0) {
+        *_error = QString("%1: %2").arg(path, strerror(errno));
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+} // namespace
+#endif
+
+CapturePort::CapturePort(CaptureEngine &_engine, int _channel, int _fd, qint64 _characterTime)
+    : ChunkSource(&_engine)
+    , m_engine(_engine)
+    , m_channel(_channel)
+    , m_direction(HistoryModel::channelDirection(_channel))
+    , m_fd(_fd)
+{
+    portOpened(_characterTime);
+}
+
+CapturePort::~CapturePort()
+{
+#ifdef Q_OS_LINUX
+    if (m_fd >= 0)
+        ::close(m_fd);
+#endif
+}
+
+int CapturePort::channel() const
+{
+    return m_channel;
+}
+
+bool CapturePort::isOpen() const
+{
+    return m_open;
+}
+
+void CapturePort::runOnReader(const std::function<void()> &_function)
+{
+    m_engine.runOnReactor(_function);
+}
+
+void CapturePort::resumeReading()
+{
+    m_resumePending = true;
+    m_engine.wake();
+}
+
+bool CapturePort::readAvailable()
+{
+    bool queued = false;
+    bool keepReading = true;
+
+#ifdef Q_OS_LINUX
+    forever {
+        size_t length {};
+        uint64_t position {};
+        const auto buffer = acquireRead(MAX_READ_SIZE, &length, &position);
+        if (!buffer) {
+            keepReading = false;
+            break;
+        }
+
+        // EAGAIN once the driver buffer is empty, errors come with EPOLLHUP/EPOLLERR
+        const auto read = ::read(m_fd, buffer, length);
+        if (read <= 0)
+            break;
+
+        // one clock read per chunk, it dates the last byte
+        const auto timestamp = captureclock::now();
+        commitRead(buffer, position, size_t(read), m_direction, timestamp);
+        queued = true;
+
+        // a short read drained the driver, save the EAGAIN round trip
+        if (size_t(read) < length)
+            break;
+    }
+#endif
+
+    if (queued)
+        announce();
+    return keepReading;
+}
+
+CaptureEngine::CaptureEngine(QObject *parent)
+    : QObject(parent)
+{
+}
+
+CaptureEngine::~CaptureEngine()
+{
+    close();
+}
+
+bool CaptureEngine::isSupported()
+{
+#ifdef Q_OS_LINUX
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool CaptureEngine::open(const QVector<PortSettings> &_ports)
+{
+    close();
+    m_errorString.clear();
+
+#ifdef Q_OS_LINUX
+    if (_ports.isEmpty() || _ports.size() > HistoryModel::MAX_CHANNELS) {
+        m_errorString = QString("between 1 and %1 ports can be captured").arg(HistoryModel::MAX_CHANNELS);
+        return false;
+    }
+
+    m_epoll = epoll_create1(EPOLL_CLOEXEC);
+    m_wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_epoll < 0 || m_wakeFd < 0) {
+        m_errorString = strerror(errno);
+        close();
+        return false;
+    }
+
+    epoll_event event {};
+    event.events = EPOLLIN;
+    event.data.u64 = WAKE_TOKEN;
+    epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_wakeFd, &event);
+
+    for (const auto &settings : _ports) {
+        const auto fd = openRaw(settings.name, settings.baudRate, &m_errorString);
+        if (fd < 0) {
+            qWarning() << m_errorString;
+            close();
+            return false;
+        }
+
+        const auto channel = m_ports.size();
+        m_ports.append(new CapturePort(*this, channel, fd, captureclock::byteDuration(settings.baudRate, 10)));
+
+        // level triggered, a port left unread is reported again by the next wait
+        event.events = EPOLLIN;
+        event.data.u64 = quint64(channel);
+        if (epoll_ctl(m_epoll, EPOLL_CTL_ADD, fd, &event) != 0) {
+            m_errorString = QString("%1: %2").arg(settings.name, strerror(errno));
+            close();
+            return false;
+        }
+    }
+
+    m_running = true;
+    m_thread = std::thread([this](){ run(); });
+    return true;
+#else
+    Q_UNUSED(_ports)
+    m_errorString = "the capture engine needs epoll, it is only available on Linux";
+    return false;
+#endif
+}
+
+void CaptureEngine::stop()
+{
+    if (!m_thread.joinable())
+        return;
+
+    m_running = false;
+    wake();
+    m_thread.join();
+}
+
+void CaptureEngine::close()
+{
+    stop();
+
+    qDeleteAll(m_ports);
+    m_ports.clear();
+
+#ifdef Q_OS_LINUX
+    if (m_wakeFd >= 0)
+        ::close(m_wakeFd);
+    if (m_epoll >= 0)
+        ::close(m_epoll);
+#endif
+    m_wakeFd = -1;
+    m_epoll = -1;
+}
+
+bool CaptureEngine::isOpen() const
+{
+    // until stop(), even if an error ended the reactor, the ports are still there to close
+    return m_thread.joinable();
+}
+
+QString CaptureEngine::errorString() const
+{
+    return m_errorString;
+}
+
+int CaptureEngine::portCount() const
+{
+    return m_ports.size();
+}
+
+CapturePort *CaptureEngine::port(int _channel) const
+{
+    return m_ports.value(_channel, nullptr);
+}
+
+void CaptureEngine::runOnReactor(const std::function<void()> &_function)
+{
+    if (!m_thread.joinable() || std::this_thread::get_id() == m_thread.get_id()) {
+        _function();
+        return;
+    }
+
+    QMutexLocker locker(&m_commandMutex);
+    while (m_command)
+        m_commandDone.wait(&m_commandMutex);
+    if (!m_running) {
+        // the reactor has left its loop, nothing else touches the ports
+        locker.unlock();
+        _function();
+        return;
+    }
+    m_command = &_function;
+    wake();
+    while (m_command == &_function)
+        m_commandDone.wait(&m_commandMutex);
+}
+
+void CaptureEngine::wake()
+{
+#ifdef Q_OS_LINUX
+    const quint64 one = 1;
+    if (::write(m_wakeFd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+        qWarning() << "eventfd" << strerror(errno);
+#endif
+}
+
+void CaptureEngine::run()
+{
+#ifdef Q_OS_LINUX
+    pthread_setname_np(pthread_self(), "capture-epoll");
+
+    static constexpr int MAX_EVENTS = 64;
+    epoll_event events[MAX_EVENTS];
+
+    while (m_running) {
+        const auto count = epoll_wait(m_epoll, events, MAX_EVENTS, -1);
+        if (count < 0) {
+            if (errno == EINTR)
+                continue;
+            qWarning() << "epoll_wait" << strerror(errno);
+            break;
+        }
+
+        for (int i = 0; i < count; ++i) {
+            if (events[i].data.u64 == WAKE_TOKEN) {
+                quint64 wakeups {};
+                if (::read(m_wakeFd, &wakeups, sizeof(wakeups)) < 0 && errno != EAGAIN)
+                    qWarning() << "eventfd" << strerror(errno);
+                runCommands();
+
+                // the consumer made room in the rings of stalled ports
+                for (const auto port : qAsConst(m_ports)) {
+                    if (port->m_resumePending.exchange(false) && port->m_open)
+                        arm(port, port->readAvailable());
+                }
+                continue;
+            }
+
+            const auto port = m_ports.at(int(events[i].data.u64));
+            if (!port->m_open)
+                continue;
+            if ((events[i].events & EPOLLIN) && !port->readAvailable())
+                arm(port, false); // popChunk() resumes it
+            if (events[i].events & (EPOLLHUP | EPOLLERR))
+                hangUp(port);
+        }
+    }
+
+    // an error ends the loop as well: a caller waiting behind a command must not hang,
+    // and later ones run their commands themselves
+    {
+        QMutexLocker locker(&m_commandMutex);
+        m_running = false;
+    }
+    runCommands();
+#endif
+}
+
+void CaptureEngine::runCommands()
+{
+    QMutexLocker locker(&m_commandMutex);
+    if (!m_command)
+        return;
+
+    (*m_command)();
+    m_command = nullptr;
+    m_commandDone.wakeAll();
+}
+
+void CaptureEngine::arm(CapturePort *_port, bool _armed)
+{
+#ifdef Q_OS_LINUX
+    if (_port->m_armed == _armed)
+        return;
+
+    // disarmed ports still report EPOLLHUP and EPOLLERR
+    epoll_event event {};
+    event.events = _armed ? EPOLLIN : 0;
+    event.data.u64 = quint64(_port->m_channel);
+    if (epoll_ctl(m_epoll, EPOLL_CTL_MOD, _port->m_fd, &event) == 0)
+        _port->m_armed = _armed;
+#else
+    Q_UNUSED(_port)
+    Q_UNUSED(_armed)
+#endif
+}
+
+void CaptureEngine::hangUp(CapturePort *_port)
+{
+#ifdef Q_OS_LINUX
+    qWarning() << "channel" << _port->m_channel + 1 << "hung up";
+    epoll_ctl(m_epoll, EPOLL_CTL_DEL, _port->m_fd, nullptr);
+    ::close(_port->m_fd);
+    _port->m_fd = -1;
+    _port->m_open = false;
+#else
+    Q_UNUSED(_port)
+#endif
+}
@@ -0,0 +1,103 @@
+#ifndef CAPTUREENGINE_H
+#define CAPTUREENGINE_H
+
+#include <QObject>
+#include <QString>
+#include <QVector>
+#include <QMutex>
+#include <QWaitCondition>
+#include <atomic>
+#include <functional>
+#include <thread>
+
+#include "controllers/chunksource.h"
+
+class CaptureEngine;
+
+// One channel of a CaptureEngine, its chunks carry HistoryModel::channelDirection()
+class CapturePort : public ChunkSource
+{
+    Q_OBJECT
+public:
+    CapturePort(CaptureEngine &_engine, int _channel, int _fd, qint64 _characterTime);
+    ~CapturePort();
+
+    int channel() const;
+    bool isOpen() const; // false once the device hung up
+
+protected:
+    void runOnReader(const std::function<void()> &_function) override;
+    void resumeReading() override;
+
+private:
+    friend class CaptureEngine;
+
+    // reactor thread, returns false while the consumer is behind
+    bool readAvailable();
+
+private:
+    static constexpr size_t MAX_READ_SIZE = 64 * 1024;
+
+    CaptureEngine &m_engine;
+    const int m_channel;
+    const HistoryModel::DataDirection m_direction;
+    int m_fd {-1};
+    std::atomic<bool> m_open {true};
+    std::atomic<bool> m_resumePending {false};
+    bool m_armed {true}; // reactor thread only
+};
+
+// Captures N serial ports from a single reactor thread. Every port is opened raw and
+// non-blocking and watched by one epoll set, so adding ports costs file descriptors,
+// not threads. Each port queues its chunks like a SerialHandler, UpdateScheduler
+// merges them by timestamp. Linux only, isSupported() tells.
+class CaptureEngine : public QObject
+{
+    Q_OBJECT
+public:
+    struct PortSettings {
+        QString name; // "ttyUSB0" or a full path
+        qint32 baudRate;
+    };
+
+    explicit CaptureEngine(QObject *parent = nullptr);
+    ~CaptureEngine();
+
+    static bool isSupported();
+
+    // GUI thread; opens every port or none, the previous ports are closed first
+    bool open(const QVector<PortSettings> &_ports);
+    void stop(); // stops reading, the ports keep their queued chunks until close()
+    void close();
+    bool isOpen() const; // from open() until stop()
+    QString errorString() const;
+
+    int portCount() const;
+    CapturePort *port(int _channel) const; // valid until close()
+
+private:
+    friend class CapturePort;
+
+    // calls _function on the reactor thread and waits for it
+    void runOnReactor(const std::function<void()> &_function);
+    void wake();
+    void run();
+    void runCommands();
+    void arm(CapturePort *_port, bool _armed);
+    void hangUp(CapturePort *_port);
+
+private:
+    static constexpr quint64 WAKE_TOKEN = ~quint64(0);
+
+    QVector<CapturePort *> m_ports {};
+    int m_epoll {-1};
+    int m_wakeFd {-1};
+    std::thread m_thread {};
+    std::atomic<bool> m_running {false}; // the reactor loop runs, cleared under m_commandMutex when it ends
+    QMutex m_commandMutex {};
+    QWaitCondition m_commandDone {};
+    const std::function<void()> *m_command {nullptr}; // guarded by m_commandMutex
+    QString m_errorString {};
+};
+
+#endif // CAPTUREENGINE_H
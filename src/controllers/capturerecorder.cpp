@@ -0,0 +1,183 @@
+#include "capturerecorder.h"
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QMutexLocker>
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+
+#include "utils/captureclock.h"
+
+constexpr int CaptureRecorder::FLUSH_INTERVAL_MS;
+
+CaptureRecorder::~CaptureRecorder()
+{
+    stop();
+}
+
+bool CaptureRecorder::start(const QString &_indexPath)
+{
+    stop();
+
+    if (!m_writer.open(_indexPath)) {
+        setError(m_writer.errorString());
+        return false;
+    }
+
+    setError(QString());
+    m_fileName = _indexPath;
+    m_bytesWritten = 0;
+    m_droppedChunks = 0;
+    m_running = true;
+    m_thread = std::thread([this](){ run(); });
+    return true;
+}
+
+void CaptureRecorder::stop()
+{
+    if (!m_thread.joinable())
+        return;
+
+    m_running = false;
+    m_thread.join();
+}
+
+bool CaptureRecorder::isRecording() const
+{
+    return m_running;
+}
+
+QString CaptureRecorder::fileName() const
+{
+    return m_fileName;
+}
+
+QString CaptureRecorder::errorString() const
+{
+    QMutexLocker locker(&m_errorMutex);
+    return m_errorString;
+}
+
+void CaptureRecorder::setSyncInterval(int _ms)
+{
+    m_syncInterval = std::max(_ms, 0);
+}
+
+int CaptureRecorder::syncInterval() const
+{
+    return m_syncInterval;
+}
+
+void CaptureRecorder::record(quint8 _direction, qint64 _timestamp, const char *_data, size_t _length)
+{
+    // twice the length free guarantees the copy fits in at most two regions,
+    // so a chunk is either queued whole or not at all
+    if (m_ring.capacity() - m_ring.used() < 2 * _length || m_entries.capacity() - m_entries.size() < 2) {
+        m_droppedChunks++;
+        return;
+    }
+
+    size_t copied = 0;
+    while (copied < _length) {
+        size_t length {};
+        uint64_t position {};
+        const auto buffer = m_ring.acquire(_length - copied, &length, &position);
+        Q_ASSERT(buffer);
+
+        memcpy(buffer, _data + copied, length);
+        m_ring.commit(length);
+        copied += length;
+        m_entries.push(Entry {position, quint32(length), _direction, copied == _length, _timestamp});
+    }
+}
+
+CaptureRecorder::Stats CaptureRecorder::takeStats()
+{
+    return Stats {
+        m_bytesWritten.exchange(0),
+        m_droppedChunks.exchange(0),
+        m_ring.used(),
+        m_entries.size()
+    };
+}
+
+void CaptureRecorder::run()
+{
+    QElapsedTimer sinceFlush {};
+    QElapsedTimer sinceSync {};
+    sinceFlush.start();
+    sinceSync.start();
+
+    // keep draining after stop() was requested until the queue is empty
+    while (true) {
+        const auto stopping = !m_running;
+        const auto wrote = drain();
+
+        // the writer buffers up to a large block, flush it now and then at low data rates
+        if (sinceFlush.elapsed() >= FLUSH_INTERVAL_MS) {
+            if (!m_writer.flush())
+                setError(m_writer.errorString());
+            sinceFlush.restart();
+        }
+
+        const auto syncInterval = m_syncInterval.load();
+        if (syncInterval > 0 && sinceSync.elapsed() >= syncInterval) {
+            if (!m_writer.sync())
+                setError(m_writer.errorString());
+            sinceSync.restart();
+        }
+
+        if (stopping)
+            break;
+        if (!wrote)
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+
+    if (!m_writer.close())
+        setError(m_writer.errorString());
+    m_pending.clear();
+}
+
+bool CaptureRecorder::drain()
+{
+    bool wrote = false;
+
+    while (const auto entry = m_entries.front()) {
+        const auto data = m_ring.data(entry->position);
+        const auto timestamp = captureclock::toNSecsSinceEpoch(entry->timestamp);
+
+        bool ok = true;
+        if (!entry->last) {
+            m_pending.append(data, int(entry->length));
+        } else if (!m_pending.isEmpty()) {
+            m_pending.append(data, int(entry->length));
+            ok = m_writer.append(entry->direction, timestamp, m_pending.constData(), m_pending.size());
+            m_pending.resize(0);
+        } else {
+            ok = m_writer.append(entry->direction, timestamp, data, int(entry->length));
+        }
+
+        // on a write error chunks are still consumed, the reader must never stall
+        if (ok)
+            m_bytesWritten += entry->length;
+        else
+            setError(m_writer.errorString());
+
+        m_ring.release(entry->position + entry->length);
+        m_entries.pop();
+        wrote = true;
+    }
+
+    return wrote;
+}
+
+void CaptureRecorder::setError(const QString &_error)
+{
+    QMutexLocker locker(&m_errorMutex);
+    if (_error == m_errorString)
+        return;
+
+    if (!_error.isEmpty())
+        qWarning() << m_fileName << _error;
+    m_errorString = _error;
+}
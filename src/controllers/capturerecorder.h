@@ -0,0 +1,77 @@
+#ifndef CAPTURERECORDER_H
+#define CAPTURERECORDER_H
+
+#include <QString>
+#include <QByteArray>
+#include <QMutex>
+#include <atomic>
+#include <thread>
+
+#include "models/capturefile.h"
+#include "utils/ringbuffer.h"
+
+// Streams every received chunk to a capture file from its own writer thread.
+// The serial readers copy chunks into a lock-free ring and never wait for the
+// disk, a chunk that doesn't fit is dropped and counted instead.
+class CaptureRecorder
+{
+public:
+    struct Stats {
+        quint64 bytesWritten; // since the last takeStats()
+        quint64 droppedChunks;
+        size_t queuedBytes;
+        size_t queuedChunks;
+    };
+
+    CaptureRecorder() = default;
+    ~CaptureRecorder();
+    CaptureRecorder(const CaptureRecorder &) = delete;
+    CaptureRecorder &operator=(const CaptureRecorder &) = delete;
+
+    // GUI thread, the producer must be detached before stop()
+    bool start(const QString &_indexPath);
+    void stop(); // writes what is queued, then closes the capture
+    bool isRecording() const;
+    QString fileName() const;
+    QString errorString() const;
+
+    // fsync the capture every _ms milliseconds, 0 leaves it to the OS
+    void setSyncInterval(int _ms);
+    int syncInterval() const;
+
+    // producer side, a single thread only (the serial I/O thread)
+    void record(quint8 _direction, qint64 _timestamp, const char *_data, size_t _length);
+
+    Stats takeStats(); // resets the written and dropped counters
+
+private:
+    void run();
+    bool drain(); // returns whether anything was written
+    void setError(const QString &_error);
+
+private:
+    struct Entry {
+        uint64_t position;
+        quint32 length;
+        quint8 direction;
+        bool last; // a chunk wrapping around the ring is queued as two entries
+        qint64 timestamp; // capture clock, ns
+    };
+
+    static constexpr int FLUSH_INTERVAL_MS = 250;
+
+    SpscByteRing m_ring {16 * 1024 * 1024};
+    SpscQueue<Entry> m_entries {64 * 1024};
+    CaptureWriter m_writer {}; // writer thread only while recording
+    QByteArray m_pending {}; // first part of a wrapped chunk, writer thread only
+    std::thread m_thread {};
+    std::atomic<bool> m_running {false};
+    std::atomic<int> m_syncInterval {0};
+    std::atomic<quint64> m_bytesWritten {0};
+    std::atomic<quint64> m_droppedChunks {0};
+    QString m_fileName {};
+    mutable QMutex m_errorMutex {};
+    QString m_errorString {};
+};
+
+#endif // CAPTURERECORDER_H
@@ -0,0 +1,197 @@
+#include "chunksource.h"
+#include <algorithm>
+
+#include "controllers/capturerecorder.h"
+#include "utils/captureclock.h"
+
+std::atomic<quint64> ChunkSource::s_sequence {0};
+
+ChunkSource::ChunkSource(QObject *parent)
+    : QObject(parent)
+{
+}
+
+ChunkSource::~ChunkSource()
+{
+    delete m_decoder;
+}
+
+void ChunkSource::setByteTimestampsEnabled(bool _enabled)
+{
+    m_byteTimestampsEnabled = _enabled;
+}
+
+bool ChunkSource::byteTimestampsEnabled() const
+{
+    return m_byteTimestampsEnabled;
+}
+
+void ChunkSource::setFrameDecoder(FrameDecoder *_decoder)
+{
+    runOnReader([&](){
+        delete m_decoder;
+        m_decoder = _decoder;
+        if (m_decoder)
+            m_decoder->setCharacterTime(m_characterTime);
+    });
+}
+
+bool ChunkSource::hasFrameDecoder() const
+{
+    return m_decoder;
+}
+
+FrameDecoder::Stats ChunkSource::takeFrameDecoderStats()
+{
+    return m_decoder ? m_decoder->takeStats() : FrameDecoder::Stats {};
+}
+
+void ChunkSource::setRecorder(CaptureRecorder *_recorder)
+{
+    runOnReader([&](){
+        m_recorder = _recorder;
+    });
+}
+
+const ChunkSource::Chunk *ChunkSource::frontChunk()
+{
+    // new data after this point will be announced again
+    m_notifyPending = false;
+    return m_chunks.front();
+}
+
+size_t ChunkSource::queuedChunks()
+{
+    m_notifyPending = false;
+    return m_chunks.size();
+}
+
+const ChunkSource::Chunk *ChunkSource::chunkAt(size_t _index)
+{
+    return m_chunks.at(_index);
+}
+
+const char *ChunkSource::chunkBytes(const Chunk &_chunk) const
+{
+    return m_ring.data(_chunk.position);
+}
+
+QByteArray ChunkSource::chunkData(const Chunk &_chunk) const
+{
+    return QByteArray::fromRawData(chunkBytes(_chunk), int(_chunk.length));
+}
+
+void ChunkSource::popChunk()
+{
+    const auto chunk = m_chunks.front();
+    Q_ASSERT(chunk);
+    m_ring.release(chunk->position + chunk->length);
+    m_chunks.pop();
+
+    // the reader stopped because the ring was full, let it continue
+    if (m_stalled.exchange(false))
+        resumeReading();
+}
+
+size_t ChunkSource::bufferedBytes() const
+{
+    return m_ring.used();
+}
+
+double ChunkSource::fillLevel() const
+{
+    return std::max(double(m_ring.used()) / m_ring.capacity(), double(m_chunks.size()) / m_chunks.capacity());
+}
+
+quint64 ChunkSource::stallCount() const
+{
+    return m_stallCount;
+}
+
+quint64 ChunkSource::receivedBytes() const
+{
+    return m_receivedBytes.load(std::memory_order_relaxed);
+}
+
+void ChunkSource::portOpened(qint64 _characterTime)
+{
+    m_characterTime = _characterTime;
+    m_lastTimestamp = captureclock::now();
+    if (m_decoder)
+        m_decoder->setCharacterTime(_characterTime);
+}
+
+qint64 ChunkSource::characterTime() const
+{
+    return m_characterTime;
+}
+
+char *ChunkSource::acquireRead(size_t _wanted, size_t *_length, uint64_t *_position)
+{
+    // every byte may start a frame, and every frame takes a chunk
+    if (m_decoder)
+        _wanted = std::max<size_t>(1, std::min(_wanted, m_chunks.capacity() - m_chunks.size()));
+
+    forever {
+        const auto buffer = m_ring.acquire(_wanted, _length, _position);
+        if (buffer && m_chunks.size() < m_chunks.capacity())
+            return buffer;
+
+        // consumer is behind, keep the rest in the port buffer until popChunk()
+        m_stalled = true;
+
+        // the consumer may have drained everything before it could see the flag
+        if (m_ring.used() == m_ring.capacity() || m_chunks.size() == m_chunks.capacity() || !m_stalled.exchange(false)) {
+            m_stallCount++;
+            return nullptr;
+        }
+    }
+}
+
+void ChunkSource::commitRead(const char *_data, uint64_t _position, size_t _length, HistoryModel::DataDirection _direction, qint64 _timestamp)
+{
+    const auto length = qint64(_length);
+
+    // the bytes arrived one character time apart, but not before the previous chunk
+    qint64 byteTime = 0;
+    if (m_byteTimestampsEnabled && length > 1)
+        byteTime = std::min<qint64>(m_characterTime, (_timestamp - m_lastTimestamp) / length);
+    const auto gap = _timestamp - length * m_characterTime - m_lastTimestamp; // silence before the first byte
+    m_lastTimestamp = _timestamp;
+
+    if (m_recorder)
+        m_recorder->record(quint8(_direction), _timestamp, _data, _length);
+
+    m_ring.commit(_length);
+    m_receivedBytes.fetch_add(_length, std::memory_order_relaxed);
+    if (m_decoder)
+        queueFrames(_data, _position, length, _direction, _timestamp, byteTime, gap);
+    else
+        m_chunks.push(Chunk {_position, quint32(_length), _direction, s_sequence++, _timestamp, byteTime, HistoryModel::Unframed});
+}
+
+void ChunkSource::announce()
+{
+    if (!m_notifyPending.exchange(true))
+        emit dataAvailable();
+}
+
+void ChunkSource::queueFrames(const char *_data, uint64_t _position, qint64 _length, HistoryModel::DataDirection _direction,
+                              qint64 _timestamp, qint64 _byteTime, qint64 _gap)
+{
+    m_frameStarts.clear();
+    m_decoder->decode(_data, int(_length), _gap, &m_frameStarts);
+
+    // one chunk per frame in the read, dated by its last byte
+    auto start = 0;
+    auto framing = HistoryModel::FrameContinued;
+    for (int i = 0; i <= m_frameStarts.size(); ++i) {
+        const auto end = i < m_frameStarts.size() ? m_frameStarts.at(i) : int(_length);
+        if (end > start) {
+            m_chunks.push(Chunk {_position + uint64_t(start), quint32(end - start), _direction, s_sequence++,
+                                 _timestamp - (_length - end) * _byteTime, _byteTime, framing});
+        }
+        start = end;
+        framing = HistoryModel::FrameStarted;
+    }
+}
@@ -0,0 +1,104 @@
+#ifndef CHUNKSOURCE_H
+#define CHUNKSOURCE_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QVector>
+#include <atomic>
+#include <functional>
+
+#include "models/historymodel.h"
+#include "utils/framedecoder.h"
+#include "utils/ringbuffer.h"
+
+class CaptureRecorder;
+
+// The received bytes of one port, read straight into a preallocated SPSC ring on the
+// reader thread and announced as chunks. The GUI thread consumes them in place with
+// frontChunk()/popChunk(). Readers, SerialHandler or the ports of a CaptureEngine,
+// produce with acquireRead()/commitRead().
+class ChunkSource : public QObject
+{
+    Q_OBJECT
+public:
+    struct Chunk {
+        quint64 position;
+        quint32 length;
+        HistoryModel::DataDirection direction;
+        quint64 sequence; // global read order across all sources
+        qint64 timestamp; // capture clock when the read returned, ns
+        qint64 byteTime; // ns between interpolated byte timestamps, 0 if disabled
+        HistoryModel::Framing framing; // a read is split where frames start
+    };
+
+    explicit ChunkSource(QObject *parent = nullptr);
+    ~ChunkSource();
+
+    // spread the timestamps of a chunk's bytes back in time according to the baud rate
+    void setByteTimestampsEnabled(bool _enabled);
+    bool byteTimestampsEnabled() const;
+
+    // segments the received bytes into the frames of a protocol, on the reader;
+    // takes ownership, nullptr for rows by newlines, count and duration
+    void setFrameDecoder(FrameDecoder *_decoder);
+    bool hasFrameDecoder() const; // GUI thread
+    FrameDecoder::Stats takeFrameDecoderStats(); // GUI thread, zeros without a decoder
+
+    // every chunk is also handed to the recorder, from the reader itself;
+    // once this returns the previous recorder is no longer used
+    void setRecorder(CaptureRecorder *_recorder);
+
+    // consumer side, GUI thread only
+    const Chunk *frontChunk();
+    size_t queuedChunks(); // chunks queued after this call are announced again
+    const Chunk *chunkAt(size_t _index); // _index < queuedChunks(), 0 is the front
+    const char *chunkBytes(const Chunk &_chunk) const; // valid until the chunk is popped
+    QByteArray chunkData(const Chunk &_chunk) const; // no copy, valid until popChunk()
+    void popChunk();
+
+    size_t bufferedBytes() const;
+    double fillLevel() const; // 0 to 1, the fuller of the byte ring and the chunk queue
+    quint64 stallCount() const; // reads put off while the consumer was behind, the bytes wait in the port
+    quint64 receivedBytes() const; // since the source was created, thread-safe
+
+protected:
+    // calls _function on the reader thread and waits for it
+    virtual void runOnReader(const std::function<void()> &_function) = 0;
+    // consumer thread: room was made after acquireRead() failed, read again
+    virtual void resumeReading() = 0;
+
+    // producer side, reader thread only
+    void portOpened(qint64 _characterTime); // ns per character at the port settings
+    qint64 characterTime() const;
+    // a region for up to _wanted bytes, nullptr while the consumer is behind; resumeReading() follows then
+    char *acquireRead(size_t _wanted, size_t *_length, uint64_t *_position);
+    // queues _length bytes read into the acquired region, _timestamp dates the last one
+    void commitRead(const char *_data, uint64_t _position, size_t _length, HistoryModel::DataDirection _direction, qint64 _timestamp);
+    void announce(); // once per batch of commitRead()
+
+signals:
+    // emitted once per batch of chunks, until the consumer drains the queue
+    void dataAvailable();
+
+private:
+    void queueFrames(const char *_data, uint64_t _position, qint64 _length, HistoryModel::DataDirection _direction,
+                     qint64 _timestamp, qint64 _byteTime, qint64 _gap);
+
+private:
+    static std::atomic<quint64> s_sequence;
+
+    SpscByteRing m_ring {4 * 1024 * 1024};
+    SpscQueue<Chunk> m_chunks {16 * 1024};
+    CaptureRecorder *m_recorder {nullptr}; // reader thread only
+    FrameDecoder *m_decoder {nullptr}; // replaced on the reader thread while the GUI thread waits
+    QVector<int> m_frameStarts {}; // reader thread only
+    std::atomic<bool> m_notifyPending {false};
+    std::atomic<bool> m_stalled {false};
+    std::atomic<quint64> m_stallCount {0};
+    std::atomic<quint64> m_receivedBytes {0};
+    std::atomic<bool> m_byteTimestampsEnabled {false};
+    std::atomic<qint64> m_characterTime {0}; // ns per character at the current settings
+    qint64 m_lastTimestamp {}; // reader thread only
+};
+
+#endif // CHUNKSOURCE_H
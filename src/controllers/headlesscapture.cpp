@@ -0,0 +1,372 @@
+#include "headlesscapture.h"
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDateTime>
+#include <QDebug>
+#include <algorithm>
+#include <csignal>
+#include <cstring>
+
+#include "utils/captureclock.h"
+#include "utils/hexformat.h"
+
+namespace {
+
+volatile std::sig_atomic_t s_stopRequested = 0;
+
+void requestStop(int)
+{
+    s_stopRequested = 1;
+}
+
+char *appendDigits(char *_out, qint64 _value, int _digits)
+{
+    for (int i = _digits - 1; i >= 0; --i) {
+        _out[i] = char('0' + _value % 10);
+        _value /= 10;
+    }
+    return _out + _digits;
+}
+
+} // namespace
+
+constexpr int HeadlessCapture::OUTPUT_BUFFER_SIZE;
+
+HeadlessCapture::HeadlessCapture(const Options &_options, QObject *parent)
+    : QObject(parent)
+    , m_options(_options)
+{
+}
+
+HeadlessCapture::~HeadlessCapture()
+{
+    stop();
+}
+
+bool HeadlessCapture::start()
+{
+    if (m_options.portA.isEmpty() && m_options.portB.isEmpty() && m_options.channels.isEmpty()) {
+        qCritical() << "no port given";
+        return false;
+    }
+    if (!m_options.channels.isEmpty() && (!m_options.portA.isEmpty() || !m_options.portB.isEmpty())) {
+        qCritical() << "channels replace ports A and B";
+        return false;
+    }
+
+    const auto opened = m_options.output.isEmpty()
+            ? m_output.open(stdout, QIODevice::WriteOnly)
+            : m_output.open(m_options.output, QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Unbuffered);
+    if (!opened) {
+        qCritical() << m_options.output << m_output.errorString();
+        return false;
+    }
+    m_buffer.reserve(OUTPUT_BUFFER_SIZE + 1024);
+
+    // the timestamp column is local time, like in the GUI
+    m_utcOffsetNs = qint64(QDateTime::currentDateTime().offsetFromUtc()) * 1000000000;
+
+    // same segmentation as the table, rows leave the history as soon as they are written
+    m_history.setHistoryCapacity(100000);
+    m_history.setNewlineAfterCount(m_options.newlineAfterCount);
+    m_history.setNewlineAfterCountEnabled(m_options.newlineAfterCount > 0);
+    m_history.setNewlineAfterDuration(m_options.newlineAfterDuration);
+    m_history.setNewlineAfterDurationEnabled(m_options.newlineAfterDuration > 0);
+
+    m_ioThread.setObjectName("serial-io");
+    m_portA.moveToThread(&m_ioThread);
+    m_portB.moveToThread(&m_ioThread);
+    m_ioThread.start(QThread::TimeCriticalPriority);
+
+    m_portA.setPeer(&m_portB);
+    m_portB.setPeer(&m_portA);
+    m_portA.setForwardingEnabled(m_options.bridge);
+    m_portB.setForwardingEnabled(m_options.bridge);
+    m_portA.setByteTimestampsEnabled(m_options.byteTimestamps);
+    m_portB.setByteTimestampsEnabled(m_options.byteTimestamps);
+
+    QString error {};
+    m_portA.setFrameDecoder(FrameDecoder::create(m_options.frameDecoder, &error));
+    m_portB.setFrameDecoder(FrameDecoder::create(m_options.frameDecoder));
+    if (!error.isEmpty()) {
+        qCritical() << error;
+        return false;
+    }
+
+    m_scheduler.setFlushInterval(m_options.flushInterval);
+    m_scheduler.addSource(&m_portA);
+    m_scheduler.addSource(&m_portB);
+    connect(&m_scheduler, &UpdateScheduler::flushed, this, &HeadlessCapture::onFlushed);
+
+    if (!m_options.portA.isEmpty() && !m_portA.open(m_options.portA, m_options.baudRateA)) {
+        qCritical() << m_options.portA << m_portA.errorString();
+        return false;
+    }
+    if (!m_options.portB.isEmpty() && !m_portB.open(m_options.portB, m_options.baudRateB)) {
+        qCritical() << m_options.portB << m_portB.errorString();
+        return false;
+    }
+
+    if (!m_options.channels.isEmpty()) {
+        QVector<CaptureEngine::PortSettings> ports {};
+        for (const auto &name : m_options.channels)
+            ports.append(CaptureEngine::PortSettings {name, m_options.baudRateA});
+        if (!m_engine.open(ports)) {
+            qCritical() << m_engine.errorString();
+            return false;
+        }
+
+        for (int i = 0; i < m_engine.portCount(); ++i) {
+            const auto port = m_engine.port(i);
+            port->setByteTimestampsEnabled(m_options.byteTimestamps);
+            port->setFrameDecoder(FrameDecoder::create(m_options.frameDecoder));
+            m_scheduler.addSource(port);
+            m_perf.addPort(HistoryModel::toString(HistoryModel::channelDirection(i)), port);
+        }
+    }
+
+    if (!m_options.statsFile.isEmpty()) {
+        if (!m_options.portA.isEmpty())
+            m_perf.addPort("A", &m_portA);
+        if (!m_options.portB.isEmpty())
+            m_perf.addPort("B", &m_portB);
+        m_perf.sample(); // not dumped, the rates of the first dump cover one second
+        if (!m_perf.startDump(m_options.statsFile)) {
+            qCritical() << m_options.statsFile << m_perf.errorString();
+            return false;
+        }
+        connect(&m_statsTimer, &QTimer::timeout, this, [this](){ m_perf.sample(); });
+        m_statsTimer.start(1000);
+    }
+
+    connect(&m_idleTimer, &QTimer::timeout, this, &HeadlessCapture::onIdle);
+    m_idleTimer.start(100);
+    return true;
+}
+
+void HeadlessCapture::stop()
+{
+    if (!m_ioThread.isRunning())
+        return;
+
+    m_idleTimer.stop();
+    m_statsTimer.stop();
+    m_engine.stop();
+    m_portA.close();
+    m_portB.close();
+    m_ioThread.quit();
+    m_ioThread.wait();
+
+    // whatever was read last, including the row that could still have grown
+    m_scheduler.flush();
+    writeRows(true);
+    m_output.close();
+
+    if (m_perf.isDumping()) {
+        m_perf.sample();
+        m_perf.stopDump();
+    }
+
+    if (m_lostRows > 0)
+        qWarning() << m_lostRows << "rows were dropped before they could be written";
+
+    if (m_portA.hasFrameDecoder()) {
+        const auto statsA = m_portA.takeFrameDecoderStats();
+        const auto statsB = m_portB.takeFrameDecoderStats();
+        qInfo() << "frames A:" << statsA.totalFrames << "errors:" << statsA.totalErrors
+                << "B:" << statsB.totalFrames << "errors:" << statsB.totalErrors;
+    }
+    for (int i = 0; i < m_engine.portCount(); ++i) {
+        const auto port = m_engine.port(i);
+        if (port->hasFrameDecoder()) {
+            const auto stats = port->takeFrameDecoderStats();
+            qInfo() << "frames" << HistoryModel::toString(HistoryModel::channelDirection(i)) << stats.totalFrames
+                    << "errors:" << stats.totalErrors;
+        }
+        m_scheduler.removeSource(port);
+        m_perf.removePort(port);
+    }
+    m_engine.close();
+}
+
+void HeadlessCapture::onFlushed()
+{
+    writeRows(false);
+}
+
+void HeadlessCapture::onIdle()
+{
+    if (s_stopRequested) {
+        stop();
+        QCoreApplication::quit();
+        return;
+    }
+
+    // a quiet line completes the newest row once the newline duration has passed;
+    // with per-byte timestamps the next chunk may date back further, so wait for it then
+    const auto count = m_history.rowCount();
+    if (count == 0 || m_options.newlineAfterDuration <= 0 || m_options.byteTimestamps)
+        return;
+
+    const auto idleNs = captureclock::toNSecsSinceEpoch(captureclock::now()) - m_history.rowUpdatedAt(count - 1);
+    if (idleNs > qint64(m_options.newlineAfterDuration) * 1000000)
+        writeRows(true);
+}
+
+void HeadlessCapture::writeRows(bool _includeNewest)
+{
+    const auto count = m_history.rowCount();
+    if (count == 0)
+        return;
+
+    const auto first = m_history.rowSerial(0);
+    if (m_nextSerial < first) {
+        m_lostRows += first - m_nextSerial;
+        m_nextSerial = first;
+    }
+
+    // the newest row may still grow
+    const auto end = first + count - (_includeNewest ? 0 : 1);
+    for (; m_nextSerial < end; ++m_nextSerial)
+        appendRow(int(m_nextSerial - first));
+
+    flushOutput();
+}
+
+void HeadlessCapture::appendRow(int _row)
+{
+    const auto data = m_history.rowData(_row);
+    const auto direction = m_history.rowDirection(_row);
+    const auto timestamp = m_history.rowCreatedAt(_row);
+
+    if (m_options.format == BinaryFormat) {
+        Record record {};
+        record.timestamp = timestamp;
+        record.length = quint32(data.length());
+        record.direction = quint8(direction);
+        m_buffer.append(reinterpret_cast<const char *>(&record), sizeof(record));
+        m_buffer.append(data);
+    } else {
+        appendTime(timestamp);
+        m_buffer.append(' ');
+        m_buffer.append(HistoryModel::toString(direction));
+        m_buffer.append(' ');
+
+        // format straight into the output buffer
+        const auto size = m_buffer.size();
+        if (m_options.format == HexFormat) {
+            m_buffer.resize(size + hexformat::hexBufferSize(data.length(), 0));
+            m_buffer.resize(size + hexformat::formatHex(data.constData(), data.length(), 0, m_buffer.data() + size));
+        } else {
+            m_buffer.resize(size + hexformat::asciiBufferSize(data.length(), 0));
+            m_buffer.resize(size + hexformat::formatAscii(data.constData(), data.length(), 0, m_buffer.data() + size));
+        }
+        m_buffer.append('\n');
+    }
+
+    if (m_buffer.size() >= OUTPUT_BUFFER_SIZE)
+        flushOutput();
+}
+
+void HeadlessCapture::appendTime(qint64 _timestamp)
+{
+    // HH:mm:ss.uuuuuu, local time of day
+    constexpr qint64 SECOND = 1000000000;
+    constexpr qint64 DAY = 24 * 3600 * SECOND;
+    auto time = (_timestamp + m_utcOffsetNs) % DAY;
+    if (time < 0)
+        time += DAY;
+
+    char text[15];
+    auto out = appendDigits(text, time / (3600 * SECOND), 2);
+    *out++ = ':';
+    out = appendDigits(out, time / (60 * SECOND) % 60, 2);
+    *out++ = ':';
+    out = appendDigits(out, time / SECOND % 60, 2);
+    *out++ = '.';
+    appendDigits(out, time % SECOND / 1000, 6);
+    m_buffer.append(text, sizeof(text));
+}
+
+bool HeadlessCapture::flushOutput()
+{
+    if (m_buffer.isEmpty())
+        return true;
+
+    const auto ok = m_output.write(m_buffer) == m_buffer.size() && m_output.flush();
+    m_buffer.resize(0); // keeps the capacity
+
+    if (!ok) {
+        qCritical() << "output" << m_output.errorString();
+        s_stopRequested = 1;
+    }
+    return ok;
+}
+
+int runHeadless(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("SerialSpy");
+
+    QCommandLineParser parser {};
+    parser.setApplicationDescription("Captures serial traffic without a GUI, completed rows are written as they arrive.");
+    parser.addHelpOption();
+
+    const QCommandLineOption headlessOption("headless", "Run without GUI.");
+    const QCommandLineOption portAOption(QStringList {"a", "port-a"}, "Port A.", "name");
+    const QCommandLineOption portBOption(QStringList {"b", "port-b"}, "Port B.", "name");
+    const QCommandLineOption channelsOption("channels", "Capture these ports on one epoll reactor instead of A and B, Linux only.",
+                                            "name,name,...");
+    const QCommandLineOption baudOption("baud", "Baud rate of both ports, or of every channel.", "rate", "115200");
+    const QCommandLineOption baudBOption("baud-b", "Baud rate of port B, if different.", "rate");
+    const QCommandLineOption bridgeOption("bridge", "Forward A <-> B.");
+    const QCommandLineOption byteTimestampsOption("byte-timestamps", "Interpolate byte timestamps from the baud rate.");
+    const QCommandLineOption formatOption(QStringList {"f", "format"}, "text, hex or binary.", "format", "text");
+    const QCommandLineOption outputOption(QStringList {"o", "output"}, "Output file, stdout by default.", "file");
+    const QCommandLineOption countOption("newline-after-bytes", "Split rows after this many bytes, 0 disables.", "bytes", "0");
+    const QCommandLineOption durationOption("newline-after-ms", "Split rows after this much silence, 0 disables.", "ms", "500");
+    const QCommandLineOption flushOption("flush-ms", "Write out at most every this many ms.", "ms", "50");
+    const QCommandLineOption decoderOption("decoder", QString("One row per frame: %1, options after a colon.")
+                                           .arg(FrameDecoder::names().join(", ")), "name[:options]");
+    const QCommandLineOption statsOption("stats", "Append performance counters to this file every second, CSV for a .csv file, "
+                                         "JSON Lines otherwise.", "file");
+    parser.addOptions({headlessOption, portAOption, portBOption, channelsOption, baudOption, baudBOption, bridgeOption, byteTimestampsOption,
+                       formatOption, outputOption, countOption, durationOption, flushOption, decoderOption, statsOption});
+    parser.process(app);
+
+    HeadlessCapture::Options options {};
+    options.portA = parser.value(portAOption);
+    options.portB = parser.value(portBOption);
+    for (const auto &name : parser.value(channelsOption).split(',', Qt::SkipEmptyParts))
+        options.channels.append(name.trimmed());
+    options.baudRateA = parser.value(baudOption).toInt();
+    options.baudRateB = parser.isSet(baudBOption) ? parser.value(baudBOption).toInt() : options.baudRateA;
+    options.bridge = parser.isSet(bridgeOption);
+    options.byteTimestamps = parser.isSet(byteTimestampsOption);
+    options.output = parser.value(outputOption);
+    options.newlineAfterCount = std::max(parser.value(countOption).toInt(), 0);
+    options.newlineAfterDuration = std::max(parser.value(durationOption).toInt(), 0);
+    options.flushInterval = std::max(parser.value(flushOption).toInt(), 1);
+    options.frameDecoder = parser.value(decoderOption);
+    options.statsFile = parser.value(statsOption);
+
+    const auto format = parser.value(formatOption);
+    if (format == "text") {
+        options.format = HeadlessCapture::TextFormat;
+    } else if (format == "hex") {
+        options.format = HeadlessCapture::HexFormat;
+    } else if (format == "binary") {
+        options.format = HeadlessCapture::BinaryFormat;
+    } else {
+        qCritical() << "unknown format" << format;
+        return 1;
+    }
+
+    HeadlessCapture capture(options);
+    if (!capture.start())
+        return 1;
+
+    std::signal(SIGINT, &requestStop);
+    std::signal(SIGTERM, &requestStop);
+    return app.exec();
+}
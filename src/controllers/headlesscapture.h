@@ -0,0 +1,93 @@
+#ifndef HEADLESSCAPTURE_H
+#define HEADLESSCAPTURE_H
+
+#include <QObject>
+#include <QThread>
+#include <QTimer>
+#include <QFile>
+#include <QByteArray>
+#include <QStringList>
+
+#include "controllers/captureengine.h"
+#include "controllers/perfmonitor.h"
+#include "controllers/serialhandler.h"
+#include "controllers/updatescheduler.h"
+#include "models/historymodel.h"
+
+// Captures without widgets: the ports are read and segmented exactly like in the GUI,
+// completed rows are streamed to stdout or a file instead of a table.
+class HeadlessCapture : public QObject
+{
+    Q_OBJECT
+public:
+    enum Format {
+        TextFormat, // timestamp, direction and the printable bytes
+        HexFormat, // timestamp, direction and the bytes in hex
+        BinaryFormat // Record header followed by the row bytes
+    };
+
+    // binary output, native byte order
+    struct Record {
+        qint64 timestamp; // first byte, ns since epoch
+        quint32 length;
+        quint8 direction; // HistoryModel::DataDirection
+        quint8 reserved[3];
+    };
+
+    struct Options {
+        QString portA {};
+        QString portB {};
+        QStringList channels {}; // read by a CaptureEngine at baudRateA, instead of A and B
+        qint32 baudRateA {115200};
+        qint32 baudRateB {115200};
+        bool bridge {};
+        bool byteTimestamps {};
+        Format format {TextFormat};
+        QString output {}; // empty for stdout
+        int newlineAfterCount {}; // bytes, 0 disables
+        int newlineAfterDuration {}; // ms, 0 disables
+        QString frameDecoder {}; // FrameDecoder::create() spec, rows by frames instead
+        int flushInterval {50}; // ms
+        QString statsFile {}; // performance counters every second, .csv or JSON Lines
+    };
+
+    explicit HeadlessCapture(const Options &_options, QObject *parent = nullptr);
+    ~HeadlessCapture();
+
+    bool start(); // errors go to the log
+    void stop(); // writes the pending rows and closes the ports
+
+private slots:
+    void onFlushed();
+    void onIdle();
+
+private:
+    void writeRows(bool _includeNewest);
+    void appendRow(int _row);
+    void appendTime(qint64 _timestamp);
+    bool flushOutput();
+
+private:
+    static constexpr int OUTPUT_BUFFER_SIZE = 256 * 1024;
+
+    const Options m_options;
+    HistoryModel m_history {};
+    UpdateScheduler m_scheduler {m_history};
+    PerfMonitor m_perf {m_history, m_scheduler};
+    QThread m_ioThread {};
+    SerialHandler m_portA {HistoryModel::A_TO_PC, HistoryModel::A_TO_B};
+    SerialHandler m_portB {HistoryModel::B_TO_PC, HistoryModel::B_TO_A};
+    CaptureEngine m_engine {};
+    QTimer m_idleTimer {};
+    QTimer m_statsTimer {};
+    QFile m_output {};
+    QByteArray m_buffer {};
+    qint64 m_nextSerial {}; // first row not written yet
+    qint64 m_lostRows {};
+    qint64 m_utcOffsetNs {};
+};
+
+// entry point of --headless, parses the command line and runs until SIGINT/SIGTERM
+int runHeadless(int argc, char *argv[]);
+
+#endif // HEADLESSCAPTURE_H
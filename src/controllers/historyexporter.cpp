@@ -0,0 +1,414 @@
+#include "historyexporter.h"
+#include <QDateTime>
+#include <QFuture>
+#include <QMutexLocker>
+#include <QQueue>
+#include <QThread>
+#include <QtConcurrent>
+#include <algorithm>
+#include <cstring>
+
+#include "utils/hexformat.h"
+
+#ifdef Q_OS_LINUX
+#include <pthread.h>
+#endif
+
+constexpr qint64 HistoryExporter::BLOCK_BYTES;
+
+namespace {
+
+// "yyyy-MM-dd HH:mm:ss.zzzzzz"
+constexpr int TIME_LENGTH = 26;
+constexpr int DIRECTION_LENGTH = 4;
+
+// pcapng, https://www.ietf.org/archive/id/draft-ietf-opsawg-pcapng-01.html
+constexpr quint32 SECTION_HEADER_BLOCK = 0x0A0D0D0A;
+constexpr quint32 INTERFACE_DESCRIPTION_BLOCK = 1;
+constexpr quint32 ENHANCED_PACKET_BLOCK = 6;
+constexpr quint32 BYTE_ORDER_MAGIC = 0x1A2B3C4D;
+constexpr quint16 LINKTYPE_USER0 = 147;
+constexpr quint16 OPTION_END = 0;
+constexpr quint16 OPTION_IF_NAME = 2;
+constexpr quint16 OPTION_IF_TSRESOL = 9;
+constexpr quint8 TSRESOL_NSECS = 9;
+
+int padded(int _length)
+{
+    return (_length + 3) & ~3;
+}
+
+// pcapng is written in host byte order, readers swap by the section's byte order magic
+template<typename T>
+void put(char *&_out, T _value)
+{
+    memcpy(_out, &_value, sizeof(T));
+    _out += sizeof(T);
+}
+
+void putPadded(char *&_out, const char *_data, int _length)
+{
+    memcpy(_out, _data, size_t(_length));
+    memset(_out + _length, 0, size_t(padded(_length) - _length));
+    _out += padded(_length);
+}
+
+char *putNumber(char *_out, int _value)
+{
+    char digits[12];
+    auto count = 0;
+    do {
+        digits[count++] = char('0' + _value % 10);
+        _value /= 10;
+    } while (_value > 0);
+    while (count > 0)
+        *_out++ = digits[--count];
+    return _out;
+}
+
+// local time of the row, the date and time part is formatted once per second
+class TimeFormatter
+{
+public:
+    char *format(qint64 _nsecs, char *_out)
+    {
+        const auto seconds = _nsecs / 1000000000;
+        if (seconds != m_seconds || m_prefix.isEmpty()) {
+            m_seconds = seconds;
+            m_prefix = QDateTime::fromMSecsSinceEpoch(seconds * 1000).toString("yyyy-MM-dd HH:mm:ss.").toLatin1();
+        }
+        memcpy(_out, m_prefix.constData(), size_t(m_prefix.size()));
+        _out += m_prefix.size();
+
+        auto micros = int(_nsecs % 1000000000 / 1000);
+        for (int i = 5; i >= 0; --i) {
+            _out[i] = char('0' + micros % 10);
+            micros /= 10;
+        }
+        return _out + 6;
+    }
+
+private:
+    qint64 m_seconds {};
+    QByteArray m_prefix {};
+};
+
+} // namespace
+
+HistoryExporter::HistoryExporter(const HistoryModel &_history, QObject *parent)
+    : QObject(parent), m_history(_history)
+{
+}
+
+HistoryExporter::~HistoryExporter()
+{
+    cancel();
+    if (m_thread.joinable())
+        m_thread.join();
+}
+
+QString HistoryExporter::fileFilter(Format _format)
+{
+    switch (_format) {
+    case Text:
+        return "Text (*.txt)";
+    case Csv:
+        return "CSV (*.csv)";
+    case Pcapng:
+        return "Wireshark pcapng (*.pcapng)";
+    }
+    return QString();
+}
+
+QString HistoryExporter::suffix(Format _format)
+{
+    switch (_format) {
+    case Text:
+        return ".txt";
+    case Csv:
+        return ".csv";
+    case Pcapng:
+        return ".pcapng";
+    }
+    return QString();
+}
+
+bool HistoryExporter::start(const QString &_fileName, Format _format)
+{
+    if (isRunning()) {
+        setError("An export is already running");
+        return false;
+    }
+    if (m_thread.joinable())
+        m_thread.join();
+
+    // unbuffered: the blocks are large already, another copy would only cost
+    m_file.setFileName(_fileName);
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Unbuffered)) {
+        setError(m_file.errorString());
+        return false;
+    }
+
+    setError(QString());
+    m_format = _format;
+    const auto count = m_history.rowCount();
+    m_firstSerial = count > 0 ? m_history.rowSerial(0) : 0;
+    m_endSerial = count > 0 ? m_history.rowSerial(count - 1) + 1 : 0;
+    m_cancelled = false;
+    m_running = true;
+    m_thread = std::thread([this](){ run(); });
+    return true;
+}
+
+void HistoryExporter::cancel()
+{
+    m_cancelled = true;
+}
+
+bool HistoryExporter::isRunning() const
+{
+    return m_running;
+}
+
+QString HistoryExporter::fileName() const
+{
+    return m_file.fileName();
+}
+
+QString HistoryExporter::errorString() const
+{
+    QMutexLocker locker(&m_errorMutex);
+    return m_errorString;
+}
+
+void HistoryExporter::onWorkerFinished()
+{
+    if (m_thread.joinable())
+        m_thread.join();
+    m_running = false;
+    emit finished(m_ok);
+}
+
+void HistoryExporter::run()
+{
+#ifdef Q_OS_LINUX
+    pthread_setname_np(pthread_self(), "history-export");
+#endif
+
+    const auto totalRows = m_endSerial - m_firstSerial;
+    const auto maxPending = std::max(2, QThread::idealThreadCount() * 2);
+    QQueue<QFuture<QByteArray>> pending {};
+    QQueue<qint64> pendingRows {};
+    qint64 rowsWritten = 0;
+    auto ok = write(header(m_format));
+
+    // the writes happen in block order, whichever block the pool finishes first
+    const auto writeOldest = [&]() {
+        const auto data = pending.dequeue().result();
+        rowsWritten += pendingRows.dequeue();
+        if (ok && !m_cancelled) {
+            ok = write(data);
+            emit progress(rowsWritten, totalRows);
+        }
+    };
+
+    QVector<int> interfaces(256, -1);
+    auto nextInterface = 0;
+    auto serial = m_firstSerial;
+    while (ok && !m_cancelled && serial < m_endSerial) {
+        Block block {};
+        block.bytes.reserve(int(BLOCK_BYTES + BLOCK_BYTES / 4));
+        auto rows = 0;
+        m_history.visitRows(serial, BLOCK_BYTES, [&](qint64 _serial, HistoryModel::DataDirection _dir, qint64 _createdAt,
+                                                     const char *_data, int _length, bool) {
+            // rows appended since the start are not part of the export
+            if (_serial >= m_endSerial)
+                return;
+            if (m_format == Pcapng && interfaces.at(_dir) < 0) {
+                interfaces[_dir] = nextInterface++;
+                block.newInterfaces.append(_dir);
+            }
+            block.createdAt.append(_createdAt);
+            block.directions.append(_dir);
+            block.bytes.append(_data, _length);
+            block.ends.append(block.bytes.size());
+            serial = _serial + 1;
+            rows++;
+        });
+        if (rows == 0)
+            break; // cleared meanwhile
+        block.interfaces = interfaces;
+
+        if (pending.size() >= maxPending)
+            writeOldest();
+        pending.enqueue(QtConcurrent::run(&HistoryExporter::formatBlock, block, m_format));
+        pendingRows.enqueue(rows);
+    }
+    while (!pending.isEmpty())
+        writeOldest();
+
+    m_file.close();
+    if (m_cancelled) {
+        setError("Export cancelled");
+        ok = false;
+    }
+    if (!ok)
+        m_file.remove();
+    m_ok = ok;
+
+    QMetaObject::invokeMethod(this, "onWorkerFinished", Qt::QueuedConnection);
+}
+
+bool HistoryExporter::write(const QByteArray &_data)
+{
+    if (m_file.write(_data) == _data.size())
+        return true;
+    setError(m_file.errorString());
+    return false;
+}
+
+void HistoryExporter::setError(const QString &_error)
+{
+    QMutexLocker locker(&m_errorMutex);
+    m_errorString = _error;
+}
+
+QByteArray HistoryExporter::header(Format _format)
+{
+    switch (_format) {
+    case Text:
+        return QByteArray();
+    case Csv:
+        return "timestamp,direction,length,hex,ascii\n";
+    case Pcapng:
+        break;
+    }
+
+    // section header block, of unknown length
+    QByteArray out(28, Qt::Uninitialized);
+    auto data = out.data();
+    put<quint32>(data, SECTION_HEADER_BLOCK);
+    put<quint32>(data, 28);
+    put<quint32>(data, BYTE_ORDER_MAGIC);
+    put<quint16>(data, 1);
+    put<quint16>(data, 0);
+    put<qint64>(data, -1);
+    put<quint32>(data, 28);
+    return out;
+}
+
+QByteArray HistoryExporter::formatBlock(const Block &_block, Format _format)
+{
+    QByteArray out {};
+    if (_format == Pcapng)
+        formatPcapng(_block, out);
+    else
+        formatText(_block, _format == Csv, out);
+    return out;
+}
+
+void HistoryExporter::formatText(const Block &_block, bool _csv, QByteArray &_out)
+{
+    // one allocation for the block: hex takes 3 characters per byte, ascii at most 2 with the quotes doubled
+    const auto rows = _block.ends.size();
+    _out.resize(int(rows * (TIME_LENGTH + DIRECTION_LENGTH + 24) + qint64(_block.bytes.size()) * 6));
+    auto out = _out.data();
+    TimeFormatter time {};
+    QByteArray ascii {};
+
+    for (int row = 0; row < rows; ++row) {
+        const auto start = row > 0 ? _block.ends.at(row - 1) : 0;
+        const auto length = _block.ends.at(row) - start;
+        const auto data = _block.bytes.constData() + start;
+
+        out = time.format(_block.createdAt.at(row), out);
+        *out++ = _csv ? ',' : ' ';
+
+        const auto dir = HistoryModel::toString(HistoryModel::DataDirection(_block.directions.at(row)));
+        const auto dirLength = int(strlen(dir));
+        memcpy(out, dir, size_t(dirLength));
+        out += dirLength;
+
+        if (_csv) {
+            *out++ = ',';
+            out = putNumber(out, length);
+            *out++ = ',';
+        } else {
+            for (int i = dirLength; i < DIRECTION_LENGTH; ++i)
+                *out++ = ' ';
+            *out++ = ' ';
+            *out++ = ' ';
+        }
+
+        // one line each, the padding of the hex line is dropped
+        auto written = hexformat::formatHex(data, length, 0, out);
+        while (written > 0 && out[written - 1] == ' ')
+            written--;
+        out += written;
+        *out++ = _csv ? ',' : ' ';
+        if (!_csv)
+            *out++ = ' ';
+
+        if (_csv) {
+            ascii.resize(std::max(hexformat::asciiBufferSize(length, 0), 1));
+            const auto asciiLength = hexformat::formatAscii(data, length, 0, ascii.data());
+            *out++ = '"';
+            for (int i = 0; i < asciiLength; ++i) {
+                if (ascii.at(i) == '"')
+                    *out++ = '"';
+                *out++ = ascii.at(i);
+            }
+            *out++ = '"';
+        } else {
+            out += hexformat::formatAscii(data, length, 0, out);
+        }
+        *out++ = '\n';
+    }
+
+    _out.resize(int(out - _out.constData()));
+}
+
+void HistoryExporter::formatPcapng(const Block &_block, QByteArray &_out)
+{
+    // an interface per direction, named like the Direction column
+    const auto rows = _block.ends.size();
+    _out.resize(int(_block.newInterfaces.size() * 48 + rows * 32 + qint64(_block.bytes.size()) + rows * 3));
+    auto out = _out.data();
+
+    for (const auto dir : _block.newInterfaces) {
+        const auto name = QByteArray(HistoryModel::toString(HistoryModel::DataDirection(dir))).trimmed();
+        const auto length = quint32(16 + 4 + padded(name.size()) + 8 + 4 + 4);
+        put<quint32>(out, INTERFACE_DESCRIPTION_BLOCK);
+        put<quint32>(out, length);
+        put<quint16>(out, LINKTYPE_USER0);
+        put<quint16>(out, 0);
+        put<quint32>(out, 0); // no snap length
+        put<quint16>(out, OPTION_IF_NAME);
+        put<quint16>(out, quint16(name.size()));
+        putPadded(out, name.constData(), name.size());
+        put<quint16>(out, OPTION_IF_TSRESOL);
+        put<quint16>(out, 1);
+        putPadded(out, reinterpret_cast<const char *>(&TSRESOL_NSECS), 1);
+        put<quint16>(out, OPTION_END);
+        put<quint16>(out, 0);
+        put<quint32>(out, length);
+    }
+
+    for (int row = 0; row < rows; ++row) {
+        const auto start = row > 0 ? _block.ends.at(row - 1) : 0;
+        const auto length = _block.ends.at(row) - start;
+        const auto timestamp = quint64(_block.createdAt.at(row));
+        const auto blockLength = quint32(32 + padded(length));
+        put<quint32>(out, ENHANCED_PACKET_BLOCK);
+        put<quint32>(out, blockLength);
+        put<quint32>(out, quint32(_block.interfaces.at(_block.directions.at(row))));
+        put<quint32>(out, quint32(timestamp >> 32));
+        put<quint32>(out, quint32(timestamp));
+        put<quint32>(out, quint32(length));
+        put<quint32>(out, quint32(length));
+        putPadded(out, _block.bytes.constData() + start, length);
+        put<quint32>(out, blockLength);
+    }
+
+    _out.resize(int(out - _out.constData()));
+}
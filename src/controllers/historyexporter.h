@@ -0,0 +1,86 @@
+#ifndef HISTORYEXPORTER_H
+#define HISTORYEXPORTER_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QFile>
+#include <QMutex>
+#include <QString>
+#include <QVector>
+#include <atomic>
+#include <thread>
+
+#include "models/historymodel.h"
+
+// Exports the rows of a HistoryModel as text, CSV or pcapng. A writer thread copies
+// blocks of rows out of the model with visitRows(), the global thread pool formats
+// them and the writer puts them out in order, one large write per block. The rows the
+// model holds when the export starts are written, less the ones deleted meanwhile.
+class HistoryExporter : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Format {
+        Text,
+        Csv,
+        Pcapng
+    };
+
+    explicit HistoryExporter(const HistoryModel &_history, QObject *parent = nullptr);
+    ~HistoryExporter();
+
+    static QString fileFilter(Format _format); // "CSV (*.csv)"
+    static QString suffix(Format _format);
+
+    // GUI thread
+    bool start(const QString &_fileName, Format _format);
+    void cancel(); // stops at the next block and removes the file
+    bool isRunning() const;
+    QString fileName() const;
+    QString errorString() const;
+
+signals:
+    void progress(qint64 _rows, qint64 _totalRows);
+    void finished(bool _ok);
+
+private slots:
+    void onWorkerFinished();
+
+private:
+    // rows copied out of the model
+    struct Block {
+        QVector<qint64> createdAt; // ns since epoch
+        QVector<quint8> directions;
+        QVector<int> ends; // in bytes, after each row
+        QByteArray bytes;
+        QVector<int> interfaces; // pcapng: id by direction, -1 before its first row
+        QVector<quint8> newInterfaces; // pcapng: directions first seen in this block
+    };
+
+    void run();
+    bool write(const QByteArray &_data);
+    void setError(const QString &_error);
+
+    static QByteArray header(Format _format);
+    static QByteArray formatBlock(const Block &_block, Format _format);
+    static void formatText(const Block &_block, bool _csv, QByteArray &_out);
+    static void formatPcapng(const Block &_block, QByteArray &_out);
+
+private:
+    static constexpr qint64 BLOCK_BYTES = 1024 * 1024;
+
+    const HistoryModel &m_history;
+    QFile m_file {};
+    Format m_format {Text};
+    qint64 m_firstSerial {};
+    qint64 m_endSerial {};
+    std::thread m_thread {};
+    std::atomic<bool> m_running {false};
+    std::atomic<bool> m_cancelled {false};
+    bool m_ok {};
+    mutable QMutex m_errorMutex {};
+    QString m_errorString {};
+};
+
+#endif // HISTORYEXPORTER_H
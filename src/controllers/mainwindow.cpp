@@ -1,7 +1,8 @@
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
 #include <QtDebug>
-#include <QClipboard>
+#include <QFileDialog>
+#include <QProgressDialog>
 #include <algorithm>
 // #include <QFontMetrics>
 #include "utils/commonconfig.h"
@@ -12,17 +13,29 @@ MainWindow::MainWindow(QWidget *parent)
 {
     ui->setupUi(this);
 
-    connect(&m_portA, &QSerialPort::readyRead, this, &MainWindow::onPortADataReceived);
-
+    setupPorts();
     setupActionMenu();
 
     ui->historyTable->setFont(QFont("Consolas"));
     ui->historyTable->setContextMenuPolicy(Qt::CustomContextMenu);
 
     ui->historyTable->setModel(&m_history);
+    ui->historyTable->setItemDelegate(&m_historyDelegate);
     ui->txtNewlineAfterBytes->setValidator(new QIntValidator(8, 1000, this));
     ui->txtNewlineAfterDuration->setValidator(new QIntValidator(10, 10000, this));
     ui->txtHistoryCap->setValidator(new QIntValidator(10, 999999, this));
+    ui->txtFlushInterval->setValidator(new QIntValidator(1, 1000, this));
+    ui->cbbAppendNewline->addItem("none", QByteArray());
+    ui->cbbAppendNewline->addItem("LF", QByteArray("\n"));
+    ui->cbbAppendNewline->addItem("CR LF", QByteArray("\r\n"));
+    ui->cbbAppendNewline->addItem("CR", QByteArray("\r"));
+    ui->txtSendRepeat->setValidator(new QIntValidator(1, 1000000000, this));
+    ui->cbbFrameDecoder->addItem("none");
+    ui->cbbFrameDecoder->addItems(FrameDecoder::names());
+    for (const auto policy : {UpdateScheduler::Backpressure, UpdateScheduler::PauseRendering,
+                              UpdateScheduler::SampleChunks, UpdateScheduler::DropOldest})
+        ui->cbbOverloadPolicy->addItem(UpdateScheduler::toString(policy), policy);
+    ui->cbbOverloadPolicy->setCurrentIndex(ui->cbbOverloadPolicy->findData(m_scheduler.overloadPolicy()));
 
     connectSignalSlots();
 
@@ -37,6 +50,22 @@ MainWindow::MainWindow(QWidget *parent)
     setNewlineAfterDurationEnabled(true);
 
     setHistoryCapacity(10000);
+    setColdHistoryBudget(64);
+    setFlushInterval(16);
+
+    // the newline settings re-segment what was received so far
+    m_history.setChunkLogSize(64 * 1024 * 1024);
+    connect(&m_history, &HistoryModel::modelAboutToBeReset, this, &MainWindow::saveViewAnchor);
+    connect(&m_history, &HistoryModel::resegmented, this, [&](qint64 _rows, qint64 _nsecs){
+        restoreViewAnchor();
+        ui->statusbar->showMessage(QString("Re-segmented into %1 rows in %2 ms").arg(_rows).arg(_nsecs / 1000000), 5000);
+    });
+
+    connect(&m_exporter, &HistoryExporter::progress, this, [&](qint64 _rows, qint64 _totalRows){
+        if (m_exportProgress)
+            m_exportProgress->setValue(int(_totalRows > 0 ? _rows * 1000 / _totalRows : 1000));
+    });
+    connect(&m_exporter, &HistoryExporter::finished, this, &MainWindow::onExportFinished);
 
     auto testTimer = new QTimer();
     connect(testTimer, &QTimer::timeout, this, [&]{
@@ -59,13 +88,31 @@ MainWindow::MainWindow(QWidget *parent)
 MainWindow::~MainWindow()
 {
     qDebug("quit");
+    m_exporter.cancel();
+    stopRecording();
+    if (m_engine.isOpen())
+        toggleChannels();
+    m_portA.close();
+    m_portB.close();
+    m_ioThread.quit();
+    m_ioThread.wait();
     delete ui;
 }
 
-void MainWindow::onPortADataReceived()
+void MainWindow::onHistoryFlushed()
+{
+    if (autoscroll() && ui->historyTable->updatesEnabled()) {
+        ui->historyTable->scrollToBottom();
+    }
+}
+
+void MainWindow::onOverloadChanged(bool _overloaded)
 {
-    m_lastReceivedPort = &m_portA;
-    onDataReceived(m_portA.readAll());
+    // the model keeps every row, only painting stops until the backlog is gone
+    if (m_scheduler.overloadPolicy() == UpdateScheduler::PauseRendering || !_overloaded)
+        ui->historyTable->setUpdatesEnabled(!_overloaded);
+    if (!_overloaded)
+        onHistoryFlushed();
 }
 
 void MainWindow::onDataReceived(const QByteArray &_data)
@@ -100,6 +147,148 @@ void MainWindow::clearHistory()
     m_history.clear();
 }
 
+void MainWindow::openCapture()
+{
+    const auto fileName = QFileDialog::getOpenFileName(this, "Open capture", QString(), CAPTURE_FILE_FILTER);
+    if (fileName.isEmpty())
+        return;
+
+    // received data would switch the view back to the history
+    if (m_portA.isOpen())
+        togglePort(m_portA, ui->cbPortsA, ui->cbBaudA, ui->btnOpenA);
+    if (m_portB.isOpen())
+        togglePort(m_portB, ui->cbPortsB, ui->cbBaudB, ui->btnOpenB);
+    if (m_engine.isOpen())
+        toggleChannels();
+
+    if (m_history.openCapture(fileName))
+        ui->statusbar->showMessage(QString("Opened %1, %2 rows").arg(fileName).arg(m_history.rowCount()), 5000);
+    else
+        ui->statusbar->showMessage(m_history.captureErrorString(), 5000);
+}
+
+void MainWindow::startRecording()
+{
+    auto fileName = QFileDialog::getSaveFileName(this, "Record to file", QString(), CAPTURE_FILE_FILTER);
+    if (!fileName.isEmpty() && QFileInfo(fileName).suffix() != capturefile::INDEX_SUFFIX)
+        fileName += QString(".") + capturefile::INDEX_SUFFIX;
+
+    if (fileName.isEmpty() || !m_recorder.start(fileName)) {
+        if (!fileName.isEmpty())
+            ui->statusbar->showMessage(m_recorder.errorString(), 5000);
+        ui->actRecord->setChecked(false);
+        return;
+    }
+
+    m_portA.setRecorder(&m_recorder);
+    m_portB.setRecorder(&m_recorder);
+    for (int i = 0; i < m_engine.portCount(); ++i)
+        m_engine.port(i)->setRecorder(&m_recorder);
+    ui->statusbar->showMessage(QString("Recording to %1").arg(fileName), 5000);
+}
+
+void MainWindow::stopRecording()
+{
+    if (!m_recorder.isRecording())
+        return;
+
+    // the readers must let go of the recorder before it drains and closes
+    m_portA.setRecorder(nullptr);
+    m_portB.setRecorder(nullptr);
+    for (int i = 0; i < m_engine.portCount(); ++i)
+        m_engine.port(i)->setRecorder(nullptr);
+    m_recorder.stop();
+    ui->actRecord->setChecked(false);
+
+    if (m_recorder.errorString().isEmpty())
+        ui->statusbar->showMessage(QString("Recorded to %1").arg(m_recorder.fileName()), 5000);
+    else
+        ui->statusbar->showMessage(m_recorder.errorString(), 5000);
+}
+
+void MainWindow::startStatsDump()
+{
+    const auto fileName = QFileDialog::getSaveFileName(this, "Dump performance counters", QString(),
+                                                       "JSON Lines (*.jsonl);;CSV (*.csv)");
+    if (fileName.isEmpty() || !m_perf.startDump(fileName)) {
+        if (!fileName.isEmpty())
+            ui->statusbar->showMessage(m_perf.errorString(), 5000);
+        ui->actDumpStats->setChecked(false);
+        return;
+    }
+
+    ui->statusbar->showMessage(QString("Dumping performance counters to %1 every second").arg(fileName), 5000);
+}
+
+void MainWindow::stopStatsDump()
+{
+    m_perf.stopDump();
+    ui->actDumpStats->setChecked(false);
+}
+
+void MainWindow::saveCapture()
+{
+    if (m_exporter.isRunning()) {
+        ui->statusbar->showMessage(QString("Still exporting to %1").arg(m_exporter.fileName()), 5000);
+        return;
+    }
+
+    // a capture, or an export in one of the other formats
+    const QVector<HistoryExporter::Format> formats {HistoryExporter::Text, HistoryExporter::Csv, HistoryExporter::Pcapng};
+    QStringList filters {CAPTURE_FILE_FILTER};
+    for (const auto format : formats)
+        filters.append(HistoryExporter::fileFilter(format));
+
+    QString filter {};
+    auto fileName = QFileDialog::getSaveFileName(this, "Save to file", QString(), filters.join(";;"), &filter);
+    if (fileName.isEmpty())
+        return;
+    if (filters.indexOf(filter) > 0) {
+        exportHistory(fileName, formats.at(filters.indexOf(filter) - 1));
+        return;
+    }
+    if (QFileInfo(fileName).suffix() != capturefile::INDEX_SUFFIX)
+        fileName += QString(".") + capturefile::INDEX_SUFFIX;
+
+    if (m_history.saveCapture(fileName))
+        ui->statusbar->showMessage(QString("Saved %1").arg(fileName), 5000);
+    else
+        ui->statusbar->showMessage(m_history.captureErrorString(), 5000);
+}
+
+void MainWindow::exportHistory(QString _fileName, HistoryExporter::Format _format)
+{
+    const auto suffix = HistoryExporter::suffix(_format);
+    if (!_fileName.endsWith(suffix, Qt::CaseInsensitive))
+        _fileName += suffix;
+
+    if (!m_exporter.start(_fileName, _format)) {
+        ui->statusbar->showMessage(m_exporter.errorString(), 5000);
+        return;
+    }
+
+    // not modal, the capture goes on meanwhile
+    m_exportProgress = new QProgressDialog(QString("Exporting to %1").arg(_fileName), "Cancel", 0, 1000, this);
+    m_exportProgress->setWindowModality(Qt::NonModal);
+    m_exportProgress->setMinimumDuration(500);
+    m_exportProgress->setAutoReset(false);
+    m_exportProgress->setAutoClose(false);
+    connect(m_exportProgress, &QProgressDialog::canceled, &m_exporter, &HistoryExporter::cancel);
+}
+
+void MainWindow::onExportFinished(bool _ok)
+{
+    if (m_exportProgress) {
+        m_exportProgress->deleteLater();
+        m_exportProgress = nullptr;
+    }
+
+    if (_ok)
+        ui->statusbar->showMessage(QString("Exported %1").arg(m_exporter.fileName()), 5000);
+    else
+        ui->statusbar->showMessage(m_exporter.errorString(), 5000);
+}
+
 int MainWindow::newlineAfterCount() const
 {
     return m_newlineAfterCount;
@@ -196,6 +385,12 @@ void MainWindow::setDataLinkEnabled(bool newDataLinkEnabled)
     if (m_dataLinkEnabled == newDataLinkEnabled)
         return;
     m_dataLinkEnabled = newDataLinkEnabled;
+    m_portA.setForwardingEnabled(newDataLinkEnabled);
+    m_portB.setForwardingEnabled(newDataLinkEnabled);
+
+    if (newDataLinkEnabled != ui->cbLinkDataLines->isChecked())
+        ui->cbLinkDataLines->setChecked(newDataLinkEnabled);
+
     emit dataLinkEnabledChanged();
 }
 
@@ -212,6 +407,27 @@ void MainWindow::setSignalLinkEnabled(bool newSignalLinkEnabled)
     emit signalLinkEnabledChanged();
 }
 
+bool MainWindow::byteTimestampsEnabled() const
+{
+    return m_byteTimestampsEnabled;
+}
+
+void MainWindow::setByteTimestampsEnabled(bool newByteTimestampsEnabled)
+{
+    if (m_byteTimestampsEnabled == newByteTimestampsEnabled)
+        return;
+    m_byteTimestampsEnabled = newByteTimestampsEnabled;
+    m_portA.setByteTimestampsEnabled(newByteTimestampsEnabled);
+    m_portB.setByteTimestampsEnabled(newByteTimestampsEnabled);
+    for (int i = 0; i < m_engine.portCount(); ++i)
+        m_engine.port(i)->setByteTimestampsEnabled(newByteTimestampsEnabled);
+
+    if (newByteTimestampsEnabled != ui->cbByteTimestamps->isChecked())
+        ui->cbByteTimestamps->setChecked(newByteTimestampsEnabled);
+
+    emit byteTimestampsEnabledChanged();
+}
+
 bool MainWindow::autoscroll() const
 {
     return m_autoscroll;
@@ -279,6 +495,99 @@ void MainWindow::setHistoryCapacity(int newHistoryCapacity)
     emit historyCapacityChanged();
 }
 
+int MainWindow::coldHistoryBudget() const
+{
+    return int(m_history.coldHistoryBudget() / (1024 * 1024));
+}
+
+void MainWindow::setColdHistoryBudget(int newColdHistoryBudget)
+{
+    if (coldHistoryBudget() == newColdHistoryBudget)
+        return;
+    m_history.setColdHistoryBudget(qint64(newColdHistoryBudget) * 1024 * 1024);
+
+    if (newColdHistoryBudget != ui->txtColdHistory->text().toInt()) {
+        ui->txtColdHistory->setText(QString::number(newColdHistoryBudget));
+    }
+
+    emit coldHistoryBudgetChanged();
+}
+
+int MainWindow::flushInterval() const
+{
+    return m_scheduler.flushInterval();
+}
+
+void MainWindow::setFlushInterval(int newFlushInterval)
+{
+    if (newFlushInterval <= 0)
+        return;
+
+    m_scheduler.setFlushInterval(newFlushInterval);
+
+    if (newFlushInterval != ui->txtFlushInterval->text().toInt()) {
+        ui->txtFlushInterval->setText(QString::number(newFlushInterval));
+    }
+
+    emit flushIntervalChanged();
+}
+
+QString MainWindow::frameDecoder() const
+{
+    return m_frameDecoder;
+}
+
+void MainWindow::setFrameDecoder(const QString &newFrameDecoder)
+{
+    if (m_frameDecoder == newFrameDecoder)
+        return;
+
+    // each port has its own, decoders keep the state of their stream
+    QString error {};
+    const auto decoderA = FrameDecoder::create(newFrameDecoder, &error);
+    const auto decoderB = FrameDecoder::create(newFrameDecoder);
+    if (!error.isEmpty()) {
+        qWarning() << error;
+        ui->statusbar->showMessage(error, 5000);
+        ui->cbbFrameDecoder->setCurrentText(m_frameDecoder);
+        return;
+    }
+
+    m_frameDecoder = newFrameDecoder;
+    m_portA.setFrameDecoder(decoderA);
+    m_portB.setFrameDecoder(decoderB);
+    for (int i = 0; i < m_engine.portCount(); ++i)
+        m_engine.port(i)->setFrameDecoder(FrameDecoder::create(newFrameDecoder));
+
+    if (newFrameDecoder != ui->cbbFrameDecoder->currentText())
+        ui->cbbFrameDecoder->setCurrentText(newFrameDecoder);
+
+    emit frameDecoderChanged();
+}
+
+int MainWindow::overloadPolicy() const
+{
+    return m_scheduler.overloadPolicy();
+}
+
+void MainWindow::setOverloadPolicy(int newOverloadPolicy)
+{
+    if (newOverloadPolicy == m_scheduler.overloadPolicy() || newOverloadPolicy < UpdateScheduler::Backpressure
+            || newOverloadPolicy > UpdateScheduler::DropOldest)
+        return;
+
+    m_scheduler.setOverloadPolicy(UpdateScheduler::OverloadPolicy(newOverloadPolicy));
+    // painting paused by the previous policy comes back
+    if (!ui->historyTable->updatesEnabled() && newOverloadPolicy != UpdateScheduler::PauseRendering)
+        onOverloadChanged(false);
+
+    const auto index = ui->cbbOverloadPolicy->findData(newOverloadPolicy);
+    if (index != ui->cbbOverloadPolicy->currentIndex())
+        ui->cbbOverloadPolicy->setCurrentIndex(index);
+
+    emit overloadPolicyChanged();
+}
+
 void MainWindow::setupActionMenu()
 {
     m_tableContextMenu.addAction(ui->actResizeToFit);
@@ -293,32 +602,374 @@ void MainWindow::setupActionMenu()
         ui->historyTable->setColumnHidden(HistoryModel::toColumn(HistoryModel::HexRole), !ui->actShowHexa->isChecked());
     });
     connect(ui->actClearHistory, &QAction::triggered, this, &MainWindow::clearHistory);
+    connect(ui->actOpenFile, &QAction::triggered, this, &MainWindow::openCapture);
+    connect(ui->actSaveToFile, &QAction::triggered, this, &MainWindow::saveCapture);
+    connect(ui->actRecord, &QAction::triggered, this, [&](bool _checked){
+        if (_checked)
+            startRecording();
+        else
+            stopRecording();
+    });
+    connect(ui->actDumpStats, &QAction::triggered, this, [&](bool _checked){
+        if (_checked)
+            startStatsDump();
+        else
+            stopStatsDump();
+    });
+    connect(ui->actSyncRecording, &QAction::toggled, this, [&](bool _checked){
+        m_recorder.setSyncInterval(_checked ? 1000 : 0);
+    });
     connect(ui->actCopySelection, &QAction::triggered, this, [&](){
-        QString outputString {};
-        int columnIndex {0};
-
-        for (const auto &i : ui->historyTable->selectionModel()->selectedIndexes()) {
-            outputString.append(i.data().toString().replace("\n", ""));
-
-            // append '~' if not last column
-            if (columnIndex != HistoryModel::toColumn(HistoryModel::ColumnRoles::NumColumns) - 1) {
-                outputString.append(" ~ ");
-                columnIndex++;
-            } else {
-                outputString.append("\n");
-                columnIndex = 0;
-            }
-        }
-        QApplication::clipboard()->setText(outputString);
+        copySelection(SelectionCopier::Cells);
     });
     connect(ui->actCopySelectionPayload, &QAction::triggered, this, [&](){
-        QString outputString {};
-        for (const auto &i : ui->historyTable->selectionModel()->selectedRows(HistoryModel::toColumn(HistoryModel::StringRole))) {
-            outputString.append(i.data().toString());
-            outputString.append("\n");
+        copySelection(SelectionCopier::Payload);
+    });
+    connect(&m_copier, &SelectionCopier::copied, this, [&](qint64 _rows, qint64 _bytes){
+        ui->statusbar->showMessage(QString("Copied %1 rows, %2 bytes").arg(_rows).arg(_bytes), 5000);
+    });
+}
+
+void MainWindow::copySelection(SelectionCopier::Mode _mode)
+{
+    // the selected cells as serial ranges with their columns, without expanding them into cells
+    const auto proxy = ui->historyTable->model() == &m_searchResults;
+    QVector<SelectionCopier::Range> ranges {};
+    for (const auto &range : ui->historyTable->selectionModel()->selection()) {
+        quint32 columns = 0;
+        for (auto column = range.left(); column <= range.right(); ++column)
+            columns |= 1u << column;
+
+        if (!proxy) {
+            ranges.append(SelectionCopier::Range {m_history.rowSerial(range.top()), m_history.rowSerial(range.bottom()), columns});
+            continue;
         }
-        QApplication::clipboard()->setText(outputString);
+        for (auto row = range.top(); row <= range.bottom(); ++row) {
+            const auto serial = m_history.rowSerial(m_searchResults.mapToSource(m_searchResults.index(row, 0)).row());
+            if (!ranges.isEmpty() && ranges.last().lastSerial + 1 == serial)
+                ranges.last().lastSerial = serial;
+            else
+                ranges.append(SelectionCopier::Range {serial, serial, columns});
+        }
+    }
+    if (ranges.isEmpty())
+        return;
+
+    // in table order, once each: where ranges overlap a row gets the columns of all of them
+    struct Boundary {
+        qint64 serial;
+        int column;
+        int count; // +1 where a range starts, -1 after it ends
+    };
+    QVector<Boundary> boundaries {};
+    for (const auto &range : qAsConst(ranges)) {
+        for (int column = 0; column < HistoryModel::toColumn(HistoryModel::NumColumns); ++column) {
+            if (range.columns & (1u << column)) {
+                boundaries.append(Boundary {range.firstSerial, column, 1});
+                boundaries.append(Boundary {range.lastSerial + 1, column, -1});
+            }
+        }
+    }
+    std::sort(boundaries.begin(), boundaries.end(), [](const Boundary &_a, const Boundary &_b) {
+        return _a.serial < _b.serial;
     });
+
+    QVector<SelectionCopier::Range> merged {};
+    int selected[HistoryModel::toColumn(HistoryModel::NumColumns)] {};
+    for (int i = 0; i < boundaries.size();) {
+        const auto serial = boundaries.at(i).serial;
+        for (; i < boundaries.size() && boundaries.at(i).serial == serial; ++i)
+            selected[boundaries.at(i).column] += boundaries.at(i).count;
+
+        // the rows up to the next boundary, a selected row always has one after it
+        quint32 columns = 0;
+        for (int column = 0; column < HistoryModel::toColumn(HistoryModel::NumColumns); ++column)
+            columns |= selected[column] > 0 ? 1u << column : 0;
+        if (columns == 0)
+            continue;
+        const auto last = boundaries.at(i).serial - 1;
+        if (!merged.isEmpty() && merged.last().columns == columns && merged.last().lastSerial + 1 == serial)
+            merged.last().lastSerial = last;
+        else
+            merged.append(SelectionCopier::Range {serial, last, columns});
+    }
+
+    QVector<int> columns {};
+    for (int column = 0; column < HistoryModel::toColumn(HistoryModel::NumColumns); ++column) {
+        if (!ui->historyTable->isColumnHidden(column))
+            columns.append(column);
+    }
+    m_copier.copy(merged, _mode, columns);
+}
+
+void MainWindow::saveViewAnchor()
+{
+    m_viewAnchor = ViewAnchor {-1, -1, {}};
+    if (ui->historyTable->model() != &m_history)
+        return; // the search results are found again anyway
+
+    const auto top = ui->historyTable->rowAt(0);
+    if (top >= 0)
+        m_viewAnchor.top = m_history.rowCreatedAt(top);
+    const auto current = ui->historyTable->currentIndex();
+    if (current.isValid())
+        m_viewAnchor.current = m_history.rowCreatedAt(current.row());
+    for (const auto &range : ui->historyTable->selectionModel()->selection()) {
+        m_viewAnchor.selection.append(ViewAnchor::Range {m_history.rowCreatedAt(range.top()), m_history.rowUpdatedAt(range.bottom()),
+                                                         range.left(), range.right()});
+    }
+}
+
+void MainWindow::restoreViewAnchor()
+{
+    if (ui->historyTable->model() != &m_history)
+        return;
+
+    // a row split in two keeps its first part, rows merged into one are one row now
+    QItemSelection selection {};
+    for (const auto &range : qAsConst(m_viewAnchor.selection)) {
+        const auto top = std::max(0, m_history.rowOfTime(range.from));
+        const auto bottom = m_history.rowOfTime(range.to);
+        if (bottom >= top)
+            selection.select(m_history.index(top, range.left), m_history.index(bottom, range.right));
+    }
+    ui->historyTable->selectionModel()->select(selection, QItemSelectionModel::ClearAndSelect);
+
+    if (m_viewAnchor.current >= 0) {
+        const auto current = std::max(0, m_history.rowOfTime(m_viewAnchor.current));
+        ui->historyTable->selectionModel()->setCurrentIndex(m_history.index(current, 0), QItemSelectionModel::NoUpdate);
+    }
+
+    if (autoscroll())
+        ui->historyTable->scrollToBottom();
+    else if (m_viewAnchor.top >= 0)
+        ui->historyTable->scrollTo(m_history.index(std::max(0, m_history.rowOfTime(m_viewAnchor.top)), 0), QAbstractItemView::PositionAtTop);
+}
+
+void MainWindow::setupPorts()
+{
+    // both ports are read on a dedicated thread, the GUI only consumes the buffered chunks
+    m_ioThread.setObjectName("serial-io");
+    m_portA.moveToThread(&m_ioThread);
+    m_portB.moveToThread(&m_ioThread);
+    m_ioThread.start(QThread::TimeCriticalPriority);
+
+    m_portA.setPeer(&m_portB);
+    m_portB.setPeer(&m_portA);
+
+    // received data reaches the model at most once per flush interval
+    m_scheduler.addSource(&m_portA);
+    m_scheduler.addSource(&m_portB);
+    m_perf.addPort("A", &m_portA);
+    m_perf.addPort("B", &m_portB);
+    connect(&m_scheduler, &UpdateScheduler::flushed, this, &MainWindow::onHistoryFlushed);
+    connect(&m_scheduler, &UpdateScheduler::overloadChanged, this, &MainWindow::onOverloadChanged);
+
+    for (const auto &info : QSerialPortInfo::availablePorts()) {
+        ui->cbPortsA->addItem(info.portName());
+        ui->cbPortsB->addItem(info.portName());
+    }
+
+    for (const auto baud : QSerialPortInfo::standardBaudRates()) {
+        ui->cbBaudA->addItem(QString::number(baud));
+        ui->cbBaudB->addItem(QString::number(baud));
+        ui->cbBaudChannels->addItem(QString::number(baud));
+    }
+    ui->cbBaudA->setEditable(true);
+    ui->cbBaudB->setEditable(true);
+    ui->cbBaudA->setCurrentText("115200");
+    ui->cbBaudB->setCurrentText("115200");
+    ui->cbBaudChannels->setCurrentText("115200");
+
+    connect(ui->btnOpenA, &QPushButton::released, this, [&](){
+        togglePort(m_portA, ui->cbPortsA, ui->cbBaudA, ui->btnOpenA);
+    });
+    connect(ui->btnOpenB, &QPushButton::released, this, [&](){
+        togglePort(m_portB, ui->cbPortsB, ui->cbBaudB, ui->btnOpenB);
+    });
+    connect(ui->btnOpenChannels, &QPushButton::released, this, &MainWindow::toggleChannels);
+    updatePortControls();
+
+    m_statusLabel = new QLabel(this);
+    ui->statusbar->addPermanentWidget(m_statusLabel);
+    connect(&m_statusTimer, &QTimer::timeout, this, &MainWindow::updateStatusBar);
+    m_statusTimer.start(1000);
+}
+
+void MainWindow::updateStatusBar()
+{
+    QStringList parts {};
+
+    const auto formatLatency = [](const char *_name, const SerialHandler::ForwardingStats &_stats) {
+        const auto avgUs = _stats.totalNs / 1000.0 / _stats.chunks;
+        return QString("%1: %2 B/s, fwd avg %3 us, max %4 us")
+                .arg(_name)
+                .arg(_stats.bytes)
+                .arg(avgUs, 0, 'f', 1)
+                .arg(_stats.maxNs / 1000.0, 0, 'f', 1);
+    };
+
+    // forwarding latency: from the return of read() on one port to the flush() of the other
+    const auto statsA = m_portA.takeForwardingStats();
+    const auto statsB = m_portB.takeForwardingStats();
+    if (statsA.chunks > 0)
+        parts.append(formatLatency("A->B", statsA));
+    if (statsB.chunks > 0)
+        parts.append(formatLatency("B->A", statsB));
+
+    // recording: bytes written in the last second and what the writer still has to catch up with
+    if (m_recorder.isRecording()) {
+        const auto recording = m_recorder.takeStats();
+        auto text = QString("rec: %1 KiB/s, queued %2 KiB in %3 chunks")
+                .arg(recording.bytesWritten / 1024.0, 0, 'f', 1)
+                .arg(recording.queuedBytes / 1024.0, 0, 'f', 1)
+                .arg(recording.queuedChunks);
+        if (recording.droppedChunks > 0)
+            text += QString(", %1 dropped").arg(recording.droppedChunks);
+        if (!m_recorder.errorString().isEmpty())
+            text += ", " + m_recorder.errorString();
+        parts.append(text);
+    }
+
+    // throughput, backlog, GUI thread time and latency; a dump gets the same sample
+    m_perf.sample();
+    parts.append(m_perf.summary());
+    if (ui->actDumpStats->isChecked() && !m_perf.isDumping()) {
+        ui->actDumpStats->setChecked(false);
+        ui->statusbar->showMessage(m_perf.errorString(), 5000);
+    }
+
+    const auto cache = m_history.renderCacheStats();
+    const auto lookups = cache.hits + cache.misses;
+    if (lookups > 0)
+        parts.append(QString("render cache: %1% hits (%2/%3)")
+                     .arg(100.0 * cache.hits / lookups, 0, 'f', 1)
+                     .arg(cache.hits)
+                     .arg(cache.misses));
+
+    m_statusLabel->setText(parts.join(" | "));
+}
+
+void MainWindow::togglePort(SerialHandler &_port, QComboBox *_portNames, QComboBox *_baudRates, QPushButton *_button)
+{
+    if (_port.isOpen()) {
+        _port.close();
+    } else if (!_port.open(_portNames->currentText(), _baudRates->currentText().toInt())) {
+        ui->statusbar->showMessage(_port.errorString(), 5000);
+    }
+
+    const auto open = _port.isOpen();
+    _button->setText(open ? "Close" : "Open");
+    _portNames->setEnabled(!open);
+    _baudRates->setEnabled(!open);
+    updatePortControls();
+}
+
+void MainWindow::toggleChannels()
+{
+    if (m_engine.isOpen()) {
+        // whatever the channels read last goes to the history before they go
+        m_engine.stop();
+        m_scheduler.flush();
+        for (int i = 0; i < m_engine.portCount(); ++i) {
+            m_scheduler.removeSource(m_engine.port(i));
+            m_perf.removePort(m_engine.port(i));
+        }
+        m_engine.close();
+    } else {
+        QVector<CaptureEngine::PortSettings> ports {};
+        const auto baudRate = ui->cbBaudChannels->currentText().toInt();
+        for (const auto &name : ui->txtChannels->text().split(',', Qt::SkipEmptyParts))
+            ports.append(CaptureEngine::PortSettings {name.trimmed(), baudRate});
+
+        if (m_engine.open(ports)) {
+            // the same settings as A and B, every channel gets a decoder of its own
+            for (int i = 0; i < m_engine.portCount(); ++i) {
+                const auto port = m_engine.port(i);
+                port->setByteTimestampsEnabled(m_byteTimestampsEnabled);
+                port->setFrameDecoder(FrameDecoder::create(m_frameDecoder));
+                if (m_recorder.isRecording())
+                    port->setRecorder(&m_recorder);
+                m_scheduler.addSource(port);
+                m_perf.addPort(HistoryModel::toString(HistoryModel::channelDirection(i)), port);
+            }
+        } else {
+            ui->statusbar->showMessage(m_engine.errorString(), 5000);
+        }
+    }
+
+    const auto open = m_engine.isOpen();
+    ui->btnOpenChannels->setText(open ? "Close" : "Open");
+    ui->txtChannels->setEnabled(!open);
+    ui->cbBaudChannels->setEnabled(!open);
+    updatePortControls();
+}
+
+void MainWindow::updatePortControls()
+{
+    // the recorder takes a single producer thread, so the channels and A/B are never open together
+    ui->groupBoxA->setEnabled(!m_engine.isOpen());
+    ui->groupBoxB->setEnabled(!m_engine.isOpen());
+    ui->groupBoxChannels->setEnabled(CaptureEngine::isSupported() && !m_portA.isOpen() && !m_portB.isOpen());
+}
+
+void MainWindow::applySearch()
+{
+    QByteArray pattern {};
+    if (!HistorySearch::parsePattern(ui->txtSearch->text(), ui->cbSearchHex->isChecked(), &pattern)) {
+        ui->lblSearchStatus->setText("Invalid pattern");
+        return;
+    }
+
+    m_search.setPattern(pattern);
+    updateSearchStatus();
+}
+
+void MainWindow::showSearchResultsOnly(bool _enabled)
+{
+    if (_enabled)
+        ui->historyTable->setModel(&m_searchResults);
+    else
+        ui->historyTable->setModel(&m_history);
+
+    // a new model brings new header sections
+    ui->historyTable->setColumnHidden(HistoryModel::toColumn(HistoryModel::HexRole), !ui->actShowHexa->isChecked());
+}
+
+void MainWindow::findMatch(bool _forward)
+{
+    // search from the current row, in history rows
+    auto current = ui->historyTable->currentIndex();
+    if (current.isValid() && ui->historyTable->model() == &m_searchResults)
+        current = m_searchResults.mapToSource(current);
+    const auto row = current.isValid() ? current.row() : -1;
+
+    const auto match = _forward ? m_searchResults.nextMatch(row) : m_searchResults.previousMatch(row);
+    if (match < 0) {
+        ui->statusbar->showMessage("No more matches", 2000);
+        return;
+    }
+
+    auto index = m_history.index(match, 0);
+    if (ui->historyTable->model() == &m_searchResults)
+        index = m_searchResults.mapFromSource(index);
+
+    setAutoscroll(false);
+    ui->historyTable->setCurrentIndex(index);
+    ui->historyTable->selectRow(index.row());
+    ui->historyTable->scrollTo(index);
+}
+
+void MainWindow::updateSearchStatus()
+{
+    if (m_search.pattern().isEmpty()) {
+        ui->lblSearchStatus->clear();
+        return;
+    }
+
+    ui->lblSearchStatus->setText(QString("%1 matching rows%2")
+                                 .arg(m_searchResults.matchCount())
+                                 .arg(m_search.isSearching() ? ", searching" : ""));
 }
 
 void MainWindow::connectSignalSlots()
@@ -340,25 +991,152 @@ void MainWindow::connectSignalSlots()
         setNewlineAfterDuration(ui->txtNewlineAfterDuration->text().toUInt());
     });
 
+    // forward A <-> B from the I/O thread
+    connect(ui->cbLinkDataLines, &QCheckBox::toggled, this, [&](){
+        setDataLinkEnabled(ui->cbLinkDataLines->isChecked());
+    });
+    // interpolate byte timestamps from the baud rate
+    connect(ui->cbByteTimestamps, &QCheckBox::toggled, this, [&](){
+        setByteTimestampsEnabled(ui->cbByteTimestamps->isChecked());
+    });
+
     // history capacity
     connect(ui->txtHistoryCap, &QLineEdit::returnPressed, this, [&](){
         setHistoryCapacity(ui->txtHistoryCap->text().toUInt());
     });
+    // compressed rows beyond the capacity
+    connect(ui->txtColdHistory, &QLineEdit::returnPressed, this, [&](){
+        setColdHistoryBudget(ui->txtColdHistory->text().toInt());
+    });
+    // model refresh rate
+    connect(ui->txtFlushInterval, &QLineEdit::returnPressed, this, [&](){
+        setFlushInterval(ui->txtFlushInterval->text().toInt());
+    });
+    // rows by frames of a protocol
+    connect(ui->cbbFrameDecoder, QOverload<int>::of(&QComboBox::activated), this, [&](){
+        setFrameDecoder(ui->cbbFrameDecoder->currentText());
+    });
+    // what gives when the table falls behind
+    connect(ui->cbbOverloadPolicy, QOverload<int>::of(&QComboBox::activated), this, [&](){
+        setOverloadPolicy(ui->cbbOverloadPolicy->currentData().toInt());
+    });
     // set autoscroll
     connect(ui->cbAutoScroll, &QCheckBox::toggled, this, [&](){
         setAutoscroll(ui->cbAutoScroll->isChecked());
     });
 
+    // search the raw history
+    connect(ui->txtSearch, &QLineEdit::returnPressed, this, &MainWindow::applySearch);
+    connect(ui->txtSearch, &QLineEdit::textChanged, this, [&](const QString &_text){
+        if (_text.isEmpty())
+            applySearch();
+    });
+    connect(ui->cbSearchHex, &QCheckBox::toggled, this, &MainWindow::applySearch);
+    connect(ui->cbSearchFilter, &QCheckBox::toggled, this, &MainWindow::showSearchResultsOnly);
+    connect(ui->btnSearchNext, &QPushButton::released, this, [&](){
+        findMatch(true);
+    });
+    connect(ui->btnSearchPrevious, &QPushButton::released, this, [&](){
+        findMatch(false);
+    });
+    connect(&m_search, &HistorySearch::matchesFound, this, &MainWindow::updateSearchStatus);
+    connect(&m_search, &HistorySearch::finished, this, &MainWindow::updateSearchStatus);
+    connect(&m_search, &HistorySearch::restarted, this, &MainWindow::updateSearchStatus);
+
     // stop autoscroll when clicked on a row
     connect(ui->historyTable, &QTableView::clicked, this, [&](const QModelIndex &_index){
         Q_UNUSED(_index);
         setAutoscroll(false);
     });
 
+    // typed input, files and repeated patterns go out through the transmit queue of a port
     connect(ui->btnSendA, &QPushButton::released, this, [&](){
-        onDataReceived(ui->cbbInputA->currentText().toLatin1());
+        sendInput(m_portA, ui->cbbInputA, HistoryModel::PC_TO_A);
     });
     connect(ui->cbbInputA->lineEdit(), &QLineEdit::returnPressed, this, [&](){
-        onDataReceived(ui->cbbInputA->currentText().toLatin1());
+        sendInput(m_portA, ui->cbbInputA, HistoryModel::PC_TO_A);
     });
+    connect(ui->btnSendB, &QPushButton::released, this, [&](){
+        sendInput(m_portB, ui->cbbInputB, HistoryModel::PC_TO_B);
+    });
+    connect(ui->cbbInputB->lineEdit(), &QLineEdit::returnPressed, this, [&](){
+        sendInput(m_portB, ui->cbbInputB, HistoryModel::PC_TO_B);
+    });
+    connect(ui->actSendFileA, &QAction::triggered, this, [&](){
+        sendFile(m_portA, "A");
+    });
+    connect(ui->actSendFileB, &QAction::triggered, this, [&](){
+        sendFile(m_portB, "B");
+    });
+    connect(ui->actStopSending, &QAction::triggered, this, [&](){
+        m_portA.cancelTransmit();
+        m_portB.cancelTransmit();
+    });
+    connect(&m_portA, &SerialHandler::transmitted, this, [&](qint64 _bytes, qint64 _nsecs, qint64 _lineNsecs){
+        showTransmitted("A", _bytes, _nsecs, _lineNsecs);
+    });
+    connect(&m_portB, &SerialHandler::transmitted, this, [&](qint64 _bytes, qint64 _nsecs, qint64 _lineNsecs){
+        showTransmitted("B", _bytes, _nsecs, _lineNsecs);
+    });
+    connect(ui->cbFlowControl, &QCheckBox::toggled, this, [&](bool _checked){
+        m_portA.setHardwareFlowControl(_checked);
+        m_portB.setHardwareFlowControl(_checked);
+    });
+}
+
+void MainWindow::sendInput(SerialHandler &_port, QComboBox *_input, HistoryModel::DataDirection _dir)
+{
+    if (!_port.isOpen()) {
+        ui->statusbar->showMessage("The port is not open", 5000);
+        return;
+    }
+
+    QString error {};
+    const auto prefix = ui->cbHexInputPrefix->isChecked() ? ui->txtHexInputPrefix->text() : QString();
+    auto data = TransmitQueue::parseInput(_input->currentText(), prefix, &error);
+    if (!error.isEmpty()) {
+        ui->statusbar->showMessage(error, 5000);
+        return;
+    }
+    data.append(ui->cbbAppendNewline->currentData().toByteArray());
+    if (data.isEmpty())
+        return;
+
+    const auto repeat = std::max(1, ui->txtSendRepeat->text().toInt());
+    _port.transmit(data, repeat);
+
+    // a single send shows in the history, repeated ones only in the status bar
+    if (repeat == 1)
+        m_history.appendData(_dir, data);
+    if (_input->findText(_input->currentText()) < 0)
+        _input->insertItem(0, _input->currentText());
+}
+
+void MainWindow::sendFile(SerialHandler &_port, const QString &_name)
+{
+    if (!_port.isOpen()) {
+        ui->statusbar->showMessage(QString("Port %1 is not open").arg(_name), 5000);
+        return;
+    }
+
+    const auto fileName = QFileDialog::getOpenFileName(this, QString("Send file to port %1").arg(_name));
+    if (fileName.isEmpty())
+        return;
+
+    if (_port.transmitFile(fileName))
+        ui->statusbar->showMessage(QString("Sending %1 to port %2").arg(fileName, _name), 5000);
+    else
+        ui->statusbar->showMessage(_port.errorString(), 5000);
+}
+
+void MainWindow::showTransmitted(const QString &_name, qint64 _bytes, qint64 _nsecs, qint64 _lineNsecs)
+{
+    // achieved against what the baud rate allows
+    const auto rate = [](qint64 _bytes, qint64 _nsecs) {
+        return _nsecs > 0 ? double(_bytes) * 1e9 / _nsecs / 1024 : 0.0;
+    };
+    ui->statusbar->showMessage(QString("Sent %1 bytes to port %2 in %3 ms, %4 of %5 KiB/s (%6%)")
+                               .arg(_bytes).arg(_name).arg(_nsecs / 1000000)
+                               .arg(rate(_bytes, _nsecs), 0, 'f', 1).arg(rate(_bytes, _lineNsecs), 0, 'f', 1)
+                               .arg(_nsecs > 0 ? _lineNsecs * 100 / _nsecs : 100), 5000);
 }
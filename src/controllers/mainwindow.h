@@ -5,10 +5,25 @@
 #include <QtSerialPort/QtSerialPort>
 #include <QVector>
 #include <QMenu>
+#include <QThread>
 #include "models/historymodel.h"
+#include "models/historysearch.h"
+#include "models/historyfiltermodel.h"
+#include "controllers/captureengine.h"
+#include "controllers/serialhandler.h"
+#include "controllers/updatescheduler.h"
+#include "controllers/capturerecorder.h"
+#include "controllers/historyexporter.h"
+#include "controllers/perfmonitor.h"
+#include "controllers/selectioncopier.h"
+#include "views/historydelegate.h"
 
 QT_BEGIN_NAMESPACE
 namespace Ui { class MainWindow; }
+class QComboBox;
+class QLabel;
+class QProgressDialog;
+class QPushButton;
 QT_END_NAMESPACE
 
 class MainWindow : public QMainWindow
@@ -20,10 +35,15 @@ class MainWindow : public QMainWindow
     Q_PROPERTY(bool newlineAfterDurationEnabled READ newlineAfterDurationEnabled WRITE setNewlineAfterDurationEnabled NOTIFY newlineAfterDurationEnabledChanged)
     Q_PROPERTY(bool dataLinkEnabled READ dataLinkEnabled WRITE setDataLinkEnabled NOTIFY dataLinkEnabledChanged)
     Q_PROPERTY(bool signalLinkEnabled READ signalLinkEnabled WRITE setSignalLinkEnabled NOTIFY signalLinkEnabledChanged)
+    Q_PROPERTY(bool byteTimestampsEnabled READ byteTimestampsEnabled WRITE setByteTimestampsEnabled NOTIFY byteTimestampsEnabledChanged)
     Q_PROPERTY(bool autoscroll READ autoscroll WRITE setAutoscroll NOTIFY autoscrollChanged)
     Q_PROPERTY(bool showTimestamp READ showTimestamp WRITE setShowTimestamp NOTIFY showTimestampChanged)
     Q_PROPERTY(bool showHexa READ showHexa WRITE setShowHexa NOTIFY showHexaChanged)
     Q_PROPERTY(int historyCapacity READ historyCapacity WRITE setHistoryCapacity NOTIFY historyCapacityChanged)
+    Q_PROPERTY(int coldHistoryBudget READ coldHistoryBudget WRITE setColdHistoryBudget NOTIFY coldHistoryBudgetChanged)
+    Q_PROPERTY(int flushInterval READ flushInterval WRITE setFlushInterval NOTIFY flushIntervalChanged)
+    Q_PROPERTY(QString frameDecoder READ frameDecoder WRITE setFrameDecoder NOTIFY frameDecoderChanged)
+    Q_PROPERTY(int overloadPolicy READ overloadPolicy WRITE setOverloadPolicy NOTIFY overloadPolicyChanged)
 
 public:
     MainWindow(QWidget *parent = nullptr);
@@ -47,6 +67,9 @@ public:
     bool signalLinkEnabled() const;
     void setSignalLinkEnabled(bool newSignalLinkEnabled);
 
+    bool byteTimestampsEnabled() const;
+    void setByteTimestampsEnabled(bool newByteTimestampsEnabled);
+
     bool autoscroll() const;
     void setAutoscroll(bool newAutoscroll);
 
@@ -59,9 +82,37 @@ public:
     int historyCapacity() const;
     void setHistoryCapacity(int newHistoryCapacity);
 
+    int coldHistoryBudget() const; // MiB
+    void setColdHistoryBudget(int newColdHistoryBudget);
+
+    int flushInterval() const;
+    void setFlushInterval(int newFlushInterval);
+
+    QString frameDecoder() const;
+    void setFrameDecoder(const QString &newFrameDecoder);
+
+    int overloadPolicy() const;
+    void setOverloadPolicy(int newOverloadPolicy);
+
 private:
     void setupActionMenu();
     void connectSignalSlots();
+    void setupPorts();
+    void updateStatusBar();
+    void togglePort(SerialHandler &_port, QComboBox *_portNames, QComboBox *_baudRates, QPushButton *_button);
+    void toggleChannels();
+    void updatePortControls();
+    void applySearch();
+    void showSearchResultsOnly(bool _enabled);
+    void findMatch(bool _forward);
+    void updateSearchStatus();
+    void exportHistory(QString _fileName, HistoryExporter::Format _format);
+    void copySelection(SelectionCopier::Mode _mode);
+    void saveViewAnchor();
+    void restoreViewAnchor();
+    void sendInput(SerialHandler &_port, QComboBox *_input, HistoryModel::DataDirection _dir);
+    void sendFile(SerialHandler &_port, const QString &_name);
+    void showTransmitted(const QString &_name, qint64 _bytes, qint64 _nsecs, qint64 _lineNsecs);
 
 signals:
     void newlineAfterCountChanged();
@@ -70,26 +121,68 @@ signals:
     void newlineAfterDurationEnabledChanged();
     void dataLinkEnabledChanged();
     void signalLinkEnabledChanged();
+    void byteTimestampsEnabledChanged();
     void autoscrollChanged();
     void showTimestampChanged();
     void showHexaChanged();
     void historyCapacityChanged();
+    void coldHistoryBudgetChanged();
+    void flushIntervalChanged();
+    void frameDecoderChanged();
+    void overloadPolicyChanged();
 
 private slots:
-    void onPortADataReceived();
+    void onHistoryFlushed();
+    void onOverloadChanged(bool _overloaded);
     void onDataReceived(const QByteArray &_data);
     void onTableContextMenuRequested(const QPoint &_pos);
 
     void resizeToFit();
     void clearHistory();
+    void openCapture();
+    void saveCapture();
+    void onExportFinished(bool _ok);
+    void startRecording();
+    void stopRecording();
+    void startStatsDump();
+    void stopStatsDump();
 
 private:
+    // the table across the reset of a re-segmentation; serials start over, so the
+    // rows are found again by the timestamps of their bytes, ns since epoch
+    struct ViewAnchor {
+        struct Range {
+            qint64 from; // first byte of the top row
+            qint64 to; // last byte of the bottom row
+            int left;
+            int right;
+        };
+
+        qint64 top; // -1 for none
+        qint64 current;
+        QVector<Range> selection;
+    };
+
     Ui::MainWindow *ui;
     HistoryModel m_history {};
+    UpdateScheduler m_scheduler {m_history};
+    HistorySearch m_search {m_history};
+    HistoryFilterModel m_searchResults {m_history, m_search};
+    HistoryDelegate m_historyDelegate {};
     QMenu m_tableContextMenu {this};
 
-    QSerialPort m_portA {};
-    QSerialPort *m_lastReceivedPort {nullptr};
+    QThread m_ioThread {};
+    SerialHandler m_portA {HistoryModel::A_TO_PC, HistoryModel::A_TO_B};
+    SerialHandler m_portB {HistoryModel::B_TO_PC, HistoryModel::B_TO_A};
+    CaptureEngine m_engine {}; // N ports on one reactor, instead of A and B
+    CaptureRecorder m_recorder {};
+    HistoryExporter m_exporter {m_history};
+    QProgressDialog *m_exportProgress {nullptr};
+    SelectionCopier m_copier {m_history};
+    PerfMonitor m_perf {m_history, m_scheduler};
+    QTimer m_statusTimer {};
+    QLabel *m_statusLabel {nullptr};
+    ViewAnchor m_viewAnchor {-1, -1, {}};
 
     int m_newlineAfterCount {}; // bytes
     int m_newlineAfterDuration {}; // ms
@@ -99,9 +192,11 @@ private:
     bool m_newlineAfterDuraionEnabled {};
     bool m_dataLinkEnabled {};
     bool m_signalLinkEnabled {};
+    bool m_byteTimestampsEnabled {};
     bool m_autoscroll {false};
     bool m_showTimestamp {true};
     bool m_showHexa {true};
     int m_historyCapacity {};
+    QString m_frameDecoder {"none"};
 };
 #endif // MAINWINDOW_H
@@ -0,0 +1,234 @@
+#include "perfmonitor.h"
+#include <QDebug>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QStringList>
+
+#include "controllers/chunksource.h"
+#include "controllers/updatescheduler.h"
+#include "models/historymodel.h"
+#include "utils/captureclock.h"
+
+namespace {
+
+QString formatDuration(qint64 _ns)
+{
+    if (_ns < 1000000)
+        return QString("%1 us").arg(_ns / 1000.0, 0, 'f', 0);
+    return QString("%1 ms").arg(_ns / 1000000.0, 0, 'f', 1);
+}
+
+QString formatBytes(double _bytes)
+{
+    if (_bytes < 1024)
+        return QString("%1 B").arg(_bytes, 0, 'f', 0);
+    if (_bytes < 1024 * 1024)
+        return QString("%1 KiB").arg(_bytes / 1024, 0, 'f', 1);
+    return QString("%1 MiB").arg(_bytes / 1024 / 1024, 0, 'f', 1);
+}
+
+} // namespace
+
+PerfMonitor::PerfMonitor(HistoryModel &_history, UpdateScheduler &_scheduler)
+    : m_history(_history)
+    , m_scheduler(_scheduler)
+{
+}
+
+PerfMonitor::~PerfMonitor()
+{
+    stopDump();
+}
+
+void PerfMonitor::addPort(const QString &_name, ChunkSource *_source)
+{
+    m_ports.append(Port {_name, _source, _source->receivedBytes()});
+}
+
+void PerfMonitor::removePort(ChunkSource *_source)
+{
+    for (int i = 0; i < m_ports.size(); ++i) {
+        if (m_ports.at(i).source == _source) {
+            m_ports.remove(i);
+            return;
+        }
+    }
+}
+
+void PerfMonitor::sample()
+{
+    const auto timestamp = captureclock::now();
+    const auto seconds = m_lastSample > 0 ? (timestamp - m_lastSample) / 1e9 : 0.0;
+    const auto perSecond = [&](double _count) { return seconds > 0 ? _count / seconds : 0.0; };
+    m_lastSample = timestamp;
+    m_metrics.clear();
+
+    QStringList parts {};
+
+    // idle ports only show up in the dump
+    for (auto &port : m_ports) {
+        const auto prefix = "port." + port.name + ".";
+        const auto bytes = port.source->receivedBytes();
+        const auto byteRate = perSecond(bytes - port.lastBytes);
+        port.lastBytes = bytes;
+        add(prefix + "bytes_per_s", byteRate);
+        add(prefix + "buffered_bytes", port.source->bufferedBytes());
+        add(prefix + "read_stalls", port.source->stallCount());
+
+        auto text = QString("%1 %2/s").arg(port.name, formatBytes(byteRate));
+        const auto framed = port.source->hasFrameDecoder();
+        if (framed) {
+            const auto frames = port.source->takeFrameDecoderStats();
+            const auto frameRate = perSecond(frames.frames);
+            add(prefix + "frames_per_s", frameRate);
+            add(prefix + "frame_errors", frames.totalErrors);
+            text += QString(" %1 frames/s %2 errors").arg(frameRate, 0, 'f', 0).arg(frames.totalErrors);
+        }
+        if (byteRate > 0 || framed)
+            parts.append(text);
+    }
+
+    // backlog and latency between the readers and the model
+    const auto scheduler = m_scheduler.takeStats();
+    add("queue.max_chunks", scheduler.maxQueuedChunks);
+    add("flushes_per_s", perSecond(scheduler.flushes));
+    add("chunks_per_s", perSecond(scheduler.chunks));
+    add("latency.p50_us", scheduler.latency.percentile(0.5) / 1000.0);
+    add("latency.p90_us", scheduler.latency.percentile(0.9) / 1000.0);
+    add("latency.p99_us", scheduler.latency.percentile(0.99) / 1000.0);
+    add("latency.max_us", scheduler.latency.max() / 1000.0);
+    if (scheduler.chunks > 0) {
+        parts.append(QString("queue %1, latency p50 %2 p99 %3")
+                     .arg(scheduler.maxQueuedChunks)
+                     .arg(formatDuration(scheduler.latency.percentile(0.5)))
+                     .arg(formatDuration(scheduler.latency.percentile(0.99))));
+    }
+
+    // what the overload policy gave up, the readers and the recorder still got it
+    add("overload.active", m_scheduler.isOverloaded() ? 1 : 0);
+    add("overload.dropped_chunks_per_s", perSecond(scheduler.droppedChunks));
+    add("overload.dropped_bytes_per_s", perSecond(scheduler.droppedBytes));
+    add("overload.dropped_chunks", m_scheduler.totalDroppedChunks());
+    add("overload.dropped_bytes", m_scheduler.totalDroppedBytes());
+    if (m_scheduler.isOverloaded() || m_scheduler.totalDroppedChunks() > 0) {
+        auto text = QString("overload: %1").arg(m_scheduler.isOverloaded() ? UpdateScheduler::toString(m_scheduler.overloadPolicy()) : "no");
+        if (m_scheduler.totalDroppedChunks() > 0)
+            text += QString(", %1 chunks (%2) not shown").arg(m_scheduler.totalDroppedChunks()).arg(formatBytes(m_scheduler.totalDroppedBytes()));
+        parts.append(text);
+    }
+
+    // GUI thread time, busy is the share of the interval
+    const auto timings = [&](const char *_name, const LatencyHistogram &_times) {
+        const auto prefix = QString(_name) + ".";
+        add(prefix + "calls_per_s", perSecond(_times.count()));
+        add(prefix + "p50_us", _times.percentile(0.5) / 1000.0);
+        add(prefix + "p99_us", _times.percentile(0.99) / 1000.0);
+        add(prefix + "max_us", _times.max() / 1000.0);
+        add(prefix + "busy_percent", seconds > 0 ? 100.0 * _times.total() / (seconds * 1e9) : 0.0);
+        if (_times.count() > 0)
+            parts.append(QString("%1 p99 %2").arg(_name, formatDuration(_times.percentile(0.99))));
+    };
+    timings("append", m_history.takeAppendTimes());
+    timings("format", m_history.takeFormatTimes());
+
+    const auto memory = m_history.memoryUsage();
+    add("history.rows", m_history.rowCount());
+    add("history.memory_bytes", memory);
+    auto rows = QString("%1 rows, %2").arg(m_history.rowCount()).arg(formatBytes(memory));
+
+    // rows kept compressed beyond the history capacity
+    const auto cold = m_history.coldHistoryStats();
+    const auto ratio = cold.compressedBytes > 0 ? double(cold.rawBytes) / cold.compressedBytes : 0.0;
+    add("history.cold_rows", m_history.coldRowCount());
+    add("history.cold_blocks", cold.blocks);
+    add("history.cold_pending_blocks", cold.pendingBlocks);
+    add("history.cold_compression_ratio", ratio);
+    add("history.cold_decompressions", cold.decompressions);
+    if (m_history.coldRowCount() > 0)
+        rows += QString(" (%1 compressed %2:1)").arg(m_history.coldRowCount()).arg(ratio, 0, 'f', 1);
+    parts.append(rows);
+
+    m_summary = parts.join(" | ");
+
+    if (m_dump.isOpen())
+        dump(timestamp);
+}
+
+const QVector<PerfMonitor::Metric> &PerfMonitor::metrics() const
+{
+    return m_metrics;
+}
+
+QString PerfMonitor::summary() const
+{
+    return m_summary;
+}
+
+bool PerfMonitor::startDump(const QString &_fileName)
+{
+    stopDump();
+
+    m_dump.setFileName(_fileName);
+    if (!m_dump.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text)) {
+        m_errorString = m_dump.errorString();
+        return false;
+    }
+
+    m_errorString.clear();
+    m_csv = QFileInfo(_fileName).suffix().compare("csv", Qt::CaseInsensitive) == 0;
+    if (m_csv && m_dump.size() == 0)
+        m_dump.write("timestamp,metric,value\n");
+    return true;
+}
+
+void PerfMonitor::stopDump()
+{
+    if (m_dump.isOpen())
+        m_dump.close();
+}
+
+bool PerfMonitor::isDumping() const
+{
+    return m_dump.isOpen();
+}
+
+QString PerfMonitor::fileName() const
+{
+    return m_dump.fileName();
+}
+
+QString PerfMonitor::errorString() const
+{
+    return m_errorString;
+}
+
+void PerfMonitor::add(const QString &_name, double _value)
+{
+    m_metrics.append(Metric {_name, _value});
+}
+
+void PerfMonitor::dump(qint64 _timestamp)
+{
+    // ms since epoch, what dashboards expect
+    const auto time = captureclock::toMSecsSinceEpoch(_timestamp);
+
+    QByteArray text {};
+    if (m_csv) {
+        const auto prefix = QByteArray::number(time) + ',';
+        for (const auto &metric : qAsConst(m_metrics))
+            text += prefix + metric.name.toUtf8() + ',' + QByteArray::number(metric.value, 'g', 10) + '\n';
+    } else {
+        QJsonObject object {};
+        object.insert("timestamp", double(time));
+        for (const auto &metric : qAsConst(m_metrics))
+            object.insert(metric.name, metric.value);
+        text = QJsonDocument(object).toJson(QJsonDocument::Compact) + '\n';
+    }
+
+    if (m_dump.write(text) != text.size() || !m_dump.flush()) {
+        m_errorString = m_dump.errorString();
+        qWarning() << m_dump.fileName() << m_errorString;
+        stopDump();
+    }
+}
@@ -0,0 +1,66 @@
+#ifndef PERFMONITOR_H
+#define PERFMONITOR_H
+
+#include <QString>
+#include <QVector>
+#include <QFile>
+
+class ChunkSource;
+class HistoryModel;
+class UpdateScheduler;
+
+// Samples the counters of the capture pipeline once per sample() call: bytes and frames
+// per second of every port, the backlog between the readers and the model, the time spent
+// appending and formatting, rows and memory, and the latency from a read to the model update.
+// Samples can be appended to a file for dashboards, CSV rows of timestamp,metric,value for a
+// .csv file and JSON Lines, one object per sample, otherwise. GUI thread only.
+class PerfMonitor
+{
+public:
+    struct Metric {
+        QString name; // "port.A.bytes_per_s", "latency.p99_us", ...
+        double value;
+    };
+
+    PerfMonitor(HistoryModel &_history, UpdateScheduler &_scheduler);
+    ~PerfMonitor();
+    PerfMonitor(const PerfMonitor &) = delete;
+    PerfMonitor &operator=(const PerfMonitor &) = delete;
+
+    void addPort(const QString &_name, ChunkSource *_source);
+    void removePort(ChunkSource *_source);
+
+    // takes the stats of the model, the scheduler and the frame decoders of the ports
+    void sample();
+    const QVector<Metric> &metrics() const; // of the last sample
+    QString summary() const; // of the last sample, one line for the status bar
+
+    bool startDump(const QString &_fileName);
+    void stopDump();
+    bool isDumping() const;
+    QString fileName() const;
+    QString errorString() const;
+
+private:
+    struct Port {
+        QString name;
+        ChunkSource *source;
+        quint64 lastBytes;
+    };
+
+    void add(const QString &_name, double _value);
+    void dump(qint64 _timestamp);
+
+private:
+    HistoryModel &m_history;
+    UpdateScheduler &m_scheduler;
+    QVector<Port> m_ports {};
+    QVector<Metric> m_metrics {};
+    QString m_summary {};
+    qint64 m_lastSample {}; // capture clock, 0 before the first sample
+    QFile m_dump {};
+    bool m_csv {};
+    QString m_errorString {};
+};
+
+#endif // PERFMONITOR_H
@@ -0,0 +1,179 @@
+#include "selectioncopier.h"
+#include <QGuiApplication>
+#include <QClipboard>
+#include <QDateTime>
+#include <QMimeData>
+#include <QtConcurrent>
+#include <algorithm>
+#include <cstring>
+
+#include "utils/hexformat.h"
+#include "utils/timeformat.h"
+
+constexpr const char *SelectionCopier::RAW_MIME_TYPE;
+
+namespace {
+
+// rows are copied out of the model about this many bytes at a time, it is locked meanwhile
+constexpr qint64 SLICE_BYTES = 1024 * 1024;
+
+// the longest direction name
+constexpr int MAX_DIRECTION_LENGTH = 7;
+constexpr char SEPARATOR[] = " ~ ";
+constexpr int SEPARATOR_LENGTH = sizeof(SEPARATOR) - 1;
+
+// the rows from _first to _last that still exist, a slice at a time
+void visitRange(const HistoryModel &_history, qint64 _first, qint64 _last, const HistoryModel::RowVisitor &_visitor)
+{
+    auto from = _first;
+    while (from <= _last) {
+        auto next = from;
+        _history.visitRows(from, SLICE_BYTES, [&](qint64 _serial, HistoryModel::DataDirection _dir, qint64 _createdAt,
+                                                  const char *_data, int _length, bool _newest) {
+            if (_serial > _last)
+                return;
+            _visitor(_serial, _dir, _createdAt, _data, _length, _newest);
+            next = _serial + 1;
+        });
+        if (next == from)
+            break; // evicted or cleared meanwhile
+        from = next;
+    }
+}
+
+} // namespace
+
+SelectionCopier::SelectionCopier(const HistoryModel &_history, QObject *parent)
+    : QObject(parent), m_history(_history)
+{
+    connect(&m_watcher, &QFutureWatcherBase::finished, this, &SelectionCopier::onCopied);
+}
+
+SelectionCopier::~SelectionCopier()
+{
+    m_watcher.waitForFinished();
+}
+
+void SelectionCopier::copy(const QVector<Range> &_ranges, Mode _mode, const QVector<int> &_columns)
+{
+    m_next = Request {_ranges, _mode, _columns, QDateTime::currentDateTime().offsetFromUtc() * 1000LL};
+    m_pending = true;
+    start();
+}
+
+bool SelectionCopier::isCopying() const
+{
+    return m_pending || m_watcher.isRunning();
+}
+
+void SelectionCopier::start()
+{
+    // a running copy is out of date, onCopied() starts the next one
+    if (!m_pending || m_watcher.isRunning())
+        return;
+
+    m_pending = false;
+    m_watcher.setFuture(QtConcurrent::run(&SelectionCopier::formatted, &m_history, m_next));
+}
+
+void SelectionCopier::onCopied()
+{
+    if (m_pending) {
+        start();
+        return;
+    }
+
+    const auto result = m_watcher.result();
+    auto mimeData = new QMimeData();
+    mimeData->setText(QString::fromLatin1(result.text));
+    mimeData->setData(RAW_MIME_TYPE, result.raw);
+    QGuiApplication::clipboard()->setMimeData(mimeData);
+    emit copied(result.rows, result.raw.size());
+}
+
+SelectionCopier::Result SelectionCopier::formatted(const HistoryModel *_history, const Request &_request)
+{
+    const auto cells = _request.mode == Cells;
+    const auto rowBound = [&](int _length) {
+        if (!cells)
+            return qint64(_length) + 1;
+        return timeformat::TIME_LENGTH + MAX_DIRECTION_LENGTH + qint64(_request.columns.size()) * SEPARATOR_LENGTH + 1
+               + hexformat::hexBufferSize(_length, 0) + hexformat::asciiBufferSize(_length, 0);
+    };
+
+    // sized first, so the text is written without growing it
+    qint64 textSize = 0;
+    qint64 rawSize = 0;
+    for (const auto &range : _request.ranges) {
+        visitRange(*_history, range.firstSerial, range.lastSerial, [&](qint64, HistoryModel::DataDirection, qint64,
+                                                                       const char *, int _length, bool) {
+            textSize += rowBound(_length);
+            rawSize += _length;
+        });
+    }
+
+    Result result {QByteArray(int(textSize), Qt::Uninitialized), QByteArray(), 0};
+    result.raw.reserve(int(rawSize));
+    qint64 used = 0;
+
+    for (const auto &range : _request.ranges) {
+        visitRange(*_history, range.firstSerial, range.lastSerial, [&](qint64, HistoryModel::DataDirection _dir, qint64 _createdAt,
+                                                                       const char *_data, int _length, bool) {
+            // the newest row may have grown since it was sized
+            const auto bound = rowBound(_length);
+            if (used + bound > result.text.size())
+                result.text.resize(int(used + bound));
+
+            const auto begin = result.text.data() + used;
+            auto out = begin;
+            if (cells) {
+                auto first = true;
+                for (const auto column : _request.columns) {
+                    if (!(range.columns & (1u << column)))
+                        continue;
+                    if (!first) {
+                        memcpy(out, SEPARATOR, SEPARATOR_LENGTH);
+                        out += SEPARATOR_LENGTH;
+                    }
+                    first = false;
+
+                    switch (HistoryModel::toRole(column)) {
+                    case HistoryModel::TimestampRole:
+                        out = timeformat::formatTime(_createdAt / 1000000, _request.utcOffsetMs, out);
+                        break;
+                    case HistoryModel::DirectionRole: {
+                        const auto dir = HistoryModel::toString(_dir);
+                        const auto length = std::min<size_t>(strlen(dir), MAX_DIRECTION_LENGTH);
+                        memcpy(out, dir, length);
+                        out += length;
+                        break;
+                    }
+                    case HistoryModel::HexRole: {
+                        // one line, without the padding
+                        auto written = hexformat::formatHex(_data, _length, 0, out);
+                        while (written > 0 && out[written - 1] == ' ')
+                            written--;
+                        out += written;
+                        break;
+                    }
+                    case HistoryModel::StringRole:
+                        out += hexformat::formatAscii(_data, _length, 0, out);
+                        break;
+                    default:
+                        break;
+                    }
+                }
+            } else {
+                out += hexformat::formatAscii(_data, _length, 0, out);
+            }
+            *out++ = '\n';
+
+            used += out - begin;
+            result.raw.append(_data, _length);
+            result.rows++;
+        });
+    }
+
+    result.text.resize(int(used));
+    return result;
+}
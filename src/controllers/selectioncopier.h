@@ -0,0 +1,71 @@
+#ifndef SELECTIONCOPIER_H
+#define SELECTIONCOPIER_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QFutureWatcher>
+#include <QVector>
+
+#include "models/historymodel.h"
+
+// Copies selected history rows to the clipboard. The selection comes as ranges of
+// serials, and the rows are formatted from their raw bytes on the thread pool, into
+// one buffer sized beforehand. Next to the text the clipboard gets the rows' bytes
+// as RAW_MIME_TYPE.
+class SelectionCopier : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Mode {
+        Cells, // the shown columns, separated by " ~ "
+        Payload // the String column only
+    };
+
+    struct Range {
+        qint64 firstSerial;
+        qint64 lastSerial;
+        quint32 columns; // bit per HistoryModel column, the cells selected in these rows
+    };
+
+    static constexpr const char *RAW_MIME_TYPE = "application/octet-stream";
+
+    explicit SelectionCopier(const HistoryModel &_history, QObject *parent = nullptr);
+    ~SelectionCopier();
+
+    // GUI thread; _columns are the HistoryModel columns that may be copied, in order,
+    // a row gets those of them its range selects. A copy requested while one runs replaces it.
+    void copy(const QVector<Range> &_ranges, Mode _mode, const QVector<int> &_columns);
+    bool isCopying() const;
+
+signals:
+    void copied(qint64 _rows, qint64 _bytes);
+
+private slots:
+    void onCopied();
+
+private:
+    struct Request {
+        QVector<Range> ranges; // sorted, not overlapping
+        Mode mode;
+        QVector<int> columns;
+        qint64 utcOffsetMs;
+    };
+
+    struct Result {
+        QByteArray text;
+        QByteArray raw;
+        qint64 rows;
+    };
+
+    void start();
+    static Result formatted(const HistoryModel *_history, const Request &_request);
+
+private:
+    const HistoryModel &m_history;
+    QFutureWatcher<Result> m_watcher {};
+    Request m_next {};
+    bool m_pending {};
+};
+
+#endif // SELECTIONCOPIER_H
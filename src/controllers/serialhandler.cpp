@@ -1,25 +1,323 @@
 #include "serialhandler.h"
 #include <QDebug>
-#include <QMutexLocker>
+#include <QTimer>
 
-SerialHandler::SerialHandler()
+#ifdef Q_OS_UNIX
+#include <sys/ioctl.h>
+#endif
+
+#include "utils/captureclock.h"
+
+constexpr size_t SerialHandler::MAX_READ_SIZE;
+constexpr qint64 SerialHandler::TRANSMIT_AHEAD_NS;
+constexpr qint64 SerialHandler::MIN_TRANSMIT_BATCH;
+constexpr qint64 SerialHandler::MAX_TRANSMIT_BATCH;
+
+SerialHandler::SerialHandler(HistoryModel::DataDirection _direction, HistoryModel::DataDirection _forwardDirection, QObject *parent)
+    : ChunkSource(parent)
+    , m_direction(_direction)
+    , m_forwardDirection(_forwardDirection)
 {
     qDebug();
-    connect(this, &QSerialPort::readyRead, this, &SerialHandler::onReadyRead);
 }
 
 SerialHandler::~SerialHandler()
 {
-    if (isOpen()) {
-        close();
+    // the owner is expected to close() before stopping the I/O thread
+    Q_ASSERT(!m_port);
+}
+
+bool SerialHandler::open(const QString &_portName, qint32 _baudRate)
+{
+    bool ok = false;
+
+    runOnReader([&](){
+        closePort();
+
+        m_port = new QSerialPort(this);
+        m_port->setPortName(_portName);
+        m_port->setBaudRate(_baudRate);
+        m_port->setFlowControl(m_hardwareFlowControl ? QSerialPort::HardwareControl : QSerialPort::NoFlowControl);
+        connect(m_port, &QSerialPort::readyRead, this, &SerialHandler::onReadyRead);
+        connect(m_port, &QSerialPort::bytesWritten, this, &SerialHandler::onBytesWritten);
+
+        ok = m_port->open(QIODevice::ReadWrite);
+        m_errorString = m_port->errorString();
+
+        const auto parityBits = m_port->parity() == QSerialPort::NoParity ? 0 : 1;
+        const auto stopBits = m_port->stopBits() == QSerialPort::OneStop ? 1 : 2;
+        portOpened(captureclock::byteDuration(_baudRate, 1 + int(m_port->dataBits()) + parityBits + stopBits));
+        if (!ok) {
+            qWarning() << _portName << m_errorString;
+            closePort();
+        }
+        m_open = ok;
+    });
+
+    return ok;
+}
+
+void SerialHandler::close()
+{
+    runOnReader([&](){
+        closePort();
+    });
+}
+
+bool SerialHandler::isOpen() const
+{
+    return m_open;
+}
+
+QString SerialHandler::errorString() const
+{
+    return m_errorString;
+}
+
+void SerialHandler::setPeer(SerialHandler *_peer)
+{
+    runOnReader([&](){
+        Q_ASSERT(!_peer || _peer->thread() == thread());
+        m_peer = _peer;
+    });
+}
+
+void SerialHandler::setForwardingEnabled(bool _enabled)
+{
+    m_forwardingEnabled = _enabled;
+}
+
+bool SerialHandler::forwardingEnabled() const
+{
+    return m_forwardingEnabled;
+}
+
+SerialHandler::ForwardingStats SerialHandler::takeForwardingStats()
+{
+    return ForwardingStats {
+        m_forwardedChunks.exchange(0),
+        m_forwardedBytes.exchange(0),
+        m_forwardingTotalNs.exchange(0),
+        m_forwardingMaxNs.exchange(0)
+    };
+}
+
+void SerialHandler::setHardwareFlowControl(bool _enabled)
+{
+    m_hardwareFlowControl = _enabled;
+}
+
+bool SerialHandler::hardwareFlowControl() const
+{
+    return m_hardwareFlowControl;
+}
+
+void SerialHandler::transmit(const QByteArray &_data, qint64 _repeat)
+{
+    runOnReader([&](){
+        if (!m_port)
+            return;
+        m_transmitQueue.append(_data, _repeat);
+        m_queuedTransmitBytes = m_transmitQueue.queuedBytes();
+        writeBatch();
+    });
+}
+
+bool SerialHandler::transmitFile(const QString &_fileName)
+{
+    bool ok = false;
+
+    runOnReader([&](){
+        if (!m_port) {
+            m_errorString = "The port is not open";
+            return;
+        }
+        ok = m_transmitQueue.appendFile(_fileName, &m_errorString);
+        m_queuedTransmitBytes = m_transmitQueue.queuedBytes();
+        writeBatch();
+    });
+
+    return ok;
+}
+
+void SerialHandler::cancelTransmit()
+{
+    runOnReader([&](){
+        m_transmitQueue.clear();
+        m_queuedTransmitBytes = 0;
+        stopTransmitting();
+        if (m_port)
+            m_port->clear(QSerialPort::Output);
+    });
+}
+
+qint64 SerialHandler::queuedTransmitBytes() const
+{
+    return m_queuedTransmitBytes;
+}
+
+void SerialHandler::runOnReader(const std::function<void()> &_function)
+{
+    if (thread() == QThread::currentThread())
+        _function();
+    else
+        QMetaObject::invokeMethod(this, _function, Qt::BlockingQueuedConnection);
+}
+
+void SerialHandler::resumeReading()
+{
+    QMetaObject::invokeMethod(this, "onReadyRead", Qt::QueuedConnection);
+}
+
+void SerialHandler::closePort()
+{
+    if (!m_port)
+        return;
+
+    m_open = false;
+    if (m_port->isOpen())
+        m_port->close();
+    delete m_port;
+    m_port = nullptr;
+
+    m_transmitQueue.clear();
+    m_queuedTransmitBytes = 0;
+    stopTransmitting();
+}
+
+void SerialHandler::stopTransmitting()
+{
+    // a drain check already scheduled finds itself out of date
+    m_transmitting = false;
+    m_drainPending = false;
+    m_drainGeneration++;
+}
+
+bool SerialHandler::forward(const char *_data, qint64 _length)
+{
+    if (!m_forwardingEnabled || !m_peer || !m_peer->m_port || !m_peer->m_port->isOpen())
+        return false;
+
+    // same thread as the peer, write and push to the driver right away
+    m_peer->m_port->write(_data, _length);
+    m_peer->m_port->flush();
+    return true;
+}
+
+void SerialHandler::writeBatch()
+{
+    if (!m_port || !m_port->isOpen() || m_transmitQueue.isEmpty())
+        return;
+
+    // about TRANSMIT_AHEAD_NS of data waits for the line, more only while CTS holds it
+    const auto ahead = qBound(MIN_TRANSMIT_BATCH, TRANSMIT_AHEAD_NS / std::max<qint64>(characterTime(), 1), MAX_TRANSMIT_BATCH);
+    const auto room = ahead - m_port->bytesToWrite();
+    if (room < std::min(ahead / 2, MIN_TRANSMIT_BATCH))
+        return;
+
+    if (!m_transmitting) {
+        m_transmitting = true;
+        m_transmitStart = captureclock::now();
+        m_transmittedBytes = 0;
+        m_transmitBatch.reserve(int(MAX_TRANSMIT_BATCH));
+    }
+
+    // one write for the batch, QSerialPort sends it without blocking
+    m_transmitBatch.resize(0);
+    m_transmitQueue.take(&m_transmitBatch, room);
+    m_queuedTransmitBytes = m_transmitQueue.queuedBytes();
+    const auto written = m_port->write(m_transmitBatch);
+    if (written < 0) {
+        qWarning() << m_port->portName() << m_port->errorString();
+        m_transmitQueue.clear();
+        m_queuedTransmitBytes = 0;
+        stopTransmitting();
+        return;
     }
+    m_transmittedBytes += written;
 }
 
-void SerialHandler::onReadyRead()
+void SerialHandler::checkTransmitted()
+{
+    if (!m_port || !m_transmitting || !m_transmitQueue.isEmpty() || m_port->bytesToWrite() > 0)
+        return;
+
+    // the driver took the bytes, they are sent once its output queue is empty too;
+    // polled about when it should be, CTS may hold them longer
+    const auto unsent = driverQueuedBytes();
+    if (unsent > 0) {
+        if (!m_drainPending) {
+            m_drainPending = true;
+            const auto msecs = std::max<qint64>(1, unsent * characterTime() / 1000000);
+            const auto generation = m_drainGeneration;
+            QTimer::singleShot(int(std::min<qint64>(msecs, 1000)), Qt::PreciseTimer, this, [this, generation](){
+                if (generation != m_drainGeneration)
+                    return; // cancelled or closed meanwhile
+                m_drainPending = false;
+                checkTransmitted();
+            });
+        }
+        return;
+    }
+
+    m_transmitting = false;
+    emit transmitted(m_transmittedBytes, captureclock::now() - m_transmitStart, m_transmittedBytes * characterTime());
+}
+
+qint64 SerialHandler::driverQueuedBytes() const
+{
+    // elsewhere the queue is not known, the bytes count as sent once the driver has them
+#ifdef Q_OS_UNIX
+    int queued = 0;
+    if (m_port && ::ioctl(int(m_port->handle()), TIOCOUTQ, &queued) == 0)
+        return queued;
+#endif
+    return 0;
+}
+
+void SerialHandler::onBytesWritten()
 {
+    writeBatch();
+    checkTransmitted();
 }
 
-QString SerialHandler::formatData(const QByteArray &data)
+void SerialHandler::onReadyRead()
 {
-    return data;
+    if (!m_port)
+        return;
+
+    bool queued = false;
+
+    while (m_port->bytesAvailable() > 0) {
+        const auto wanted = std::min<size_t>(size_t(m_port->bytesAvailable()), MAX_READ_SIZE);
+        size_t length {};
+        uint64_t position {};
+        const auto buffer = acquireRead(wanted, &length, &position);
+        if (!buffer)
+            break;
+
+        const auto read = m_port->read(buffer, qint64(length));
+        if (read <= 0)
+            break;
+
+        // one clock read per chunk, it dates the last byte
+        const auto timestamp = captureclock::now();
+
+        const auto forwarded = forward(buffer, read);
+        if (forwarded) {
+            const auto latencyNs = quint64(captureclock::now() - timestamp);
+            m_forwardedChunks++;
+            m_forwardedBytes += quint64(read);
+            m_forwardingTotalNs += latencyNs;
+
+            auto maxNs = m_forwardingMaxNs.load(std::memory_order_relaxed);
+            while (latencyNs > maxNs && !m_forwardingMaxNs.compare_exchange_weak(maxNs, latencyNs)) {}
+        }
+
+        commitRead(buffer, position, size_t(read), forwarded ? m_forwardDirection : m_direction, timestamp);
+        queued = true;
+    }
+
+    if (queued)
+        announce();
 }
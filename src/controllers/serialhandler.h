@@ -2,30 +2,102 @@
 #define SERIALHANDLER_H
 
 #include <QtSerialPort/QtSerialPort>
-#include <QByteArray>
+#include <atomic>
+#include <functional>
 
-// struct StaticBuffer {
-    // size_t length;
-    // uint8_t data[MAX_BUFFER_LENGTH];
-// };
+#include "controllers/chunksource.h"
+#include "utils/transmitqueue.h"
 
-class SerialHandler : public QSerialPort
+// Owns one serial port and reads it on the thread this object is moved to,
+// the chunks are consumed through ChunkSource. Data to send is queued and written
+// from the same thread in batches that keep about TRANSMIT_AHEAD_NS of data ahead
+// of the line, so the UART never idles and a CTS hold never piles up buffers.
+class SerialHandler : public ChunkSource
 {
     Q_OBJECT
 public:
-    SerialHandler();
+    using Chunk = ChunkSource::Chunk;
+
+    struct ForwardingStats {
+        quint64 chunks;
+        quint64 bytes;
+        quint64 totalNs;
+        quint64 maxNs;
+    };
+
+    // _forwardDirection tags chunks that were also forwarded to the peer port
+    SerialHandler(HistoryModel::DataDirection _direction, HistoryModel::DataDirection _forwardDirection, QObject *parent = nullptr);
     ~SerialHandler();
 
-private:
-    QString formatData(const QByteArray &data);
+    // thread-safe, executed on the I/O thread
+    bool open(const QString &_portName, qint32 _baudRate);
+    void close();
+    bool isOpen() const;
+    QString errorString() const;
+
+    // the peer must live on the same I/O thread, received bytes are written to it
+    // from the reader itself, before they are queued for the GUI
+    void setPeer(SerialHandler *_peer);
+    void setForwardingEnabled(bool _enabled);
+    bool forwardingEnabled() const;
+    ForwardingStats takeForwardingStats(); // resets the counters
+
+    // RTS/CTS handshaking, applied when the port opens
+    void setHardwareFlowControl(bool _enabled);
+    bool hardwareFlowControl() const;
+
+    // thread-safe, queued behind what is being sent
+    void transmit(const QByteArray &_data, qint64 _repeat = 1);
+    bool transmitFile(const QString &_fileName); // errorString() tells why not
+    void cancelTransmit();
+    qint64 queuedTransmitBytes() const; // not handed to the driver yet
 
 signals:
-    void dataReceived(const QString &data);
+    // the line sent the last queued byte: _bytes took _nsecs, the line needs _lineNsecs for them at the baud rate
+    void transmitted(qint64 _bytes, qint64 _nsecs, qint64 _lineNsecs);
+
+protected:
+    void runOnReader(const std::function<void()> &_function) override;
+    void resumeReading() override;
+
+private:
+    void closePort();
+    bool forward(const char *_data, qint64 _length);
+    void writeBatch();
+    void checkTransmitted();
+    void stopTransmitting(); // cancelled or closed, the drain is no longer polled
+    qint64 driverQueuedBytes() const;
 
 private slots:
     void onReadyRead();
+    void onBytesWritten();
 
 private:
+    static constexpr size_t MAX_READ_SIZE = 64 * 1024;
+    static constexpr qint64 TRANSMIT_AHEAD_NS = 20 * 1000 * 1000;
+    static constexpr qint64 MIN_TRANSMIT_BATCH = 256;
+    static constexpr qint64 MAX_TRANSMIT_BATCH = 1024 * 1024;
+
+    QSerialPort *m_port {nullptr}; // lives on the I/O thread
+    SerialHandler *m_peer {nullptr};
+    const HistoryModel::DataDirection m_direction;
+    const HistoryModel::DataDirection m_forwardDirection;
+    std::atomic<bool> m_open {false};
+    std::atomic<bool> m_forwardingEnabled {false};
+    std::atomic<quint64> m_forwardedChunks {0};
+    std::atomic<quint64> m_forwardedBytes {0};
+    std::atomic<quint64> m_forwardingTotalNs {0};
+    std::atomic<quint64> m_forwardingMaxNs {0};
+    std::atomic<bool> m_hardwareFlowControl {false};
+    TransmitQueue m_transmitQueue {}; // I/O thread only
+    QByteArray m_transmitBatch {};
+    bool m_transmitting {};
+    bool m_drainPending {}; // checkTransmitted() is due again
+    quint32 m_drainGeneration {}; // bumped by stopTransmitting(), the due check is dropped then
+    qint64 m_transmitStart {};
+    qint64 m_transmittedBytes {};
+    std::atomic<qint64> m_queuedTransmitBytes {0};
+    QString m_errorString {};
 };
 
 #endif // SERIALHANDLER_H
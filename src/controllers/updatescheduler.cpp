@@ -0,0 +1,240 @@
+#include "updatescheduler.h"
+#include <algorithm>
+
+#include "controllers/chunksource.h"
+#include "utils/captureclock.h"
+
+UpdateScheduler::UpdateScheduler(HistoryModel &_history, QObject *parent)
+    : QObject(parent)
+    , m_history(_history)
+{
+    m_timer.setSingleShot(true);
+    m_timer.setTimerType(Qt::PreciseTimer);
+    connect(&m_timer, &QTimer::timeout, this, &UpdateScheduler::flush);
+}
+
+constexpr double UpdateScheduler::OVERLOAD_ENTER_LEVEL;
+constexpr double UpdateScheduler::OVERLOAD_LEAVE_LEVEL;
+constexpr quint32 UpdateScheduler::DROP_OLDEST_KEEP_BYTES;
+
+void UpdateScheduler::addSource(ChunkSource *_source)
+{
+    m_sources.append(_source);
+    m_stalls.append(_source->stallCount());
+    m_gaps.append(false);
+    connect(_source, &ChunkSource::dataAvailable, this, &UpdateScheduler::schedule);
+}
+
+void UpdateScheduler::removeSource(ChunkSource *_source)
+{
+    disconnect(_source, &ChunkSource::dataAvailable, this, &UpdateScheduler::schedule);
+    const auto index = m_sources.indexOf(_source);
+    if (index >= 0) {
+        m_sources.remove(index);
+        m_stalls.remove(index);
+        m_gaps.remove(index);
+    }
+}
+
+int UpdateScheduler::flushInterval() const
+{
+    return m_flushInterval;
+}
+
+void UpdateScheduler::setFlushInterval(int _ms)
+{
+    m_flushInterval = std::max(0, _ms);
+}
+
+UpdateScheduler::OverloadPolicy UpdateScheduler::overloadPolicy() const
+{
+    return m_overloadPolicy;
+}
+
+void UpdateScheduler::setOverloadPolicy(OverloadPolicy _policy)
+{
+    m_overloadPolicy = _policy;
+}
+
+int UpdateScheduler::sampleInterval() const
+{
+    return m_sampleInterval;
+}
+
+void UpdateScheduler::setSampleInterval(int _chunks)
+{
+    m_sampleInterval = std::max(1, _chunks);
+}
+
+bool UpdateScheduler::isOverloaded() const
+{
+    return m_overloaded;
+}
+
+quint64 UpdateScheduler::totalDroppedChunks() const
+{
+    return m_totalDroppedChunks;
+}
+
+quint64 UpdateScheduler::totalDroppedBytes() const
+{
+    return m_totalDroppedBytes;
+}
+
+const char *UpdateScheduler::toString(OverloadPolicy _policy)
+{
+    switch (_policy) {
+    case Backpressure:
+        return "backpressure";
+    case PauseRendering:
+        return "pause rendering";
+    case SampleChunks:
+        return "sample chunks";
+    case DropOldest:
+        return "drop oldest";
+    }
+    return "invalid";
+}
+
+UpdateScheduler::Stats UpdateScheduler::takeStats()
+{
+    const auto stats = m_stats;
+    m_stats = Stats {};
+    return stats;
+}
+
+void UpdateScheduler::schedule()
+{
+    if (m_timer.isActive())
+        return;
+
+    // flush right away if the last flush is older than one interval
+    const auto elapsed = m_lastFlush.isValid() ? m_lastFlush.elapsed() : m_flushInterval;
+    m_timer.start(int(std::max<qint64>(0, m_flushInterval - elapsed)));
+}
+
+void UpdateScheduler::flush()
+{
+    m_timer.stop();
+    m_batch.clear();
+
+    // the latest chunk goes to the bottom of the heap, ties in read order
+    const auto later = [](const Cursor &_a, const Cursor &_b) {
+        return _a.timestamp != _b.timestamp ? _a.timestamp > _b.timestamp : _a.sequence > _b.sequence;
+    };
+
+    updateOverload();
+    const auto sampling = m_overloaded && m_overloadPolicy == SampleChunks;
+
+    // snapshot every queue, then merge them by capture time
+    const auto sources = m_sources.size();
+    m_queued.resize(sources);
+    m_taken.fill(0, sources);
+    m_heap.clear();
+    size_t queued = 0;
+    for (int i = 0; i < sources; ++i) {
+        m_queued[i] = m_sources[i]->queuedChunks();
+        queued += m_queued[i];
+        if (m_overloaded && m_overloadPolicy == DropOldest)
+            m_taken[i] = dropOldest(i);
+        if (m_taken[i] < m_queued[i]) {
+            const auto chunk = m_sources[i]->chunkAt(m_taken[i]);
+            m_heap.append(Cursor {chunk->timestamp, chunk->sequence, i});
+        }
+    }
+    std::make_heap(m_heap.begin(), m_heap.end(), later);
+
+    while (!m_heap.isEmpty()) {
+        std::pop_heap(m_heap.begin(), m_heap.end(), later);
+        auto &cursor = m_heap.last();
+        const auto source = m_sources[cursor.source];
+        const auto chunk = source->chunkAt(m_taken[cursor.source]++);
+
+        if (sampling && m_sampleCounter++ % quint64(m_sampleInterval) != 0) {
+            countDropped(cursor.source, chunk->length);
+        } else {
+            // the first chunk after a drop starts a row of its own
+            m_batch.append(HistoryModel::Chunk {chunk->direction, source->chunkBytes(*chunk), int(chunk->length),
+                                                chunk->timestamp, chunk->byteTime, chunk->framing, m_gaps[cursor.source]});
+            m_gaps[cursor.source] = false;
+        }
+
+        if (m_taken[cursor.source] == m_queued[cursor.source]) {
+            m_heap.removeLast();
+        } else {
+            const auto next = source->chunkAt(m_taken[cursor.source]);
+            cursor.timestamp = next->timestamp;
+            cursor.sequence = next->sequence;
+            std::push_heap(m_heap.begin(), m_heap.end(), later);
+        }
+    }
+
+    if (!m_batch.isEmpty())
+        m_history.appendChunks(m_batch);
+
+    const auto updatedAt = captureclock::now();
+    for (const auto &chunk : qAsConst(m_batch))
+        m_stats.latency.record(updatedAt - chunk.timestamp);
+    m_stats.flushes++;
+    m_stats.chunks += quint64(m_batch.size());
+    m_stats.maxQueuedChunks = std::max(m_stats.maxQueuedChunks, queued);
+
+    // the model copied the bytes, give the ring space back to the readers
+    for (int i = 0; i < sources; ++i) {
+        for (size_t k = 0; k < m_taken[i]; ++k)
+            m_sources[i]->popChunk();
+    }
+
+    m_lastFlush.restart();
+    emit flushed();
+}
+
+void UpdateScheduler::updateOverload()
+{
+    // full queues or a reader that had to wait since the last flush
+    bool full = false;
+    bool drained = true;
+    for (int i = 0; i < m_sources.size(); ++i) {
+        const auto level = m_sources[i]->fillLevel();
+        const auto stalls = m_sources[i]->stallCount();
+        full |= level >= OVERLOAD_ENTER_LEVEL || stalls != m_stalls[i];
+        drained &= level <= OVERLOAD_LEAVE_LEVEL;
+        m_stalls[i] = stalls;
+    }
+
+    if (m_overloaded ? !drained : !full)
+        return;
+
+    m_overloaded = !m_overloaded;
+    emit overloadChanged(m_overloaded);
+}
+
+size_t UpdateScheduler::dropOldest(int _source)
+{
+    // keep the newest chunks that fit the budget, at least one
+    const auto source = m_sources[_source];
+    const auto queued = m_queued[_source];
+    size_t kept = 0;
+    quint64 keptBytes = 0;
+    while (kept < queued) {
+        const auto length = source->chunkAt(queued - 1 - kept)->length;
+        if (kept > 0 && keptBytes + length > DROP_OLDEST_KEEP_BYTES)
+            break;
+        keptBytes += length;
+        kept++;
+    }
+
+    const auto dropped = queued - kept;
+    for (size_t k = 0; k < dropped; ++k)
+        countDropped(_source, source->chunkAt(k)->length);
+    return dropped;
+}
+
+void UpdateScheduler::countDropped(int _source, quint32 _length)
+{
+    m_gaps[_source] = true;
+    m_stats.droppedChunks++;
+    m_stats.droppedBytes += _length;
+    m_totalDroppedChunks++;
+    m_totalDroppedBytes += _length;
+}
@@ -0,0 +1,108 @@
+#ifndef UPDATESCHEDULER_H
+#define UPDATESCHEDULER_H
+
+#include <QObject>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QVector>
+
+#include "models/historymodel.h"
+#include "utils/latencyhistogram.h"
+
+class ChunkSource;
+
+// Coalesces chunks from the sources and hands them to HistoryModel at most
+// once per flush interval, so bursts turn into a single model update. The
+// queues are merged by capture time, reads from different ports interleave
+// in the order their bytes arrived.
+//
+// A source whose queue fills up past half, or whose reader had to wait, puts the
+// scheduler in overload until every queue is almost empty again. The policy decides
+// what gives then; dropping keeps the readers going, so a recorder still gets every byte.
+// A waiting reader leaves the bytes in the port, where the driver may drop them before
+// the recorder sees them, so the default drops instead.
+class UpdateScheduler : public QObject
+{
+    Q_OBJECT
+public:
+    enum OverloadPolicy {
+        Backpressure, // every chunk reaches the model, full queues make the readers wait
+        PauseRendering, // every chunk reaches the model, the view stops painting meanwhile; the readers still may wait
+        SampleChunks, // one chunk in sampleInterval() reaches the model, the others are dropped
+        DropOldest // the newest chunks of every queue reach the model, the older ones are dropped
+    };
+
+    struct Stats {
+        quint64 flushes; // since the last takeStats()
+        quint64 chunks;
+        quint64 droppedChunks;
+        quint64 droppedBytes;
+        size_t maxQueuedChunks; // deepest backlog a flush found, all sources together
+        LatencyHistogram latency; // per chunk, from the read to the model update
+    };
+
+    explicit UpdateScheduler(HistoryModel &_history, QObject *parent = nullptr);
+
+    void addSource(ChunkSource *_source);
+    void removeSource(ChunkSource *_source); // its queued chunks are left in place
+
+    int flushInterval() const;
+    void setFlushInterval(int _ms);
+
+    OverloadPolicy overloadPolicy() const;
+    void setOverloadPolicy(OverloadPolicy _policy);
+    int sampleInterval() const;
+    void setSampleInterval(int _chunks);
+    bool isOverloaded() const;
+    quint64 totalDroppedChunks() const; // since the scheduler was created
+    quint64 totalDroppedBytes() const;
+    static const char *toString(OverloadPolicy _policy);
+
+    Stats takeStats();
+
+signals:
+    // the model has been updated, once per flush
+    void flushed();
+    void overloadChanged(bool _overloaded);
+
+public slots:
+    void schedule();
+    void flush();
+
+private:
+    void updateOverload();
+    size_t dropOldest(int _source); // returns how many chunks to skip
+    void countDropped(int _source, quint32 _length);
+
+private:
+    struct Cursor {
+        qint64 timestamp; // of the next chunk
+        quint64 sequence;
+        int source;
+    };
+
+    static constexpr double OVERLOAD_ENTER_LEVEL = 0.5;
+    static constexpr double OVERLOAD_LEAVE_LEVEL = 0.125;
+    static constexpr quint32 DROP_OLDEST_KEEP_BYTES = 256 * 1024; // per source and flush
+
+    HistoryModel &m_history;
+    QVector<ChunkSource *> m_sources {};
+    QVector<quint64> m_stalls {}; // per source, when the last flush started
+    QVector<bool> m_gaps {}; // per source, chunks were dropped since the last one that was kept
+    QVector<HistoryModel::Chunk> m_batch {};
+    QVector<size_t> m_queued {}; // per source, reused by every flush
+    QVector<size_t> m_taken {};
+    QVector<Cursor> m_heap {};
+    QTimer m_timer {};
+    QElapsedTimer m_lastFlush {};
+    int m_flushInterval {16}; // ms, about one display frame
+    Stats m_stats {};
+    OverloadPolicy m_overloadPolicy {DropOldest}; // readers only wait if the GUI thread stops flushing
+    int m_sampleInterval {10};
+    quint64 m_sampleCounter {};
+    bool m_overloaded {};
+    quint64 m_totalDroppedChunks {};
+    quint64 m_totalDroppedBytes {};
+};
+
+#endif // UPDATESCHEDULER_H
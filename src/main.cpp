@@ -1,10 +1,20 @@
 #include <QApplication>
+#include <cstring>
 
+#include "controllers/headlesscapture.h"
 #include "controllers/mainwindow.h"
 #include "utils/loghandler.h"
 
 int main(int argc, char *argv[])
 {
+    // no QApplication and no widgets when capturing headless
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--headless") == 0) {
+            initLog(true);
+            return runHeadless(argc, argv);
+        }
+    }
+
     initLog();
 
     QApplication a(argc, argv);
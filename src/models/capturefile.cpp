@@ -0,0 +1,280 @@
+#include "capturefile.h"
+#include <QFileInfo>
+#include <cstring>
+#include <limits>
+#include <algorithm>
+
+#ifdef Q_OS_WIN
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace capturefile {
+
+static const char MAGIC[8] = "SSPYIDX";
+
+QString journalPath(const QString &_indexPath)
+{
+    const QFileInfo info(_indexPath);
+    return info.path() + "/" + info.completeBaseName() + "." + JOURNAL_SUFFIX;
+}
+
+} // namespace capturefile
+
+using namespace capturefile;
+
+CaptureReader::~CaptureReader()
+{
+    close();
+}
+
+bool CaptureReader::open(const QString &_indexPath)
+{
+    close();
+
+    m_index.setFileName(_indexPath);
+    m_journal.setFileName(journalPath(_indexPath));
+    if (!m_index.open(QIODevice::ReadOnly))
+        return fail(m_index.errorString());
+    if (!m_journal.open(QIODevice::ReadOnly))
+        return fail(m_journal.errorString());
+
+    Header header {};
+    if (m_index.read(reinterpret_cast<char *>(&header), sizeof(header)) != qint64(sizeof(header)))
+        return fail("Not a capture file");
+    if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0)
+        return fail("Not a capture file");
+    if (header.version != VERSION || header.byteOrderMark != BYTE_ORDER_MARK
+            || header.headerSize != sizeof(Header) || header.recordSize != sizeof(Record))
+        return fail("Unsupported capture file version");
+
+    // a record torn by an interrupted write is ignored
+    const auto count = (m_index.size() - qint64(sizeof(Header))) / qint64(sizeof(Record));
+    m_count = int(std::min<qint64>(count, std::numeric_limits<int>::max()));
+    m_journalSize = m_journal.size();
+
+    if (m_count > 0) {
+        m_records = m_index.map(sizeof(Header), qint64(m_count) * qint64(sizeof(Record)));
+        if (!m_records)
+            return fail(m_index.errorString());
+    }
+    if (m_journalSize > 0) {
+        m_data = m_journal.map(0, m_journalSize);
+        if (!m_data)
+            return fail(m_journal.errorString());
+    }
+
+    m_errorString.clear();
+    return true;
+}
+
+void CaptureReader::close()
+{
+    // closing the files drops the mappings
+    m_index.close();
+    m_journal.close();
+    m_records = nullptr;
+    m_data = nullptr;
+    m_journalSize = 0;
+    m_count = 0;
+}
+
+bool CaptureReader::isOpen() const
+{
+    return m_index.isOpen();
+}
+
+QString CaptureReader::fileName() const
+{
+    return m_index.fileName();
+}
+
+QString CaptureReader::errorString() const
+{
+    return m_errorString;
+}
+
+int CaptureReader::count() const
+{
+    return m_count;
+}
+
+quint8 CaptureReader::direction(int _row) const
+{
+    return record(_row).direction;
+}
+
+qint64 CaptureReader::timestamp(int _row) const
+{
+    return record(_row).timestamp;
+}
+
+const char *CaptureReader::data(int _row) const
+{
+    if (length(_row) == 0)
+        return "";
+    return reinterpret_cast<const char *>(m_data) + record(_row).offset;
+}
+
+int CaptureReader::length(int _row) const
+{
+    const auto &r = record(_row);
+    if (r.offset > quint64(m_journalSize) || r.length > quint64(m_journalSize) - r.offset)
+        return 0;
+    return int(r.length);
+}
+
+const Record &CaptureReader::record(int _row) const
+{
+    Q_ASSERT(_row >= 0 && _row < m_count);
+    // the 32-byte header keeps the mapped records 8-byte aligned
+    return reinterpret_cast<const Record *>(m_records)[_row];
+}
+
+bool CaptureReader::fail(const QString &_error)
+{
+    close();
+    m_errorString = _error;
+    return false;
+}
+
+CaptureWriter::~CaptureWriter()
+{
+    close();
+}
+
+bool CaptureWriter::open(const QString &_indexPath)
+{
+    close();
+
+    m_index.setFileName(_indexPath);
+    m_journal.setFileName(journalPath(_indexPath));
+    // buffered here, QFile's own buffer would only split the writes
+    if (!m_index.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Unbuffered))
+        return fail(m_index);
+    if (!m_journal.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Unbuffered)) {
+        m_index.close();
+        return fail(m_journal);
+    }
+
+    Header header {};
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.byteOrderMark = BYTE_ORDER_MARK;
+    header.headerSize = sizeof(Header);
+    header.recordSize = sizeof(Record);
+
+    m_indexBuffer.reserve(m_bufferSize);
+    m_journalBuffer.reserve(m_bufferSize);
+    m_indexBuffer.append(reinterpret_cast<const char *>(&header), sizeof(header));
+    m_journalSize = 0;
+    m_bytesWritten = sizeof(header);
+    m_errorString.clear();
+    return true;
+}
+
+bool CaptureWriter::close()
+{
+    if (!isOpen())
+        return true;
+
+    const auto ok = flush();
+    m_index.close();
+    m_journal.close();
+    m_indexBuffer.clear();
+    m_journalBuffer.clear();
+    return ok;
+}
+
+bool CaptureWriter::isOpen() const
+{
+    return m_index.isOpen();
+}
+
+QString CaptureWriter::errorString() const
+{
+    return m_errorString;
+}
+
+bool CaptureWriter::append(quint8 _direction, qint64 _timestamp, const char *_data, int _length)
+{
+    Q_ASSERT(isOpen());
+
+    Record record {};
+    record.timestamp = _timestamp;
+    record.offset = m_journalSize;
+    record.length = quint32(_length);
+    record.direction = _direction;
+
+    // large rows bypass the buffer
+    if (_length >= m_bufferSize) {
+        if (!writeAll(m_journal, m_journalBuffer))
+            return false;
+        if (m_journal.write(_data, _length) != _length)
+            return fail(m_journal);
+    } else {
+        m_journalBuffer.append(_data, _length);
+    }
+    m_indexBuffer.append(reinterpret_cast<const char *>(&record), sizeof(record));
+    m_journalSize += quint64(_length);
+    m_bytesWritten += _length + qint64(sizeof(record));
+
+    if (m_journalBuffer.size() >= m_bufferSize || m_indexBuffer.size() >= m_bufferSize)
+        return flush();
+    return true;
+}
+
+bool CaptureWriter::flush()
+{
+    // the journal goes first so a record never points to bytes that are not written yet
+    return writeAll(m_journal, m_journalBuffer) && writeAll(m_index, m_indexBuffer);
+}
+
+bool CaptureWriter::sync()
+{
+    if (!flush())
+        return false;
+
+#ifdef Q_OS_WIN
+    const auto ok = _commit(m_journal.handle()) == 0 && _commit(m_index.handle()) == 0;
+#else
+    const auto ok = fsync(m_journal.handle()) == 0 && fsync(m_index.handle()) == 0;
+#endif
+    if (!ok)
+        m_errorString = "fsync failed";
+    return ok;
+}
+
+qint64 CaptureWriter::bytesWritten() const
+{
+    return m_bytesWritten;
+}
+
+qint64 CaptureWriter::bufferedBytes() const
+{
+    return m_indexBuffer.size() + m_journalBuffer.size();
+}
+
+void CaptureWriter::setBufferSize(int _bytes)
+{
+    m_bufferSize = std::max(_bytes, int(sizeof(Record)));
+}
+
+bool CaptureWriter::writeAll(QFile &_file, QByteArray &_buffer)
+{
+    if (_buffer.isEmpty())
+        return true;
+
+    if (_file.write(_buffer) != _buffer.size())
+        return fail(_file);
+
+    _buffer.resize(0); // keeps the capacity
+    return true;
+}
+
+bool CaptureWriter::fail(const QFile &_file)
+{
+    m_errorString = _file.errorString();
+    return false;
+}
@@ -0,0 +1,117 @@
+#ifndef CAPTUREFILE_H
+#define CAPTUREFILE_H
+
+#include <QFile>
+#include <QByteArray>
+#include <QString>
+
+// Capture on disk, as two files next to each other:
+//  <name>.ssidx  a header followed by fixed-width row records
+//  <name>.ssraw  the append-only journal of row bytes, records point into it
+// Both are only ever appended to, the row count follows from the index size,
+// so a capture that is still being written can be opened as well.
+namespace capturefile {
+
+constexpr quint32 VERSION = 1;
+constexpr quint32 BYTE_ORDER_MARK = 0x01020304;
+constexpr const char *INDEX_SUFFIX = "ssidx";
+constexpr const char *JOURNAL_SUFFIX = "ssraw";
+
+struct Header {
+    char magic[8]; // "SSPYIDX"
+    quint32 version;
+    quint32 byteOrderMark; // written natively, rejected when it reads back differently
+    quint32 headerSize;
+    quint32 recordSize;
+    qint64 reserved;
+};
+
+struct Record {
+    qint64 timestamp; // ns since epoch
+    quint64 offset; // in the journal
+    quint32 length;
+    quint8 direction;
+    quint8 reserved[3];
+};
+
+static_assert(sizeof(Header) == 32, "capture header layout");
+static_assert(sizeof(Record) == 24, "capture record layout");
+
+QString journalPath(const QString &_indexPath);
+
+} // namespace capturefile
+
+// Read-only view on a capture, both files are memory-mapped so opening is
+// constant time and only the rows being looked at are paged in.
+class CaptureReader
+{
+public:
+    CaptureReader() = default;
+    ~CaptureReader();
+    CaptureReader(const CaptureReader &) = delete;
+    CaptureReader &operator=(const CaptureReader &) = delete;
+
+    bool open(const QString &_indexPath);
+    void close();
+    bool isOpen() const;
+    QString fileName() const;
+    QString errorString() const;
+
+    int count() const;
+    quint8 direction(int _row) const;
+    qint64 timestamp(int _row) const; // ns since epoch
+    const char *data(int _row) const; // valid until close()
+    int length(int _row) const; // 0 if the row points past the journal
+
+private:
+    const capturefile::Record &record(int _row) const;
+    bool fail(const QString &_error);
+
+private:
+    QFile m_index {};
+    QFile m_journal {};
+    const uchar *m_records {nullptr};
+    const uchar *m_data {nullptr};
+    qint64 m_journalSize {};
+    int m_count {};
+    QString m_errorString {};
+};
+
+// Appends rows to a capture, buffered into large sequential writes.
+class CaptureWriter
+{
+public:
+    CaptureWriter() = default;
+    ~CaptureWriter();
+    CaptureWriter(const CaptureWriter &) = delete;
+    CaptureWriter &operator=(const CaptureWriter &) = delete;
+
+    bool open(const QString &_indexPath); // truncates an existing capture
+    bool close(); // flushes first
+    bool isOpen() const;
+    QString errorString() const;
+
+    bool append(quint8 _direction, qint64 _timestamp, const char *_data, int _length);
+    bool flush(); // hands the buffers to the OS
+    bool sync(); // flush() and wait for the data to reach the disk
+    qint64 bytesWritten() const; // journal and index, including buffered bytes
+    qint64 bufferedBytes() const;
+
+    void setBufferSize(int _bytes); // flush threshold
+
+private:
+    bool writeAll(QFile &_file, QByteArray &_buffer);
+    bool fail(const QFile &_file);
+
+private:
+    QFile m_index {};
+    QFile m_journal {};
+    QByteArray m_indexBuffer {};
+    QByteArray m_journalBuffer {};
+    quint64 m_journalSize {};
+    qint64 m_bytesWritten {};
+    int m_bufferSize {1024 * 1024};
+    QString m_errorString {};
+};
+
+#endif // CAPTUREFILE_H
@@ -0,0 +1,107 @@
+#include "chunklog.h"
+#include <algorithm>
+
+constexpr int ChunkLog::PAGE_SIZE;
+
+qint64 ChunkLog::Snapshot::firstEntry() const
+{
+    return pages.isEmpty() ? 0 : pages.first().firstEntry;
+}
+
+qint64 ChunkLog::Snapshot::endEntry() const
+{
+    return pages.isEmpty() ? 0 : pages.last().firstEntry + pages.last().entries.size();
+}
+
+qint64 ChunkLog::Snapshot::visit(qint64 _from, qint64 _to, const std::function<bool(const Entry &, const char *)> &_visitor) const
+{
+    _from = std::max(_from, firstEntry());
+    _to = std::min(_to, endEntry());
+    if (_from >= _to)
+        return _from;
+
+    auto page = std::upper_bound(pages.cbegin(), pages.cend(), _from,
+                                 [](qint64 _entry, const Page &_page) { return _entry < _page.firstEntry; }) - 1;
+    for (auto entry = _from; entry < _to; ++entry) {
+        if (entry == page->firstEntry + page->entries.size())
+            ++page;
+        const auto &e = page->entries.at(int(entry - page->firstEntry));
+        if (!_visitor(e, page->bytes.constData() + e.offset))
+            return entry;
+    }
+    return _to;
+}
+
+qint64 ChunkLog::maxSize() const
+{
+    return m_maxSize;
+}
+
+void ChunkLog::setMaxSize(qint64 _bytes)
+{
+    m_maxSize = std::max<qint64>(_bytes, 0);
+    if (m_maxSize == 0)
+        clear();
+    else
+        trim();
+}
+
+bool ChunkLog::isEnabled() const
+{
+    return m_maxSize > 0;
+}
+
+void ChunkLog::clear()
+{
+    m_pages.clear();
+    m_size = 0;
+    m_endEntry = 0;
+}
+
+void ChunkLog::append(quint8 _direction, const char *_data, int _length, qint64 _timestamp, qint64 _byteTime, quint8 _framing, bool _gap)
+{
+    if (!isEnabled() || _length <= 0)
+        return;
+
+    // a chunk never spans pages, an oversized one gets a page of its own
+    if (m_pages.isEmpty() || (!m_pages.last().bytes.isEmpty() && m_pages.last().bytes.size() + _length > PAGE_SIZE)) {
+        Page page {m_endEntry, {}, {}};
+        page.bytes.reserve(std::max(PAGE_SIZE, _length));
+        m_pages.append(page);
+    }
+
+    // detaches from a snapshot at most once per page
+    auto &page = m_pages.last();
+    page.entries.append(Entry {page.bytes.size(), _length, _direction, _framing, _gap, _timestamp, _byteTime});
+    page.bytes.append(_data, _length);
+    m_size += _length;
+    m_endEntry++;
+    trim();
+}
+
+ChunkLog::Snapshot ChunkLog::snapshot() const
+{
+    return Snapshot {m_pages};
+}
+
+qint64 ChunkLog::endEntry() const
+{
+    return m_endEntry;
+}
+
+qint64 ChunkLog::memoryUsage() const
+{
+    qint64 memory = 0;
+    for (const auto &page : m_pages)
+        memory += page.bytes.capacity() + page.entries.capacity() * qint64(sizeof(Entry));
+    return memory;
+}
+
+void ChunkLog::trim()
+{
+    // the newest page stays
+    while (m_pages.size() > 1 && m_size > m_maxSize) {
+        m_size -= m_pages.first().bytes.size();
+        m_pages.removeFirst();
+    }
+}
@@ -0,0 +1,65 @@
+#ifndef CHUNKLOG_H
+#define CHUNKLOG_H
+
+#include <QByteArray>
+#include <QVector>
+#include <functional>
+
+// The received chunks in arrival order, bytes and timestamps as they came in, so
+// rows can be segmented again from the source when the newline settings change.
+// Chunks are packed into pages of PAGE_SIZE bytes and the oldest pages go once
+// the log exceeds its size. Pages are implicitly shared: a snapshot is a cheap,
+// consistent copy that a worker can read while the GUI thread keeps appending.
+class ChunkLog
+{
+public:
+    struct Entry {
+        int offset; // in the page's bytes
+        int length;
+        quint8 direction;
+        quint8 framing; // HistoryModel::Framing
+        bool gap; // HistoryModel::Chunk::gap
+        qint64 timestamp; // capture clock of the last byte, ns
+        qint64 byteTime;
+    };
+
+    struct Page {
+        qint64 firstEntry; // numbered since clear()
+        QByteArray bytes;
+        QVector<Entry> entries;
+    };
+
+    struct Snapshot {
+        QVector<Page> pages;
+
+        qint64 firstEntry() const;
+        qint64 endEntry() const; // after the newest one
+        // calls _visitor for the entries from _from until before _to while it returns true,
+        // returns the entry it stopped at
+        qint64 visit(qint64 _from, qint64 _to, const std::function<bool(const Entry &_entry, const char *_data)> &_visitor) const;
+    };
+
+    qint64 maxSize() const;
+    void setMaxSize(qint64 _bytes); // 0 disables the log and clears it
+    bool isEnabled() const;
+    void clear();
+
+    void append(quint8 _direction, const char *_data, int _length, qint64 _timestamp, qint64 _byteTime, quint8 _framing, bool _gap);
+
+    Snapshot snapshot() const;
+    qint64 endEntry() const;
+    qint64 memoryUsage() const;
+
+private:
+    void trim();
+
+private:
+    static constexpr int PAGE_SIZE = 1024 * 1024;
+
+    QVector<Page> m_pages {};
+    qint64 m_size {}; // chunk bytes in all pages
+    qint64 m_maxSize {};
+    qint64 m_endEntry {};
+};
+
+#endif // CHUNKLOG_H
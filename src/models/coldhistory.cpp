@@ -0,0 +1,348 @@
+#include "coldhistory.h"
+#include <QMutexLocker>
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#ifdef Q_OS_LINUX
+#include <pthread.h>
+#endif
+
+constexpr int ColdHistory::BLOCK_BYTES;
+constexpr int ColdHistory::LRU_BYTES;
+
+std::atomic<quint64> ColdHistory::s_nextBlockId {0};
+
+namespace {
+
+// per row: createdAt, updatedAt, end offset and direction
+constexpr int COLUMN_BYTES = sizeof(qint64) * 2 + sizeof(qint32) + sizeof(quint8);
+
+// model rows are ints, the hot rows come on top
+constexpr qint64 MAX_ROWS = std::numeric_limits<int>::max() / 2;
+
+// zlib's fastest level, the data is mostly text and repeats a lot anyway
+constexpr int COMPRESSION_LEVEL = 1;
+
+template<typename T>
+T load(const char *_data)
+{
+    T value;
+    memcpy(&value, _data, sizeof(T));
+    return value;
+}
+
+} // namespace
+
+ColdHistory::ColdHistory()
+{
+}
+
+ColdHistory::~ColdHistory()
+{
+    stopCompressor();
+}
+
+qint64 ColdHistory::maxMemory() const
+{
+    return m_maxMemory;
+}
+
+void ColdHistory::setMaxMemory(qint64 _bytes)
+{
+    m_maxMemory = std::max<qint64>(_bytes, 0);
+}
+
+bool ColdHistory::isEnabled() const
+{
+    return m_maxMemory > 0;
+}
+
+int ColdHistory::count() const
+{
+    return int(m_rowCount);
+}
+
+qint64 ColdHistory::firstSerial() const
+{
+    return m_firstSerial;
+}
+
+void ColdHistory::clear()
+{
+    QMutexLocker locker(&m_mutex);
+    m_blocks.clear();
+    m_unpacked.clear();
+    m_builder = Builder {};
+    m_firstRow = 0;
+    m_rowCount = 0;
+    m_firstSerial = 0;
+    m_storedBytes = 0;
+}
+
+void ColdHistory::append(qint64 _serial, quint8 _direction, qint64 _createdAt, qint64 _updatedAt, const char *_data, int _length)
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_rowCount == 0) {
+        m_firstSerial = _serial;
+        m_builder.firstRow = m_firstRow;
+    }
+    Q_ASSERT(_serial == m_firstSerial + m_rowCount);
+
+    m_builder.createdAt.append(_createdAt);
+    m_builder.updatedAt.append(_updatedAt);
+    m_builder.direction.append(_direction);
+    m_builder.bytes.append(_data, _length);
+    m_builder.ends.append(m_builder.bytes.size());
+    m_rowCount++;
+
+    if (m_builder.bytes.size() + m_builder.ends.size() * COLUMN_BYTES >= BLOCK_BYTES)
+        seal();
+}
+
+int ColdHistory::excessRows() const
+{
+    if (!isEnabled())
+        return count();
+
+    QMutexLocker locker(&m_mutex);
+    auto used = blockMemory();
+    qint64 rows = 0;
+
+    // whole blocks, the one being filled stays
+    for (const auto &block : m_blocks) {
+        if (used <= m_maxMemory && m_rowCount - rows <= MAX_ROWS)
+            break;
+        used -= block.data.size();
+        rows += block.firstRow + block.rows - std::max(block.firstRow, m_firstRow);
+    }
+    return int(rows);
+}
+
+void ColdHistory::removeFirst(int _count)
+{
+    QMutexLocker locker(&m_mutex);
+    const auto count = std::min<qint64>(_count, m_rowCount);
+    if (count <= 0)
+        return;
+
+    m_firstRow += count;
+    m_rowCount -= count;
+    m_firstSerial += count;
+
+    while (!m_blocks.isEmpty() && m_blocks.first().firstRow + m_blocks.first().rows <= m_firstRow) {
+        m_storedBytes -= m_blocks.first().data.size();
+        m_unpacked.remove(m_blocks.first().id);
+        m_blocks.removeFirst();
+    }
+
+    if (m_rowCount == 0)
+        m_builder = Builder {m_firstRow, {}, {}, {}, {}, {}};
+}
+
+void ColdHistory::waitForCompressor()
+{
+    QMutexLocker locker(&m_mutex);
+    const auto pending = [this]() {
+        return std::any_of(m_blocks.cbegin(), m_blocks.cend(), [](const Block &_block) { return _block.pending; });
+    };
+    while (pending() && !m_stopping)
+        m_compressed.wait(&m_mutex);
+}
+
+void ColdHistory::swap(ColdHistory &_other)
+{
+    if (&_other == this)
+        return;
+
+    // only the GUI thread takes both locks, the compressors take their own
+    QMutexLocker locker(&m_mutex);
+    QMutexLocker otherLocker(&_other.m_mutex);
+    std::swap(m_blocks, _other.m_blocks);
+    std::swap(m_builder, _other.m_builder);
+    std::swap(m_firstRow, _other.m_firstRow);
+    std::swap(m_rowCount, _other.m_rowCount);
+    std::swap(m_firstSerial, _other.m_firstSerial);
+    std::swap(m_storedBytes, _other.m_storedBytes);
+    m_unpacked.clear();
+    _other.m_unpacked.clear();
+
+    // a block one compressor is working on is no longer found by it, the other one takes it
+    for (auto history : {this, &_other}) {
+        const auto pending = std::any_of(history->m_blocks.cbegin(), history->m_blocks.cend(),
+                                         [](const Block &_block) { return _block.pending; });
+        if (pending && !history->m_compressor.joinable())
+            history->m_compressor = std::thread([history](){ history->runCompressor(); });
+        history->m_pending.wakeOne();
+    }
+}
+
+ColdHistory::Row ColdHistory::row(int _row) const
+{
+    QMutexLocker locker(&m_mutex);
+    Q_ASSERT(_row >= 0 && _row < m_rowCount);
+    const auto absolute = m_firstRow + _row;
+
+    // the rows of the block being filled are read in place, from a copy of the bytes
+    if (absolute >= m_builder.firstRow) {
+        const auto index = int(absolute - m_builder.firstRow);
+        const auto start = index > 0 ? m_builder.ends.at(index - 1) : 0;
+        return Row {m_builder.bytes, m_builder.bytes.constData() + start, m_builder.ends.at(index) - start,
+                    m_builder.direction.at(index), m_builder.createdAt.at(index), m_builder.updatedAt.at(index)};
+    }
+
+    const auto block = std::upper_bound(m_blocks.cbegin(), m_blocks.cend(), absolute,
+                                        [](qint64 _absolute, const Block &_block) { return _absolute < _block.firstRow; }) - 1;
+    return unpackedRow(unpacked(*block), int(absolute - block->firstRow));
+}
+
+qint64 ColdHistory::memoryUsage() const
+{
+    QMutexLocker locker(&m_mutex);
+    return blockMemory() + m_unpacked.totalCost();
+}
+
+ColdHistory::Stats ColdHistory::stats() const
+{
+    QMutexLocker locker(&m_mutex);
+    Stats stats {};
+    stats.blocks = m_blocks.size();
+    for (const auto &block : m_blocks) {
+        if (block.pending) {
+            stats.pendingBlocks++;
+        } else {
+            stats.rawBytes += block.rawSize;
+            stats.compressedBytes += block.data.size();
+        }
+    }
+    stats.decompressions = m_decompressions;
+    return stats;
+}
+
+void ColdHistory::seal()
+{
+    if (m_builder.ends.isEmpty())
+        return;
+
+    const auto rows = m_builder.ends.size();
+    const auto packed = pack(m_builder);
+    m_blocks.append(Block {s_nextBlockId++, m_builder.firstRow, rows, packed.size(), packed, false, true});
+    m_storedBytes += packed.size();
+    m_builder = Builder {m_builder.firstRow + rows, {}, {}, {}, {}, {}};
+
+    if (!m_compressor.joinable())
+        m_compressor = std::thread([this](){ runCompressor(); });
+    m_pending.wakeOne();
+}
+
+QByteArray ColdHistory::unpacked(const Block &_block) const
+{
+    if (!_block.compressed)
+        return _block.data;
+
+    if (const auto cached = m_unpacked.object(_block.id))
+        return *cached;
+
+    const auto data = qUncompress(_block.data);
+    m_unpacked.insert(_block.id, new QByteArray(data), data.size());
+    m_decompressions++;
+    return data;
+}
+
+qint64 ColdHistory::blockMemory() const
+{
+    return m_storedBytes + m_builder.bytes.size() + qint64(m_builder.ends.size()) * COLUMN_BYTES;
+}
+
+void ColdHistory::runCompressor()
+{
+#ifdef Q_OS_LINUX
+    pthread_setname_np(pthread_self(), "cold-history");
+#endif
+
+    forever {
+        quint64 id {};
+        QByteArray raw {};
+        {
+            QMutexLocker locker(&m_mutex);
+            forever {
+                if (m_stopping)
+                    return;
+                const auto block = std::find_if(m_blocks.cbegin(), m_blocks.cend(), [](const Block &_block) { return _block.pending; });
+                if (block != m_blocks.cend()) {
+                    id = block->id;
+                    raw = block->data;
+                    break;
+                }
+                m_pending.wait(&m_mutex);
+            }
+        }
+
+        // the slow part, without the lock; readers use the raw block meanwhile
+        const auto compressed = qCompress(raw, COMPRESSION_LEVEL);
+
+        QMutexLocker locker(&m_mutex);
+        m_compressed.wakeAll();
+        const auto block = std::lower_bound(m_blocks.begin(), m_blocks.end(), id,
+                                            [](const Block &_block, quint64 _id) { return _block.id < _id; });
+        if (block == m_blocks.end() || block->id != id)
+            continue; // removed, cleared or swapped away meanwhile
+
+        // incompressible bytes stay as they are
+        block->pending = false;
+        if (compressed.size() < raw.size()) {
+            m_storedBytes += compressed.size() - block->data.size();
+            block->data = compressed;
+            block->compressed = true;
+        }
+    }
+}
+
+void ColdHistory::stopCompressor()
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_stopping = true;
+        m_pending.wakeAll();
+        m_compressed.wakeAll();
+    }
+    if (m_compressor.joinable())
+        m_compressor.join();
+}
+
+QByteArray ColdHistory::pack(const Builder &_builder)
+{
+    // [rows][createdAt...][updatedAt...][ends...][directions...][bytes]
+    const auto rows = _builder.ends.size();
+    QByteArray packed(int(sizeof(qint64)) + rows * COLUMN_BYTES + _builder.bytes.size(), Qt::Uninitialized);
+    auto out = packed.data();
+    const auto put = [&out](const void *_data, size_t _length) {
+        memcpy(out, _data, _length);
+        out += _length;
+    };
+
+    const qint64 count = rows;
+    put(&count, sizeof(count));
+    put(_builder.createdAt.constData(), rows * sizeof(qint64));
+    put(_builder.updatedAt.constData(), rows * sizeof(qint64));
+    put(_builder.ends.constData(), rows * sizeof(qint32));
+    put(_builder.direction.constData(), size_t(rows));
+    put(_builder.bytes.constData(), size_t(_builder.bytes.size()));
+    return packed;
+}
+
+ColdHistory::Row ColdHistory::unpackedRow(const QByteArray &_block, int _index)
+{
+    const auto data = _block.constData();
+    const auto rows = int(load<qint64>(data));
+    const auto createdAt = data + sizeof(qint64);
+    const auto updatedAt = createdAt + rows * sizeof(qint64);
+    const auto ends = updatedAt + rows * sizeof(qint64);
+    const auto directions = ends + rows * sizeof(qint32);
+    const auto bytes = directions + rows;
+
+    const auto start = _index > 0 ? load<qint32>(ends + (_index - 1) * sizeof(qint32)) : 0;
+    const auto end = load<qint32>(ends + _index * sizeof(qint32));
+    return Row {_block, bytes + start, end - start, quint8(directions[_index]),
+                load<qint64>(createdAt + _index * sizeof(qint64)), load<qint64>(updatedAt + _index * sizeof(qint64))};
+}
@@ -0,0 +1,119 @@
+#ifndef COLDHISTORY_H
+#define COLDHISTORY_H
+
+#include <QByteArray>
+#include <QCache>
+#include <QMutex>
+#include <QVector>
+#include <QWaitCondition>
+#include <atomic>
+#include <thread>
+
+// The rows evicted from the hot HistoryStore, oldest first, kept compressed.
+// Rows are packed into blocks of about BLOCK_BYTES, columns and bytes together;
+// a sealed block is compressed with qCompress on a background thread. Reading a
+// row decompresses its block on demand, the last decompressed blocks are kept
+// in an LRU. When the blocks exceed the memory budget the oldest ones go.
+//
+// Rows are only added and removed by one thread, the model's GUI thread under its
+// rows mutex; count() and firstSerial() are read there too. row() is thread-safe.
+// A worker can build a cold history of its own, the GUI thread swaps it in.
+class ColdHistory
+{
+public:
+    // a cold row, block keeps data alive
+    struct Row {
+        QByteArray block;
+        const char *data;
+        int length;
+        quint8 direction;
+        qint64 createdAt; // capture clock, ns
+        qint64 updatedAt;
+    };
+
+    struct Stats {
+        int blocks;
+        int pendingBlocks; // sealed, not compressed yet
+        qint64 rawBytes; // of the compressed blocks before compression
+        qint64 compressedBytes;
+        quint64 decompressions; // LRU misses since the history was created
+    };
+
+    ColdHistory();
+    ~ColdHistory();
+    ColdHistory(const ColdHistory &) = delete;
+    ColdHistory &operator=(const ColdHistory &) = delete;
+
+    // compressed bytes to keep, 0 disables the cold tier and drops its rows
+    qint64 maxMemory() const;
+    void setMaxMemory(qint64 _bytes);
+    bool isEnabled() const;
+
+    int count() const;
+    qint64 firstSerial() const; // of row 0, the serials of cold rows are consecutive
+    void clear();
+
+    // the next row after the newest one, with the serial it had in the hot store
+    void append(qint64 _serial, quint8 _direction, qint64 _createdAt, qint64 _updatedAt, const char *_data, int _length);
+    int excessRows() const; // the oldest rows, whole blocks, that are over the budget
+    void removeFirst(int _count);
+    void waitForCompressor(); // until every sealed block is compressed
+    void swap(ColdHistory &_other); // the rows, not the budget
+
+    Row row(int _row) const;
+
+    qint64 memoryUsage() const;
+    Stats stats() const;
+
+private:
+    struct Block {
+        quint64 id;
+        qint64 firstRow; // counted since clear()
+        int rows;
+        qint64 rawSize;
+        QByteArray data; // the packed rows, compressed once the worker got to it
+        bool compressed;
+        bool pending; // not seen by the worker yet
+    };
+
+    // the rows of the block being filled, packed when it is sealed
+    struct Builder {
+        qint64 firstRow;
+        QVector<qint64> createdAt;
+        QVector<qint64> updatedAt;
+        QVector<int> ends; // offset after each row in bytes
+        QVector<quint8> direction;
+        QByteArray bytes;
+    };
+
+    void seal(); // m_mutex held
+    QByteArray unpacked(const Block &_block) const; // m_mutex held
+    qint64 blockMemory() const; // m_mutex held
+    void runCompressor();
+    void stopCompressor();
+
+    static QByteArray pack(const Builder &_builder);
+    static Row unpackedRow(const QByteArray &_block, int _index);
+
+private:
+    static constexpr int BLOCK_BYTES = 64 * 1024; // bytes and columns before compression
+    static constexpr int LRU_BYTES = 16 * BLOCK_BYTES;
+
+    mutable QMutex m_mutex {};
+    QWaitCondition m_pending {}; // sealed blocks for the compressor
+    QWaitCondition m_compressed {}; // the compressor finished a block
+    QVector<Block> m_blocks {};
+    Builder m_builder {};
+    mutable QCache<quint64, QByteArray> m_unpacked {LRU_BYTES};
+    mutable quint64 m_decompressions {};
+    static std::atomic<quint64> s_nextBlockId; // unique across histories, blocks move with swap()
+    qint64 m_firstRow {}; // of row 0, counted since clear()
+    qint64 m_rowCount {};
+    qint64 m_firstSerial {};
+    qint64 m_maxMemory {};
+    qint64 m_storedBytes {}; // of the sealed blocks
+    std::thread m_compressor {};
+    bool m_stopping {}; // guarded by m_mutex
+};
+
+#endif // COLDHISTORY_H
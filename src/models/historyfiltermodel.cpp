@@ -0,0 +1,178 @@
+#include "historyfiltermodel.h"
+#include <algorithm>
+
+HistoryFilterModel::HistoryFilterModel(HistoryModel &_history, HistorySearch &_search, QObject *parent)
+    : QAbstractProxyModel(parent)
+    , m_history(_history)
+{
+    setSourceModel(&m_history);
+
+    connect(&_search, &HistorySearch::restarted, this, &HistoryFilterModel::clearMatches);
+    connect(&_search, &HistorySearch::matchesFound, this, &HistoryFilterModel::addMatches);
+
+    // serials start over on a reset, the search reports everything again
+    connect(&m_history, &HistoryModel::modelAboutToBeReset, this, [&](){
+        beginResetModel();
+        m_serials.clear();
+    });
+    connect(&m_history, &HistoryModel::modelReset, this, [&](){
+        endResetModel();
+    });
+    connect(&m_history, &HistoryModel::rowsAboutToBeRemoved, this, &HistoryFilterModel::onSourceRowsAboutToBeRemoved);
+    connect(&m_history, &HistoryModel::dataChanged, this, &HistoryFilterModel::onSourceDataChanged);
+}
+
+QModelIndex HistoryFilterModel::mapToSource(const QModelIndex &proxyIndex) const
+{
+    if (!proxyIndex.isValid() || proxyIndex.row() >= m_serials.length())
+        return QModelIndex();
+
+    const auto row = m_history.rowOfSerial(m_serials.at(proxyIndex.row()));
+    if (row < 0)
+        return QModelIndex();
+    return m_history.index(row, proxyIndex.column());
+}
+
+QModelIndex HistoryFilterModel::mapFromSource(const QModelIndex &sourceIndex) const
+{
+    if (!sourceIndex.isValid())
+        return QModelIndex();
+
+    const auto row = proxyRow(m_history.rowSerial(sourceIndex.row()));
+    if (row < 0)
+        return QModelIndex();
+    return index(row, sourceIndex.column());
+}
+
+QModelIndex HistoryFilterModel::index(int row, int column, const QModelIndex &parent) const
+{
+    if (parent.isValid() || row < 0 || row >= rowCount() || column < 0 || column >= columnCount())
+        return QModelIndex();
+    return createIndex(row, column);
+}
+
+QModelIndex HistoryFilterModel::parent(const QModelIndex &child) const
+{
+    Q_UNUSED(child)
+    return QModelIndex();
+}
+
+int HistoryFilterModel::rowCount(const QModelIndex &parent) const
+{
+    if (parent.isValid())
+        return 0;
+    return m_serials.length();
+}
+
+int HistoryFilterModel::columnCount(const QModelIndex &parent) const
+{
+    if (parent.isValid())
+        return 0;
+    return m_history.columnCount();
+}
+
+int HistoryFilterModel::matchCount() const
+{
+    return m_serials.length();
+}
+
+int HistoryFilterModel::nextMatch(int _sourceRow) const
+{
+    const auto serial = _sourceRow >= 0 ? m_history.rowSerial(_sourceRow) : -1;
+    const auto it = std::upper_bound(m_serials.cbegin(), m_serials.cend(), serial);
+    if (it == m_serials.cend())
+        return -1;
+    return m_history.rowOfSerial(*it);
+}
+
+int HistoryFilterModel::previousMatch(int _sourceRow) const
+{
+    const auto count = m_history.rowCount();
+    if (count == 0)
+        return -1;
+
+    // -1 searches back from the end
+    const auto serial = _sourceRow >= 0 && _sourceRow < count ? m_history.rowSerial(_sourceRow) : m_history.rowSerial(count - 1) + 1;
+    const auto it = std::lower_bound(m_serials.cbegin(), m_serials.cend(), serial);
+    if (it == m_serials.cbegin())
+        return -1;
+    return m_history.rowOfSerial(*(it - 1));
+}
+
+void HistoryFilterModel::addMatches(const QVector<qint64> &_serials)
+{
+    // matches of the rows searched last go to the end in one insertion,
+    // a match reaching back into rows searched before is inserted on its own
+    QVector<qint64> appended {};
+    for (const auto serial : _serials) {
+        if (m_history.rowOfSerial(serial) < 0)
+            continue; // evicted meanwhile
+
+        if (m_serials.isEmpty() || serial > m_serials.last()) {
+            appended.append(serial);
+            continue;
+        }
+
+        const auto it = std::lower_bound(m_serials.begin(), m_serials.end(), serial);
+        if (*it == serial)
+            continue;
+
+        const auto row = int(it - m_serials.begin());
+        beginInsertRows(QModelIndex(), row, row);
+        m_serials.insert(row, serial);
+        endInsertRows();
+    }
+
+    if (!appended.isEmpty()) {
+        beginInsertRows(QModelIndex(), m_serials.length(), m_serials.length() + appended.length() - 1);
+        m_serials.append(appended);
+        endInsertRows();
+    }
+}
+
+void HistoryFilterModel::clearMatches()
+{
+    if (m_serials.isEmpty())
+        return;
+
+    beginResetModel();
+    m_serials.clear();
+    endResetModel();
+}
+
+void HistoryFilterModel::onSourceRowsAboutToBeRemoved(const QModelIndex &_parent, int _first, int _last)
+{
+    if (_parent.isValid())
+        return;
+
+    const auto from = std::lower_bound(m_serials.cbegin(), m_serials.cend(), m_history.rowSerial(_first));
+    const auto to = std::upper_bound(from, m_serials.cend(), m_history.rowSerial(_last));
+    if (from == to)
+        return;
+
+    const auto first = int(from - m_serials.cbegin());
+    const auto count = int(to - from);
+    beginRemoveRows(QModelIndex(), first, first + count - 1);
+    m_serials.remove(first, count);
+    endRemoveRows();
+}
+
+void HistoryFilterModel::onSourceDataChanged(const QModelIndex &_topLeft, const QModelIndex &_bottomRight, const QVector<int> &_roles)
+{
+    const auto from = std::lower_bound(m_serials.cbegin(), m_serials.cend(), m_history.rowSerial(_topLeft.row()));
+    const auto to = std::upper_bound(from, m_serials.cend(), m_history.rowSerial(_bottomRight.row()));
+    if (from == to)
+        return;
+
+    const auto first = int(from - m_serials.cbegin());
+    const auto last = int(to - m_serials.cbegin()) - 1;
+    emit dataChanged(index(first, _topLeft.column()), index(last, _bottomRight.column()), _roles);
+}
+
+int HistoryFilterModel::proxyRow(qint64 _serial) const
+{
+    const auto it = std::lower_bound(m_serials.cbegin(), m_serials.cend(), _serial);
+    if (it == m_serials.cend() || *it != _serial)
+        return -1;
+    return int(it - m_serials.cbegin());
+}
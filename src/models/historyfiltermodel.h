@@ -0,0 +1,46 @@
+#ifndef HISTORYFILTERMODEL_H
+#define HISTORYFILTERMODEL_H
+
+#include <QAbstractProxyModel>
+#include <QVector>
+
+#include "historymodel.h"
+#include "historysearch.h"
+
+// Shows only the history rows a HistorySearch matched.
+// Works like a QSortFilterProxyModel that is told which rows to accept, instead of
+// asking for every row: matches arrive in batches and are merged into a sorted list
+// of serials, evicted rows drop off the front.
+class HistoryFilterModel : public QAbstractProxyModel
+{
+    Q_OBJECT
+public:
+    HistoryFilterModel(HistoryModel &_history, HistorySearch &_search, QObject *parent = nullptr);
+
+    QModelIndex mapToSource(const QModelIndex &proxyIndex) const override;
+    QModelIndex mapFromSource(const QModelIndex &sourceIndex) const override;
+    QModelIndex index(int row, int column, const QModelIndex &parent = QModelIndex()) const override;
+    QModelIndex parent(const QModelIndex &child) const override;
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+
+    int matchCount() const;
+    // history rows of the closest match after/before _sourceRow, -1 if there is none
+    int nextMatch(int _sourceRow) const;
+    int previousMatch(int _sourceRow) const;
+
+private slots:
+    void addMatches(const QVector<qint64> &_serials);
+    void clearMatches();
+    void onSourceRowsAboutToBeRemoved(const QModelIndex &_parent, int _first, int _last);
+    void onSourceDataChanged(const QModelIndex &_topLeft, const QModelIndex &_bottomRight, const QVector<int> &_roles);
+
+private:
+    int proxyRow(qint64 _serial) const; // -1 if not matched
+
+private:
+    HistoryModel &m_history;
+    QVector<qint64> m_serials {}; // matched rows, sorted
+};
+
+#endif // HISTORYFILTERMODEL_H
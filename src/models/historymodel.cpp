@@ -1,25 +1,32 @@
 #include "historymodel.h"
 #include <QDebug>
-#include <QTextStream>
 #include <QColor>
+#include <QFileInfo>
+#include <QThread>
+#include <QTimer>
+#include <QtConcurrent>
 #include <cmath>
+#include <cstring>
 #include <algorithm>
 
 #include "utils/commonconfig.h"
+#include "utils/hexformat.h"
+#include "utils/captureclock.h"
 
-// not thread-safe
-char * char2hex (char c) {
-    static char buffer[3];
-    const char * const hex = "0123456789ABCDEF";
-    memset(buffer, 0, sizeof(buffer));
-    buffer[0] = hex[c >> 4];
-    buffer[1] = hex[c & 0x0F];
-    return buffer;
-}
+constexpr int HistoryModel::MAX_CHANNELS;
 
 HistoryModel::HistoryModel(QObject *parent)
     : QAbstractTableModel(parent)
 {
+    connect(&m_resegmentWatcher, &QFutureWatcherBase::finished, this, &HistoryModel::finishResegmenting);
+}
+
+HistoryModel::~HistoryModel()
+{
+    m_resegmentWatcher.waitForFinished();
+    Resegmented result {};
+    if (takeResegmented(&result))
+        delete result.cold;
 }
 
 QVariant HistoryModel::headerData(int section, Qt::Orientation orientation, int role) const
@@ -41,7 +48,7 @@ QVariant HistoryModel::headerData(int section, Qt::Orientation orientation, int
 
     if (role == Qt::DisplayRole && orientation == Qt::Vertical) {
         if (section >= 0 && section < rowCount())
-            return m_items.at(section).index;
+            return rowSerial(section);
         else
             return 0;
     }
@@ -54,7 +61,7 @@ int HistoryModel::rowCount(const QModelIndex &parent) const
     if (parent.isValid())
         return 0;
 
-    return m_items.count();
+    return m_capture.isOpen() ? m_capture.count() : m_cold.count() + m_store.count();
 }
 
 int HistoryModel::columnCount(const QModelIndex &parent) const
@@ -74,51 +81,51 @@ QVariant HistoryModel::data(const QModelIndex &index, int role) const
         return QVariant();
 
     if (role == Qt::DisplayRole) {
-        const auto &item = m_items.at(index.row());
+        const auto row = index.row();
 
         switch (index.column()) {
         case toColumn(TimestampRole):
-            return item.createdDatetime.toString(TIME_FORMAT);
+            return QDateTime::fromMSecsSinceEpoch(rowCreatedAt(row) / 1000000).toString(TIME_FORMAT);
         case toColumn(DirectionRole):
-            return toString(item.direction);
+            return toString(rowDirection(row));
         case toColumn(HexRole):
-            return formattedHexString(item.data);
+            return renderedCell(row, HexRole);
         case toColumn(StringRole):
-            return formattedString(item.data);
+            return renderedCell(row, StringRole);
         default:
             break;
         }
     }
 
-    if (role == Qt::ForegroundRole) {
-        switch (index.column()) {
-        case toColumn(TimestampRole):
-        case toColumn(HexRole):
-        case toColumn(DirectionRole):
-            return QColor(Qt::gray);
-        default:
-            return QColor(Qt::black);
-        }
-    }
+    if (role == Qt::ForegroundRole)
+        return foregroundColor(index.column());
 
     return QVariant();
 }
 
 bool HistoryModel::removeRows(int row, int count, const QModelIndex &parent)
 {
-    if (rowCount() == 0)
+    if (rowCount() == 0 || count <= 0)
         return false;
 
     if (row < 0 || row >= rowCount())
         return false;
 
+    // rows live in a ring, only the oldest ones can be evicted
+    if (row != 0 || m_capture.isOpen())
+        return false;
+
     if (row + count >= rowCount()) {
         count = rowCount() - row;
     }
 
     beginRemoveRows(parent, row, row + count - 1);
-    for (int i = 0; i < count && !m_items.empty(); ++i) {
-        m_items.removeFirst();
+    {
+        // the cold rows are the oldest ones
+        QMutexLocker locker(&m_rowsMutex);
+        const auto cold = std::min(count, m_cold.count());
+        m_cold.removeFirst(cold);
+        m_store.removeFirst(count - cold);
     }
     endRemoveRows();
 
@@ -128,8 +135,17 @@ bool HistoryModel::removeRows(int row, int count, const QModelIndex &parent)
 void HistoryModel::clear()
 {
     beginResetModel();
-    m_totalLines = 0;
-    m_items.clear();
+    {
+        QMutexLocker locker(&m_rowsMutex);
+        m_capture.close();
+        m_store.clear();
+        m_cold.clear();
+    }
+    m_log.clear();
+    m_resegmentGeneration++; // a running re-segmentation is void
+    m_coldPin = ColdHistory::Row {};
+    m_coldPinSerial = -1;
+    m_renderCache.clear(); // serials start over
     endResetModel();
 }
 
@@ -138,165 +154,759 @@ void HistoryModel::setHistoryCapacity(int _cap)
     if (_cap == m_historyCapacity)
         return;
     // shrinking
-    if (_cap < m_historyCapacity) {
-        if (rowCount() > _cap) {
-            removeRows(0, _cap - rowCount());
-        }
+    if (!m_capture.isOpen() && m_store.count() > _cap) {
+        evictRows(m_store.count() - _cap);
     }
     m_historyCapacity = _cap;
+
+    QMutexLocker locker(&m_rowsMutex);
+    m_store.setCapacity(_cap);
 }
 
 void HistoryModel::addItem(DataDirection _dir, const QByteArray &_data)
 {
-    if (rowCount() + 1 > historyCapacity())
-        removeRow(0);
-
-    beginInsertRows(QModelIndex(), rowCount(), rowCount());
-    m_items.append(LogData {m_totalLines, _dir, now(), now(), _data});
-    m_totalLines += 1;
-    endInsertRows();
+    addItems(_dir, QList<QByteArray> {_data});
 }
 
 void HistoryModel::addItems(DataDirection _dir, const QList<QByteArray> &_data)
 {
-    const auto length = _data.length();
-    if (length == 0)
-        return;
+    closeCapture();
+    const auto timestamp = now();
+    for (const auto &data : _data) {
+        // logged as frames, they stay rows of their own when re-segmented
+        m_log.append(_dir, data.constData(), data.length(), timestamp, 0, FrameStarted, false);
+        m_segmenter.addRow(_dir, data.constData(), data.length(), timestamp);
+    }
+    commitStaged();
+}
 
-    if (rowCount() + length > historyCapacity())
-        removeRows(0, rowCount() + length - historyCapacity());
+void HistoryModel::appendData(DataDirection _dir, const QByteArray &_data)
+{
+    closeCapture();
+    const auto start = now();
+    const Chunk chunk {_dir, _data.constData(), _data.length(), start, 0, Unframed, false};
+    m_log.append(chunk.direction, chunk.data, chunk.length, chunk.timestamp, chunk.byteTime, chunk.framing, chunk.gap);
+    m_segmenter.setTail(storeTail());
+    stageChunk(chunk);
+    commitStaged();
+    m_appendTimes.record(now() - start);
+}
 
-    beginInsertRows(QModelIndex(), rowCount(), rowCount() + length - 1);
-    for (int i = 0; i < length; ++i) {
-        m_items.append(LogData {m_totalLines, _dir, now(), now(), _data[i]});
-        m_totalLines += 1;
+void HistoryModel::appendChunks(const QVector<Chunk> &_chunks)
+{
+    closeCapture();
+    const auto start = now();
+    m_segmenter.setTail(storeTail());
+    for (const auto &chunk : _chunks) {
+        m_log.append(chunk.direction, chunk.data, chunk.length, chunk.timestamp, chunk.byteTime, chunk.framing, chunk.gap);
+        stageChunk(chunk);
     }
-    endInsertRows();
+    commitStaged();
+    m_appendTimes.record(now() - start);
 }
 
-void HistoryModel::appendData(DataDirection _dir, const QByteArray &_data)
+void HistoryModel::stageChunk(const Chunk &_chunk)
 {
-    if (_data.length() == 0)
+    // bytes that were never next to each other on the wire don't share a row
+    if (_chunk.gap)
+        m_segmenter.setEndedAtNewline(true);
+    if (_chunk.framing == Unframed)
+        m_segmenter.addData(segmenterSettings(), _chunk.direction, _chunk.data, _chunk.length, _chunk.timestamp, _chunk.byteTime);
+    else
+        m_segmenter.addFrame(_chunk.direction, _chunk.data, _chunk.length, _chunk.timestamp, _chunk.byteTime, _chunk.framing);
+}
+
+void HistoryModel::Segmenter::setTail(const Tail &_tail)
+{
+    m_tail = _tail;
+}
+
+bool HistoryModel::Segmenter::endedAtNewline() const
+{
+    return m_endedAtNewline;
+}
+
+void HistoryModel::Segmenter::setEndedAtNewline(bool _endedAtNewline)
+{
+    m_endedAtNewline = _endedAtNewline;
+}
+
+void HistoryModel::Segmenter::addData(const Settings &_settings, DataDirection _dir, const char *_data, int _length,
+                                      qint64 _timestamp, qint64 _byteTime)
+{
+    if (_length == 0)
         return;
 
-    const auto chunkLength = newlineAfterCount();
+    // _timestamp dates the last byte, the others are _byteTime apart
+    const auto lastIndex = _length - 1;
+    const auto byteTimestamp = [&](int _index) {
+        return _timestamp - (lastIndex - _index) * _byteTime;
+    };
+
+    const auto chunkLength = _settings.count;
     bool needNewline = false;
 
     if (m_endedAtNewline)
         needNewline = true;
     m_endedAtNewline = false;
 
-    if (rowCount() == 0)
+    if (!hasTail())
         needNewline = true;
 
-    if (rowCount() > 0) {
-        auto &lastItem = m_items[rowCount() - 1];
-        if (lastItem.direction != _dir) {
+    if (hasTail()) {
+        if (tailDirection() != _dir) {
             needNewline = true;
         }
 
-        const auto timeDiff = now().toMSecsSinceEpoch() - lastItem.lastAppendDateTime.toMSecsSinceEpoch();
-        if (newlineAfterDurationEnabled() && timeDiff > newlineAfterDuration()) {
+        const auto timeDiff = byteTimestamp(0) - tailUpdatedAt();
+        if (_settings.durationEnabled && timeDiff > _settings.duration) {
             needNewline = true;
         }
     }
 
+    m_segments.clear();
+    bool concatenateFirstChunk = false;
+
     if (needNewline) {
         // add new rows
-        addItems(_dir, splitData(_data, newLineAfterCountEnabled(), chunkLength, chunkLength));
+        segmentData(_data, _length, _settings.countEnabled, chunkLength, chunkLength, &m_segments);
     } else {
-        auto &lastItem = m_items[rowCount() - 1]; // rowCount() always > 0 here
+        const auto lastLength = tailLength(); // there is always a tail here
 
         // if new data doesn't fit to the previous row,
         // split it, then append the begining to previous row, and the rest to new rows
-        if (newLineAfterCountEnabled()) {
+        if (_settings.countEnabled) {
 
-            int firstChunkLength = newlineAfterCount();
-            bool concatenateFirstChunk = false;
+            int firstChunkLength = chunkLength;
 
-            if (lastItem.data.length() < chunkLength) {
+            if (lastLength < chunkLength) {
                 concatenateFirstChunk = true;
-                firstChunkLength = chunkLength - lastItem.data.length();
+                firstChunkLength = chunkLength - lastLength;
             }
 
-            auto newItems = splitData(_data, true, chunkLength, firstChunkLength);
-            if (concatenateFirstChunk) {
-                lastItem.data.append(newItems.first());
-                emit dataChanged(index(rowCount() - 1, toColumn(StringRole)), index(rowCount() - 1, toColumn(HexRole)));
-                newItems.pop_front();
-            }
-
-            addItems(_dir, newItems);
+            segmentData(_data, _length, true, chunkLength, firstChunkLength, &m_segments);
         } else {
             // new data fits to the last row, just append it
-            lastItem.data.append(_data);
-            lastItem.lastAppendDateTime = now();
-            emit dataChanged(index(rowCount() - 1, toColumn(StringRole)), index(rowCount() - 1, toColumn(HexRole)));
+            m_segments.append(Segment {0, _length});
+            concatenateFirstChunk = true;
         }
     }
 
-    if (_data.endsWith("\n")) {
+    // date every piece by the bytes it holds
+    for (int i = 0; i < m_segments.size(); ++i) {
+        const auto &segment = m_segments.at(i);
+        const auto first = byteTimestamp(std::min(segment.offset, lastIndex));
+        const auto last = byteTimestamp(std::min(segment.offset + std::max(0, segment.length - 1), lastIndex));
+
+        if (i == 0 && concatenateFirstChunk) {
+            appendToTail(_data + segment.offset, segment.length, last);
+        } else {
+            m_rows.append(Row {_dir, first, last, m_pieces.size(), 1, segment.length});
+            m_pieces.append(Piece {_data + segment.offset, segment.length});
+        }
+    }
+
+    if (_data[lastIndex] == '\n') {
         m_endedAtNewline = true;
     }
 }
 
-QString HistoryModel::formattedHexString(const QByteArray &_data) const
+void HistoryModel::Segmenter::addFrame(DataDirection _dir, const char *_data, int _length, qint64 _timestamp, qint64 _byteTime,
+                                       Framing _framing)
 {
-    constexpr auto DISPLAY_CHARACTER_EACH_BYTE = 3; // 2 chars for HEX + 1 space
-    auto ret = _data.toHex(' ').toUpper(); // TODO: toHex fails if Unicode?
+    if (_length == 0)
+        return;
 
-    QList<QByteArray> lines {};
+    // a frame is a row however long it is and whatever it holds
+    const auto newRow = _framing == FrameStarted || m_endedAtNewline || !hasTail() || tailDirection() != _dir;
+    m_endedAtNewline = false;
 
-    const auto lineLen = newlineAfterCount() * DISPLAY_CHARACTER_EACH_BYTE;
-    lines = splitData(ret, newLineAfterCountEnabled(), lineLen, lineLen);
+    if (newRow) {
+        const auto first = _timestamp - (_length - 1) * _byteTime;
+        m_rows.append(Row {_dir, first, _timestamp, m_pieces.size(), 1, _length});
+        m_pieces.append(Piece {_data, _length});
+    } else {
+        appendToTail(_data, _length, _timestamp);
+    }
+}
 
-    const auto maxLen = newlineAfterCount() * DISPLAY_CHARACTER_EACH_BYTE + ((newlineAfterCount() - 1) / 8);
-    for (auto &l : lines) {
-        l.append(' ');
+void HistoryModel::Segmenter::addRow(DataDirection _dir, const char *_data, int _length, qint64 _timestamp)
+{
+    // as addFrame() leaves it, the log replays the row as a started frame
+    m_endedAtNewline = false;
+    m_rows.append(Row {_dir, _timestamp, _timestamp, m_pieces.size(), 1, _length});
+    m_pieces.append(Piece {_data, _length});
+}
 
-        auto len = l.length() / DISPLAY_CHARACTER_EACH_BYTE;
+HistoryModel::Segmenter::Row &HistoryModel::Segmenter::appended()
+{
+    return m_appended;
+}
 
-        for (int i = len - 1; i >= 8; i = int((i - 1) / 8) * 8) {
-            if ((i) % 8 == 0) {
-                l.insert((i)* DISPLAY_CHARACTER_EACH_BYTE, " ");
-            }
+QVector<HistoryModel::Segmenter::Row> &HistoryModel::Segmenter::rows()
+{
+    return m_rows;
+}
+
+const QVector<HistoryModel::Segmenter::Row> &HistoryModel::Segmenter::rows() const
+{
+    return m_rows;
+}
+
+const QVector<HistoryModel::Segmenter::Piece> &HistoryModel::Segmenter::pieces() const
+{
+    return m_pieces;
+}
+
+void HistoryModel::Segmenter::clear()
+{
+    m_appended = Row {};
+    m_rows.clear();
+    m_pieces.clear();
+}
+
+bool HistoryModel::Segmenter::hasTail() const
+{
+    return !m_rows.isEmpty() || m_tail.exists;
+}
+
+HistoryModel::DataDirection HistoryModel::Segmenter::tailDirection() const
+{
+    if (!m_rows.isEmpty())
+        return m_rows.last().direction;
+    return m_tail.direction;
+}
+
+int HistoryModel::Segmenter::tailLength() const
+{
+    if (!m_rows.isEmpty())
+        return m_rows.last().length;
+    return m_tail.length + m_appended.length;
+}
+
+qint64 HistoryModel::Segmenter::tailUpdatedAt() const
+{
+    if (!m_rows.isEmpty())
+        return m_rows.last().updatedAt;
+    return m_appended.length == 0 ? m_tail.updatedAt : m_appended.updatedAt;
+}
+
+void HistoryModel::Segmenter::appendToTail(const char *_data, int _length, qint64 _timestamp)
+{
+    // only the last row takes pieces, so the pieces of every row stay consecutive
+    auto &row = m_rows.isEmpty() ? m_appended : m_rows.last();
+    if (row.pieceCount == 0)
+        row.firstPiece = m_pieces.size();
+    m_pieces.append(Piece {_data, _length});
+    row.pieceCount++;
+    row.length += _length;
+    row.updatedAt = _timestamp;
+}
+
+void HistoryModel::commitStaged()
+{
+    auto &appended = m_segmenter.appended();
+    auto &rows = m_segmenter.rows();
+    const auto &pieces = m_segmenter.pieces();
+
+    // a row that would outgrow the largest arena continues on a new row; one that
+    // only crosses the end of the arena is moved by the store instead
+    if (appended.length > 0 && !m_store.canExtendLast(appended.length)) {
+        auto row = appended;
+        row.direction = DataDirection(m_store.direction(m_store.count() - 1));
+        row.createdAt = row.updatedAt;
+        rows.prepend(row);
+        appended = Segmenter::Row {};
+    }
+
+    // a batch larger than the history replaces everything, keep its newest rows
+    if (rows.size() >= historyCapacity()) {
+        rows.remove(0, rows.size() - historyCapacity());
+        appended = Segmenter::Row {};
+    }
+
+    const auto newRows = rows.size();
+    m_stagedLengths.resize(newRows);
+    for (int i = 0; i < newRows; ++i)
+        m_stagedLengths[i] = rows.at(i).length;
+
+    // one removal, one update of the last row and one insertion per commit
+    auto evict = std::max(0, m_store.count() + newRows - historyCapacity());
+    {
+        QMutexLocker locker(&m_rowsMutex);
+        evict = std::max(evict, m_store.reserve(m_stagedLengths.constData(), newRows, appended.length));
+    }
+    if (evict >= m_store.count())
+        appended = Segmenter::Row {}; // the row it belongs to goes away
+    evictRows(evict);
+
+    // the only copy of the received bytes, straight into the store
+    const auto gather = [&pieces](char *_destination, const Segmenter::Row &_row) {
+        for (int i = _row.firstPiece; i < _row.firstPiece + _row.pieceCount; ++i) {
+            const auto &piece = pieces.at(i);
+            if (piece.length > 0)
+                memcpy(_destination, piece.data, size_t(piece.length));
+            _destination += piece.length;
         }
+    };
 
-        len = l.length();
-        // right padding
-        if (len < maxLen) {
-            const auto spaces {maxLen - len};
-            l.append(QByteArray((spaces), ' '));
+    if (appended.length > 0) {
+        {
+            QMutexLocker locker(&m_rowsMutex);
+            gather(m_store.extendLast(appended.updatedAt, appended.length), appended);
         }
 
+        const auto lastRow = rowCount() - 1;
+        invalidateRenderedRow(lastRow);
+        emit dataChanged(index(lastRow, toColumn(HexRole)), index(lastRow, toColumn(StringRole)));
     }
 
-    return lines.join("\n");
+    if (newRows > 0) {
+        beginInsertRows(QModelIndex(), rowCount(), rowCount() + newRows - 1);
+        {
+            QMutexLocker locker(&m_rowsMutex);
+            for (const auto &row : qAsConst(rows))
+                gather(m_store.append(row.direction, row.createdAt, row.updatedAt, row.length), row);
+        }
+        endInsertRows();
+    }
+
+    // keeps the capacity, staging the next batch allocates nothing
+    m_segmenter.clear();
 }
 
-QString HistoryModel::formattedString(const QByteArray &_data) const
+HistoryModel::Segmenter::Tail HistoryModel::storeTail() const
 {
-    QString ret;
-    QTextStream stream(&ret);
-    int lines = 1;
+    const auto last = m_store.count() - 1;
+    if (last < 0)
+        return Segmenter::Tail {};
+    return Segmenter::Tail {true, DataDirection(m_store.direction(last)), m_store.length(last), m_store.updatedAt(last)};
+}
 
-    for (int i = 0; i < _data.count(); ++i) {
-        const auto c = _data.at(i);
-        // is c printable?
-        if (c >= 32 && c < 127) {
-            stream << c;
-        } else {
-            stream << '.';
+HistoryModel::Segmenter::Settings HistoryModel::segmenterSettings() const
+{
+    return Segmenter::Settings {newLineAfterCountEnabled(), newlineAfterCount(),
+                                newlineAfterDurationEnabled(), qint64(newlineAfterDuration()) * 1000000};
+}
+
+void HistoryModel::scheduleResegmenting()
+{
+    if (!m_log.isEnabled())
+        return;
+
+    // settings usually change several at a time, one pass for all of them
+    m_resegmentGeneration++;
+    if (m_resegmentPending)
+        return;
+    m_resegmentPending = true;
+    QTimer::singleShot(0, this, &HistoryModel::startResegmenting);
+}
+
+void HistoryModel::startResegmenting()
+{
+    // a running one is out of date, finishResegmenting() starts again; closeCapture() does
+    if (!m_resegmentPending || m_resegmentWatcher.isRunning() || m_capture.isOpen())
+        return;
+
+    // a result finishResegmenting() has not seen yet is dropped with the watcher's signal
+    Resegmented stale {};
+    if (takeResegmented(&stale))
+        delete stale.cold;
+
+    m_resegmentPending = false;
+    m_resegmentUnread = true;
+    m_resegmentWatcher.setFuture(QtConcurrent::run(&HistoryModel::resegmented, m_log.snapshot(), segmenterSettings(),
+                                                   historyCapacity(), coldHistoryBudget(), m_resegmentGeneration));
+}
+
+void HistoryModel::finishResegmenting()
+{
+    if (m_resegmentPending) {
+        startResegmenting();
+        return;
+    }
+
+    Resegmented result {};
+    if (!takeResegmented(&result))
+        return;
+    if (result.generation != m_resegmentGeneration) {
+        delete result.cold;
+        return; // cleared meanwhile
+    }
+    if (result.store.capacity() != historyCapacity() || result.cold->maxMemory() != coldHistoryBudget()) {
+        delete result.cold;
+        scheduleResegmenting();
+        return;
+    }
+    if (m_capture.isOpen()) {
+        delete result.cold;
+        m_resegmentPending = true; // again once the history shows
+        return;
+    }
+
+    // the cold blocks were built and compressed on the worker, only swapped in here
+    beginResetModel();
+    {
+        QMutexLocker locker(&m_rowsMutex);
+        m_store = result.store;
+        m_cold.swap(*result.cold);
+    }
+    delete result.cold; // the old rows, outside the lock
+    m_segmenter.clear();
+    m_segmenter.setEndedAtNewline(result.endedAtNewline);
+    m_coldPin = ColdHistory::Row {};
+    m_coldPinSerial = -1;
+    m_renderCache.clear(); // serials start over
+    endResetModel();
+
+    // the chunks received meanwhile are already in the log
+    const auto snapshot = m_log.snapshot();
+    m_segmenter.setTail(storeTail());
+    snapshot.visit(result.endEntry, snapshot.endEntry(), [this](const ChunkLog::Entry &_entry, const char *_data) {
+        stageChunk(Chunk {DataDirection(_entry.direction), _data, _entry.length, _entry.timestamp, _entry.byteTime,
+                          Framing(_entry.framing), _entry.gap});
+        return true;
+    });
+    commitStaged();
+
+    emit resegmented(result.rows.size(), result.nsecs);
+}
+
+bool HistoryModel::takeResegmented(Resegmented *_result)
+{
+    if (!m_resegmentUnread || m_resegmentWatcher.isRunning() || m_resegmentWatcher.future().resultCount() == 0)
+        return false;
+
+    m_resegmentUnread = false;
+    *_result = m_resegmentWatcher.result();
+    return true;
+}
+
+HistoryModel::Resegmented HistoryModel::resegmented(const ChunkLog::Snapshot &_snapshot, const Segmenter::Settings &_settings,
+                                                    int _capacity, qint64 _coldBudget, quint32 _generation)
+{
+    const auto start = now();
+    const auto first = _snapshot.firstEntry();
+    const auto end = _snapshot.endEntry();
+
+    // split where a row starts whatever came before, so the parts are independent
+    static constexpr qint64 MIN_PART_ENTRIES = 4096;
+    const auto partCount = std::max<qint64>(1, std::min<qint64>(QThread::idealThreadCount() * 4, (end - first) / MIN_PART_ENTRIES));
+    QVector<LogPart> parts {};
+    auto from = first;
+    for (qint64 i = 1; i < partCount && from < end; ++i) {
+        const auto target = std::max(from + 1, first + (end - first) * i / partCount);
+        const ChunkLog::Entry *previous = nullptr;
+        const char *previousData = nullptr;
+        const auto boundary = _snapshot.visit(target - 1, end, [&](const ChunkLog::Entry &_entry, const char *_data) {
+            if (previous && startsRow(_settings, *previous, previousData, _entry))
+                return false;
+            previous = &_entry;
+            previousData = _data;
+            return true;
+        });
+        if (boundary >= end)
+            break;
+        parts.append(LogPart {&_snapshot, _settings, from, boundary});
+        from = boundary;
+    }
+    parts.append(LogPart {&_snapshot, _settings, from, end});
+
+    const auto segmented = QtConcurrent::blockingMapped(parts, &HistoryModel::segmentPart);
+
+    Resegmented result {_generation, _snapshot, end, {}, {}, 0, HistoryStore(_capacity), new ColdHistory(), true, 0};
+    for (const auto &part : segmented) {
+        const auto pieceBase = result.pieces.size();
+        for (auto row : part.rows()) {
+            row.firstPiece += pieceBase;
+            result.rows.append(row);
         }
+        result.pieces += part.pieces();
+        result.endedAtNewline = part.endedAtNewline();
+    }
 
-        if (newLineAfterCountEnabled() && newlineAfterCount() > 0) {
-            if (i + 1 == lines * newlineAfterCount() && i + 1 < _data.length()) {
-                stream << "\n";
-                lines++;
+    // the newest rows go to the store, the arena may push out some more of them
+    result.hotFirst = std::max(0, result.rows.size() - _capacity);
+    result.store.setFirstSerial(result.hotFirst);
+    for (int i = result.hotFirst; i < result.rows.size(); ++i) {
+        const auto &row = result.rows.at(i);
+        const auto evict = result.store.reserve(&row.length, 1);
+        result.store.removeFirst(evict);
+        result.hotFirst += evict;
+
+        auto destination = result.store.append(row.direction, row.createdAt, row.updatedAt, row.length);
+        for (int p = row.firstPiece; p < row.firstPiece + row.pieceCount; ++p) {
+            const auto &piece = result.pieces.at(p);
+            memcpy(destination, piece.data, size_t(piece.length));
+            destination += piece.length;
+        }
+    }
+
+    // the older rows as far as the cold history takes them; trimmed once the blocks
+    // are compressed, the budget counts compressed bytes
+    result.cold->setMaxMemory(_coldBudget);
+    if (result.cold->isEnabled()) {
+        QByteArray bytes {};
+        for (int i = 0; i < result.hotFirst; ++i) {
+            const auto &row = result.rows.at(i);
+            bytes.resize(row.length);
+            auto destination = bytes.data();
+            for (int p = row.firstPiece; p < row.firstPiece + row.pieceCount; ++p) {
+                const auto &piece = result.pieces.at(p);
+                memcpy(destination, piece.data, size_t(piece.length));
+                destination += piece.length;
+            }
+            result.cold->append(i, row.direction, row.createdAt, row.updatedAt, bytes.constData(), row.length);
+            if (i % 4096 == 4095 && result.cold->excessRows() > 0) {
+                result.cold->waitForCompressor();
+                result.cold->removeFirst(result.cold->excessRows());
             }
         }
+        result.cold->waitForCompressor();
+        result.cold->removeFirst(result.cold->excessRows());
+    }
+
+    result.nsecs = now() - start;
+    return result;
+}
+
+HistoryModel::Segmenter HistoryModel::segmentPart(const LogPart &_part)
+{
+    Segmenter segmenter {};
+    _part.snapshot->visit(_part.from, _part.to, [&](const ChunkLog::Entry &_entry, const char *_data) {
+        if (_entry.gap)
+            segmenter.setEndedAtNewline(true);
+        if (Framing(_entry.framing) == Unframed)
+            segmenter.addData(_part.settings, DataDirection(_entry.direction), _data, _entry.length, _entry.timestamp, _entry.byteTime);
+        else
+            segmenter.addFrame(DataDirection(_entry.direction), _data, _entry.length, _entry.timestamp, _entry.byteTime, Framing(_entry.framing));
+        return true;
+    });
+    return segmenter;
+}
+
+bool HistoryModel::startsRow(const Segmenter::Settings &_settings, const ChunkLog::Entry &_previous, const char *_previousData,
+                             const ChunkLog::Entry &_entry)
+{
+    // what makes Segmenter start a row regardless of the rows before
+    if (_entry.direction != _previous.direction || Framing(_entry.framing) == FrameStarted || _entry.gap)
+        return true;
+    if (Framing(_previous.framing) == Unframed && _previousData[_previous.length - 1] == '\n')
+        return true;
+    const auto firstByte = _entry.timestamp - (_entry.length - 1) * _entry.byteTime;
+    return Framing(_entry.framing) == Unframed && _settings.durationEnabled && firstByte - _previous.timestamp > _settings.duration;
+}
+
+void HistoryModel::evictRows(int _count)
+{
+    if (!m_cold.isEnabled()) {
+        trimColdHistory(); // what is left from before it was disabled goes first
+        removeRows(0, _count);
+        return;
+    }
+
+    _count = std::min(_count, m_store.count());
+    if (_count <= 0)
+        return;
+
+    // the rows only move, their model rows and serials stay
+    {
+        QMutexLocker locker(&m_rowsMutex);
+        for (int row = 0; row < _count; ++row) {
+            m_cold.append(m_store.serial(row), m_store.direction(row), m_store.createdAt(row), m_store.updatedAt(row),
+                          m_store.data(row), m_store.length(row));
+        }
+        m_store.removeFirst(_count);
+    }
+    trimColdHistory();
+}
+
+void HistoryModel::trimColdHistory()
+{
+    // whole blocks, so this is rare
+    const auto excess = m_cold.excessRows();
+    if (excess > 0)
+        removeRows(0, excess);
+}
+
+int HistoryModel::coldRows() const
+{
+    return m_capture.isOpen() ? 0 : m_cold.count();
+}
+
+const ColdHistory::Row &HistoryModel::coldRow(int _row) const
+{
+    // painting asks for the direction, the timestamp and the bytes of a row in turn
+    const auto serial = m_cold.firstSerial() + _row;
+    if (serial != m_coldPinSerial) {
+        m_coldPin = m_cold.row(_row);
+        m_coldPinSerial = serial;
+    }
+    return m_coldPin;
+}
+
+qint64 HistoryModel::rowSerial(int _row) const
+{
+    if (m_capture.isOpen())
+        return _row;
+    const auto cold = m_cold.count();
+    return _row < cold ? m_cold.firstSerial() + _row : m_store.serial(_row - cold);
+}
+
+int HistoryModel::rowOfSerial(qint64 _serial) const
+{
+    const auto row = rowCount() > 0 ? _serial - rowSerial(0) : -1;
+    if (row < 0 || row >= rowCount())
+        return -1;
+    return int(row);
+}
+
+int HistoryModel::rowOfTime(qint64 _time) const
+{
+    // rows are created in capture order
+    int from = 0;
+    int to = rowCount();
+    while (from < to) {
+        const auto middle = from + (to - from) / 2;
+        if (rowCreatedAt(middle) <= _time)
+            from = middle + 1;
+        else
+            to = middle;
+    }
+    return from - 1;
+}
+
+qint64 HistoryModel::visitRows(qint64 _from, qint64 _maxBytes, const RowVisitor &_visitor) const
+{
+    QMutexLocker locker(&m_rowsMutex);
+
+    const auto count = rowCount();
+    if (count == 0)
+        return _from;
+
+    const auto first = rowSerial(0);
+    const auto cold = coldRows();
+    qint64 visited = 0;
+    const auto start = int(std::min<qint64>(std::max<qint64>(_from - first, 0), count));
+    for (auto row = start; row < count && visited < _maxBytes; ++row) {
+        if (row < cold) {
+            // a copy of our own, the pin belongs to the GUI thread
+            const auto coldRow = m_cold.row(row);
+            _visitor(first + row, DataDirection(coldRow.direction), captureclock::toNSecsSinceEpoch(coldRow.createdAt),
+                     coldRow.data, coldRow.length, false);
+            visited += coldRow.length + 1;
+            continue;
+        }
+
+        const auto data = rowData(row);
+        _visitor(first + row, rowDirection(row), rowCreatedAt(row), data.constData(), data.length(),
+                 row == count - 1 && !m_capture.isOpen());
+        visited += data.length() + 1; // empty rows count too
     }
-    return ret;
+
+    return first + count;
+}
+
+HistoryModel::DataDirection HistoryModel::rowDirection(int _row) const
+{
+    if (m_capture.isOpen())
+        return DataDirection(m_capture.direction(_row));
+    const auto cold = m_cold.count();
+    return DataDirection(_row < cold ? coldRow(_row).direction : m_store.direction(_row - cold));
+}
+
+qint64 HistoryModel::rowCreatedAt(int _row) const
+{
+    if (m_capture.isOpen())
+        return m_capture.timestamp(_row);
+    const auto cold = m_cold.count();
+    return captureclock::toNSecsSinceEpoch(_row < cold ? coldRow(_row).createdAt : m_store.createdAt(_row - cold));
+}
+
+qint64 HistoryModel::rowUpdatedAt(int _row) const
+{
+    if (m_capture.isOpen())
+        return m_capture.timestamp(_row);
+    const auto cold = m_cold.count();
+    return captureclock::toNSecsSinceEpoch(_row < cold ? coldRow(_row).updatedAt : m_store.updatedAt(_row - cold));
+}
+
+QByteArray HistoryModel::rowData(int _row) const
+{
+    const auto view = rowView(_row);
+    return QByteArray::fromRawData(view.data, view.length);
+}
+
+HistoryModel::RowView HistoryModel::rowView(int _row) const
+{
+    if (m_capture.isOpen())
+        return RowView {m_capture.data(_row), m_capture.length(_row)};
+    const auto cold = m_cold.count();
+    if (_row < cold) {
+        const auto &row = coldRow(_row);
+        return RowView {row.data, row.length};
+    }
+    return RowView {m_store.data(_row - cold), m_store.length(_row - cold)};
+}
+
+QColor HistoryModel::foregroundColor(int _column)
+{
+    switch (_column) {
+    case toColumn(TimestampRole):
+    case toColumn(HexRole):
+    case toColumn(DirectionRole):
+        return QColor(Qt::gray);
+    default:
+        return QColor(Qt::black);
+    }
+}
+
+QString HistoryModel::renderedCell(int _row, ColumnRoles _role) const
+{
+    const auto key = quint64(rowSerial(_row)) * 2 + (_role == StringRole ? 1 : 0);
+
+    const auto cached = m_renderCache.object(key);
+    if (cached && cached->generation == m_formatGeneration) {
+        m_renderCacheHits++;
+        return cached->text;
+    }
+
+    m_renderCacheMisses++;
+    const auto start = now();
+    const auto data = rowData(_row);
+    const auto text = _role == HexRole ? formattedHexString(data) : formattedString(data);
+    m_formatTimes.record(now() - start);
+    m_renderCache.insert(key, new RenderedCell {text, m_formatGeneration}, text.size() + 1);
+    return text;
+}
+
+void HistoryModel::invalidateRenderedRow(int _row)
+{
+    const auto key = quint64(rowSerial(_row)) * 2;
+    m_renderCache.remove(key);
+    m_renderCache.remove(key + 1);
+}
+
+QString HistoryModel::formattedHexString(const QByteArray &_data) const
+{
+    const auto bytesPerLine = newLineAfterCountEnabled() ? newlineAfterCount() : 0;
+    const auto size = hexformat::hexBufferSize(_data.length(), bytesPerLine);
+    if (m_formatBuffer.size() < size)
+        m_formatBuffer.resize(size);
+
+    const auto length = hexformat::formatHex(_data.constData(), _data.length(), bytesPerLine, m_formatBuffer.data());
+    return QString::fromLatin1(m_formatBuffer.constData(), length);
+}
+
+QString HistoryModel::formattedString(const QByteArray &_data) const
+{
+    const auto bytesPerLine = newLineAfterCountEnabled() ? newlineAfterCount() : 0;
+    const auto size = hexformat::asciiBufferSize(_data.length(), bytesPerLine);
+    if (m_formatBuffer.size() < size)
+        m_formatBuffer.resize(size);
+
+    const auto length = hexformat::formatAscii(_data.constData(), _data.length(), bytesPerLine, m_formatBuffer.data());
+    return QString::fromLatin1(m_formatBuffer.constData(), length);
 }
 
 const char * HistoryModel::toString(const DataDirection _dir)
@@ -317,6 +927,17 @@ const char * HistoryModel::toString(const DataDirection _dir)
     default:
         break;
     }
+
+    // "#1" for the first channel, built once
+    static const auto channelNames = [](){
+        QVector<QByteArray> names {};
+        for (int i = 0; i < MAX_CHANNELS; ++i)
+            names.append("#" + QByteArray::number(i + 1));
+        return names;
+    }();
+    const auto channel = toChannel(_dir);
+    if (channel >= 0 && channel < MAX_CHANNELS)
+        return channelNames.at(channel).constData();
     return "Invalid";
 }
 
@@ -330,6 +951,8 @@ void HistoryModel::setNewlineAfterCount(int newNewlineAfterCount)
     if (m_newlineAfterCount == newNewlineAfterCount)
         return;
     m_newlineAfterCount = newNewlineAfterCount;
+    m_formatGeneration++;
+    scheduleResegmenting();
 }
 
 bool HistoryModel::newLineAfterCountEnabled() const
@@ -342,6 +965,8 @@ void HistoryModel::setNewlineAfterCountEnabled(bool newNewLineAfterCountEnabled)
     if (m_newLineAfterCountEnabled == newNewLineAfterCountEnabled)
         return;
     m_newLineAfterCountEnabled = newNewLineAfterCountEnabled;
+    m_formatGeneration++;
+    scheduleResegmenting();
 }
 
 int HistoryModel::newlineAfterDuration() const
@@ -354,6 +979,7 @@ void HistoryModel::setNewlineAfterDuration(int newNewlineAfterDuration)
     if (newNewlineAfterDuration == m_newlineAfterDuration)
         return;
     m_newlineAfterDuration = newNewlineAfterDuration;
+    scheduleResegmenting();
 }
 
 bool HistoryModel::newlineAfterDurationEnabled() const
@@ -366,6 +992,113 @@ void HistoryModel::setNewlineAfterDurationEnabled(bool newNewlineAfterDuraionEna
     if (newNewlineAfterDuraionEnabled == m_newlineAfterDuraionEnabled)
         return;
     m_newlineAfterDuraionEnabled = newNewlineAfterDuraionEnabled;
+    scheduleResegmenting();
+}
+
+void HistoryModel::setChunkLogSize(qint64 _bytes)
+{
+    m_log.setMaxSize(_bytes);
+    if (!m_log.isEnabled()) {
+        m_resegmentGeneration++;
+        m_resegmentPending = false;
+    }
+}
+
+qint64 HistoryModel::chunkLogSize() const
+{
+    return m_log.maxSize();
+}
+
+bool HistoryModel::isResegmenting() const
+{
+    return m_resegmentPending || m_resegmentWatcher.isRunning();
+}
+
+bool HistoryModel::openCapture(const QString &_indexPath)
+{
+    beginResetModel();
+    bool ok {};
+    {
+        QMutexLocker locker(&m_rowsMutex);
+        ok = m_capture.open(_indexPath);
+    }
+    m_captureErrorString = m_capture.errorString();
+    m_renderCache.clear(); // serials are row numbers of the file now
+    endResetModel();
+    return ok;
+}
+
+void HistoryModel::closeCapture()
+{
+    if (!m_capture.isOpen())
+        return;
+
+    beginResetModel();
+    {
+        QMutexLocker locker(&m_rowsMutex);
+        m_capture.close();
+    }
+    m_renderCache.clear();
+    endResetModel();
+
+    startResegmenting(); // if settings changed meanwhile
+}
+
+bool HistoryModel::isCaptureOpen() const
+{
+    return m_capture.isOpen();
+}
+
+QString HistoryModel::captureFileName() const
+{
+    return m_capture.fileName();
+}
+
+bool HistoryModel::saveCapture(const QString &_indexPath)
+{
+    // an open capture is already on disk, copy it as is
+    if (m_capture.isOpen()) {
+        if (QFileInfo(_indexPath) == QFileInfo(m_capture.fileName()))
+            return true;
+
+        const QString from[] {m_capture.fileName(), capturefile::journalPath(m_capture.fileName())};
+        const QString to[] {_indexPath, capturefile::journalPath(_indexPath)};
+        for (int i = 0; i < 2; ++i) {
+            QFile::remove(to[i]);
+            QFile file(from[i]);
+            if (!file.copy(to[i])) {
+                m_captureErrorString = file.errorString();
+                return false;
+            }
+        }
+        return true;
+    }
+
+    CaptureWriter writer {};
+    if (!writer.open(_indexPath)) {
+        m_captureErrorString = writer.errorString();
+        return false;
+    }
+
+    // the cold rows too, block by block
+    for (int row = 0; row < rowCount(); ++row) {
+        const auto data = rowView(row);
+        if (!writer.append(rowDirection(row), rowCreatedAt(row), data.data, data.length)) {
+            m_captureErrorString = writer.errorString();
+            return false;
+        }
+    }
+
+    if (!writer.close()) {
+        m_captureErrorString = writer.errorString();
+        return false;
+    }
+    return true;
+}
+
+QString HistoryModel::captureErrorString() const
+{
+    return m_captureErrorString;
 }
 
 int HistoryModel::historyCapacity() const
@@ -373,6 +1106,63 @@ int HistoryModel::historyCapacity() const
     return m_historyCapacity;
 }
 
+void HistoryModel::setColdHistoryBudget(qint64 _bytes)
+{
+    if (_bytes == m_cold.maxMemory())
+        return;
+
+    {
+        QMutexLocker locker(&m_rowsMutex);
+        m_cold.setMaxMemory(_bytes);
+    }
+    if (!m_capture.isOpen())
+        trimColdHistory();
+}
+
+qint64 HistoryModel::coldHistoryBudget() const
+{
+    return m_cold.maxMemory();
+}
+
+int HistoryModel::coldRowCount() const
+{
+    return m_cold.count();
+}
+
+ColdHistory::Stats HistoryModel::coldHistoryStats() const
+{
+    return m_cold.stats();
+}
+
+qint64 HistoryModel::memoryUsage() const
+{
+    return m_store.memoryUsage() + m_cold.memoryUsage() + m_log.memoryUsage();
+}
+
+HistoryModel::RenderCacheStats HistoryModel::renderCacheStats() const
+{
+    return RenderCacheStats {m_renderCacheHits, m_renderCacheMisses, m_renderCache.count()};
+}
+
+LatencyHistogram HistoryModel::takeAppendTimes()
+{
+    const auto times = m_appendTimes;
+    m_appendTimes.clear();
+    return times;
+}
+
+LatencyHistogram HistoryModel::takeFormatTimes()
+{
+    const auto times = m_formatTimes;
+    m_formatTimes.clear();
+    return times;
+}
+
+void HistoryModel::recordFormatTime(qint64 _ns) const
+{
+    m_formatTimes.record(_ns);
+}
+
 QList<QByteArray> HistoryModel::splitDataByLength(const QByteArray &_data, int _chunkLength, int _firstChunkLength)
 {
     Q_ASSERT_X(_chunkLength > 0, "split", "chunkLength cannot be zero");
@@ -395,34 +1185,61 @@ QList<QByteArray> HistoryModel::splitDataByLength(const QByteArray &_data, int _
 
 QList<QByteArray> HistoryModel::splitData(const QByteArray &_data, bool limitByLength, int _chunkLength, int _firstChunkLength)
 {
-    if (limitByLength) {
+    QVector<Segment> segments {};
+    segmentData(_data.constData(), _data.length(), limitByLength, _chunkLength, _firstChunkLength, &segments);
+
+    QList<QByteArray> result {};
+    result.reserve(segments.size());
+    for (const auto &segment : qAsConst(segments))
+        result.append(_data.mid(segment.offset, segment.length));
+    return result;
+}
+
+void HistoryModel::segmentData(const char *_data, int _length, bool _limitByLength, int _chunkLength, int _firstChunkLength,
+                               QVector<Segment> *_segments)
+{
+    if (_limitByLength) {
         Q_ASSERT(_chunkLength > 0);
         Q_ASSERT(_firstChunkLength <= _chunkLength);
 
         if (_firstChunkLength == -1) _firstChunkLength = _chunkLength;
     }
 
-    auto tmpData = _data.split('\n');
-    QList<QByteArray> result {};
-
-    Q_ASSERT(tmpData.length() > 0);
+    // every line is a row, or rows of _chunkLength bytes when limited, the first
+    // one of _firstChunkLength; like splitDataByLength() a line always gives a row
+    int lineStart = 0;
+    bool firstLine = true;
+    for (;;) {
+        const auto newline = static_cast<const char *>(memchr(_data + lineStart, '\n', size_t(_length - lineStart)));
+        const auto lineEnd = newline ? int(newline - _data) : _length;
+
+        if (!_limitByLength) {
+            _segments->append(Segment {lineStart, lineEnd - lineStart});
+        } else if (firstLine && lineEnd - lineStart <= _firstChunkLength) {
+            _segments->append(Segment {lineStart, lineEnd - lineStart});
+        } else {
+            auto from = lineStart;
+            if (firstLine) {
+                _segments->append(Segment {from, _firstChunkLength});
+                from += _firstChunkLength;
+            }
 
-    if (tmpData.front().length() <= _firstChunkLength) {
-        result.append(tmpData.front());
-        tmpData.pop_front();
-    } else {
-        result.append(tmpData.front().left(_firstChunkLength));
-        tmpData.front().remove(0, _firstChunkLength);
-    }
+            _segments->append(Segment {from, std::min(lineEnd - from, _chunkLength)});
+            from += _chunkLength;
+            while (from < lineEnd) {
+                _segments->append(Segment {from, std::min(_chunkLength, lineEnd - from)});
+                from += _chunkLength;
+            }
+        }
 
-    for (const auto &line : tmpData) {
-        result.append(splitDataByLength(line, _chunkLength, _chunkLength));
+        if (!newline)
+            break;
+        lineStart = lineEnd + 1;
+        firstLine = false;
     }
-
-    return result;
 }
 
-QDateTime HistoryModel::now()
+qint64 HistoryModel::now()
 {
-    return QDateTime::currentDateTime();
+    return captureclock::now();
 }
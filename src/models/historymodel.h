@@ -4,6 +4,17 @@
 #include <QAbstractTableModel>
 #include <QList>
 #include <QDateTime>
+#include <QCache>
+#include <QColor>
+#include <QMutex>
+#include <QFutureWatcher>
+#include <functional>
+
+#include "historystore.h"
+#include "capturefile.h"
+#include "chunklog.h"
+#include "coldhistory.h"
+#include "utils/latencyhistogram.h"
 
 class HistoryModel : public QAbstractTableModel
 {
@@ -26,16 +37,64 @@ public:
         return static_cast<ColumnRoles>(TimestampRole + column);
     }
 
-    enum DataDirection {
+    // the two-port directions, then one id per channel of a CaptureEngine;
+    // stored as a byte in the history and in capture files
+    enum DataDirection : quint8 {
         A_TO_B,
         B_TO_A,
         A_TO_PC,
         B_TO_PC,
         PC_TO_A,
-        PC_TO_B
+        PC_TO_B,
+        FIRST_CHANNEL = 16
+    };
+    static constexpr int MAX_CHANNELS = 64;
+
+    static constexpr DataDirection channelDirection(int _channel) {
+        return static_cast<DataDirection>(FIRST_CHANNEL + _channel);
+    }
+
+    // -1 for the two-port directions
+    static constexpr int toChannel(DataDirection _dir) {
+        return _dir >= FIRST_CHANNEL ? _dir - FIRST_CHANNEL : -1;
+    }
+
+    struct RenderCacheStats {
+        quint64 hits;
+        quint64 misses;
+        int entries;
+    };
+
+    // With a frame decoder on the port its frames make the rows, instead of
+    // newlines, newlineAfterCount and newlineAfterDuration.
+    enum Framing : quint8 {
+        Unframed,
+        FrameContinued, // appended to the current frame
+        FrameStarted
+    };
+
+    // a view on received bytes, only used during appendChunks()
+    struct Chunk {
+        DataDirection direction;
+        const char *data;
+        int length;
+        qint64 timestamp; // capture clock of the last byte, ns
+        qint64 byteTime; // ns between interpolated byte timestamps, 0 for one timestamp per chunk
+        Framing framing;
+        bool gap; // chunks before it were dropped, it starts a row
+    };
+
+    // bytes of a row without a QByteArray, valid until the rows change
+    struct RowView {
+        const char *data;
+        int length;
     };
 
+    // _createdAt: first byte, ns since epoch; _newest: the row may still grow
+    using RowVisitor = std::function<void(qint64 _serial, DataDirection _dir, qint64 _createdAt, const char *_data, int _length, bool _newest)>;
+
     explicit HistoryModel(QObject *parent = nullptr);
+    ~HistoryModel();
 
     // Header:
     QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
@@ -54,6 +113,8 @@ public:
     void addItem(DataDirection _dir, const QByteArray &_data);
     void addItems(DataDirection _dir, const QList<QByteArray> &_data);
     void appendData(DataDirection _dir, const QByteArray &_data);
+    // applies a batch with at most one removal, one dataChanged and one insertion
+    void appendChunks(const QVector<Chunk> &_chunks);
 
     int newlineAfterCount() const;
     void setNewlineAfterCount(int newNewlineAfterCount);
@@ -67,33 +128,220 @@ public:
     bool newlineAfterDurationEnabled() const;
     void setNewlineAfterDurationEnabled(bool newNewlineAfterDuraionEnabled);
 
+    // The received chunks are logged up to _bytes, 0 disables it. With the log a change of
+    // the newline settings re-segments the logged rows on a thread pool and swaps them in
+    // with a model reset, the serials start over; without it the settings only apply to new data.
+    void setChunkLogSize(qint64 _bytes);
+    qint64 chunkLogSize() const;
+    bool isResegmenting() const;
+
+    // While a capture file is open the model shows its rows instead of the history,
+    // received data closes it again.
+    bool openCapture(const QString &_indexPath);
+    void closeCapture();
+    bool isCaptureOpen() const;
+    QString captureFileName() const;
+    bool saveCapture(const QString &_indexPath); // the open capture or else the history
+    QString captureErrorString() const;
+
+    // serials number the rows since clear(), or the rows of the open capture
+    qint64 rowSerial(int _row) const;
+    int rowOfSerial(qint64 _serial) const; // -1 if the row is gone
+    int rowOfTime(qint64 _time) const; // the newest row created at or before _time, ns since epoch; -1 for none
+    DataDirection rowDirection(int _row) const;
+    qint64 rowCreatedAt(int _row) const; // first byte, ns since epoch
+    qint64 rowUpdatedAt(int _row) const; // last byte, ns since epoch
+    // GUI thread; the bytes of a cold row are only valid until another cold row is read
+    QByteArray rowData(int _row) const; // no copy, valid until the rows change
+    RowView rowView(int _row) const; // no allocation either, for painting
+    static QColor foregroundColor(int _column);
+    static const char* toString(const DataDirection _dir);
+
+    // Thread-safe: calls _visitor for the rows from serial _from on, oldest first, until about
+    // _maxBytes were visited. The rows are locked against changes meanwhile, so keep it short.
+    // Returns the serial after the newest row.
+    qint64 visitRows(qint64 _from, qint64 _maxBytes, const RowVisitor &_visitor) const;
+
     int historyCapacity() const;
+    // rows evicted by the capacity are kept compressed in up to _bytes, 0 deletes them
+    void setColdHistoryBudget(qint64 _bytes);
+    qint64 coldHistoryBudget() const;
+    int coldRowCount() const; // the oldest rows, before the hot ones
+    ColdHistory::Stats coldHistoryStats() const;
+    qint64 memoryUsage() const;
+    RenderCacheStats renderCacheStats() const;
+    // time spent in appendData()/appendChunks() and formatting or painting Hex/String cells,
+    // since the last take; HistoryDelegate records its cells with recordFormatTime()
+    LatencyHistogram takeAppendTimes();
+    LatencyHistogram takeFormatTimes();
+    void recordFormatTime(qint64 _ns) const; // GUI thread
 
 private:
+    // benchmarks/historymodel times the hot paths below
+    friend class HistoryModelBenchmark;
+
+    // a row of received data, as a range of the received buffer
+    struct Segment {
+        int offset;
+        int length;
+    };
+
     QString formattedHexString(const QByteArray &_data) const;
     QString formattedString(const QByteArray &_data) const;
-    static const char* toString(const DataDirection _dir);
     static QList<QByteArray> splitDataByLength(const QByteArray &_data, int _chunkLength, int _firstChunkLength);
     static QList<QByteArray> splitData(const QByteArray &_data, bool limitByLength, int _chunkLength = -1, int _firstChunkLength = -1);
-    static QDateTime now();
+    // the rows splitData() would return, appended to _segments without copying a byte
+    static void segmentData(const char *_data, int _length, bool _limitByLength, int _chunkLength, int _firstChunkLength,
+                            QVector<Segment> *_segments);
+
+    // Splits received bytes into rows by the newline settings. Rows are staged as pieces of
+    // the buffers the bytes were received in. The model stages live data on top of the
+    // store's newest row with it, the re-segmenting workers replay the chunk log from scratch.
+    class Segmenter
+    {
+    public:
+        struct Settings {
+            bool countEnabled;
+            int count;
+            bool durationEnabled;
+            qint64 duration; // ns
+        };
+
+        struct Piece {
+            const char *data;
+            int length;
+        };
+
+        struct Row {
+            DataDirection direction;
+            qint64 createdAt;
+            qint64 updatedAt;
+            int firstPiece; // in pieces(), the pieces of a row are consecutive
+            int pieceCount;
+            int length;
+        };
+
+        // the newest row before the staged ones, it may still grow
+        struct Tail {
+            bool exists;
+            DataDirection direction;
+            int length;
+            qint64 updatedAt;
+        };
+
+        void setTail(const Tail &_tail);
+        bool endedAtNewline() const;
+        void setEndedAtNewline(bool _endedAtNewline);
+
+        void addData(const Settings &_settings, DataDirection _dir, const char *_data, int _length, qint64 _timestamp, qint64 _byteTime);
+        void addFrame(DataDirection _dir, const char *_data, int _length, qint64 _timestamp, qint64 _byteTime, Framing _framing);
+        void addRow(DataDirection _dir, const char *_data, int _length, qint64 _timestamp); // as is
+
+        Row &appended(); // bytes for the tail row, if length > 0
+        QVector<Row> &rows();
+        const QVector<Row> &rows() const;
+        const QVector<Piece> &pieces() const;
+        void clear(); // the staged rows, keeps the capacity
+
+    private:
+        bool hasTail() const;
+        DataDirection tailDirection() const;
+        int tailLength() const;
+        qint64 tailUpdatedAt() const;
+        void appendToTail(const char *_data, int _length, qint64 _timestamp);
+
+    private:
+        Tail m_tail {};
+        bool m_endedAtNewline {true};
+        Row m_appended {};
+        QVector<Row> m_rows {};
+        QVector<Piece> m_pieces {};
+        QVector<Segment> m_segments {}; // reused by addData()
+    };
+
+    // the entries from..to of a log snapshot, starting at a row boundary
+    struct LogPart {
+        const ChunkLog::Snapshot *snapshot;
+        Segmenter::Settings settings;
+        qint64 from;
+        qint64 to;
+    };
+
+    // the rows of the whole chunk log, built on the workers
+    struct Resegmented {
+        quint32 generation;
+        ChunkLog::Snapshot snapshot; // the pieces point into it
+        qint64 endEntry;
+        QVector<Segmenter::Row> rows;
+        QVector<Segmenter::Piece> pieces;
+        int hotFirst; // rows before it are not in the store
+        HistoryStore store;
+        ColdHistory *cold; // the rows before hotFirst it takes, owned by whoever takes the result
+        bool endedAtNewline;
+        qint64 nsecs;
+    };
+
+    // rows are staged first and committed to the store in one go
+    void stageChunk(const Chunk &_chunk);
+    void commitStaged();
+    Segmenter::Tail storeTail() const;
+    Segmenter::Settings segmenterSettings() const;
+    void scheduleResegmenting();
+    void startResegmenting();
+    void finishResegmenting();
+    bool takeResegmented(Resegmented *_result); // the finished result, once
+    static Resegmented resegmented(const ChunkLog::Snapshot &_snapshot, const Segmenter::Settings &_settings, int _capacity,
+                                   qint64 _coldBudget, quint32 _generation);
+    static Segmenter segmentPart(const LogPart &_part);
+    static bool startsRow(const Segmenter::Settings &_settings, const ChunkLog::Entry &_previous, const char *_previousData,
+                          const ChunkLog::Entry &_entry);
+    void evictRows(int _count); // the oldest hot rows, to the cold history if enabled
+    void trimColdHistory();
+    int coldRows() const; // 0 while a capture is open
+    const ColdHistory::Row &coldRow(int _row) const; // GUI thread, valid until the next cold row is read
+    QString renderedCell(int _row, ColumnRoles _role) const;
+    void invalidateRenderedRow(int _row);
+    static qint64 now(); // capture clock, ns
 
 signals:
+    void resegmented(qint64 _rows, qint64 _nsecs); // the rows were swapped in, _nsecs on the workers
 
 private slots:
 
 private:
-    struct LogData {
-        int index;
-        DataDirection direction;
-        QDateTime createdDatetime;
-        QDateTime lastAppendDateTime;
-        QByteArray data;
+    struct RenderedCell {
+        QString text;
+        quint32 generation;
     };
 
-    int m_totalLines {};
     int m_historyCapacity {};
-    bool m_endedAtNewline {true};
-    QList<LogData> m_items {};
+    HistoryStore m_store {};
+    ColdHistory m_cold {}; // rows evicted from m_store, they come first
+    mutable ColdHistory::Row m_coldPin {}; // the last cold row read by the GUI thread
+    mutable qint64 m_coldPinSerial {-1};
+    CaptureReader m_capture {};
+    mutable QMutex m_rowsMutex {}; // taken by the GUI thread to change rows, and by visitRows()
+    QString m_captureErrorString {};
+
+    // staged rows point into the received buffers, the bytes are copied once by commitStaged()
+    Segmenter m_segmenter {};
+    QVector<int> m_stagedLengths {}; // reused by commitStaged()
+
+    // the source the rows are segmented again from
+    ChunkLog m_log {};
+    QFutureWatcher<Resegmented> m_resegmentWatcher {};
+    quint32 m_resegmentGeneration {}; // bumped when a running re-segmentation is out of date
+    bool m_resegmentUnread {}; // its result is not taken yet
+    bool m_resegmentPending {};
+
+    // formatted Hex/String cells keyed by row serial, cost is the text length
+    mutable QCache<quint64, RenderedCell> m_renderCache {4 * 1024 * 1024};
+    mutable quint64 m_renderCacheHits {};
+    mutable quint64 m_renderCacheMisses {};
+    mutable LatencyHistogram m_formatTimes {}; // cache misses and painted cells
+    LatencyHistogram m_appendTimes {};
+    mutable QByteArray m_formatBuffer {}; // reused by the formatters, GUI thread only
+    quint32 m_formatGeneration {}; // bumped when the formatting settings change
     int m_newlineAfterCount {};
     bool m_newLineAfterCountEnabled {};
     int m_newlineAfterDuration {}; // ms
@@ -0,0 +1,247 @@
+#include "historysearch.h"
+#include <QRegularExpression>
+#include <algorithm>
+#include <cctype>
+
+#include "utils/bytesearch.h"
+
+constexpr qint64 HistorySearch::SLICE_BYTES;
+
+HistorySearch::HistorySearch(const HistoryModel &_history, QObject *parent)
+    : QObject(parent)
+    , m_history(_history)
+{
+    m_thread.setObjectName("history-search");
+    m_worker = new QObject();
+    m_worker->moveToThread(&m_thread);
+    m_thread.start(QThread::LowPriority);
+
+    connect(&m_history, &HistoryModel::rowsInserted, this, &HistorySearch::update);
+    connect(&m_history, &HistoryModel::dataChanged, this, &HistorySearch::update);
+    connect(&m_history, &HistoryModel::modelReset, this, &HistorySearch::restart);
+}
+
+HistorySearch::~HistorySearch()
+{
+    m_generation++; // stops a running scan at the next slice
+    m_thread.quit();
+    m_thread.wait();
+    delete m_worker;
+}
+
+bool HistorySearch::parsePattern(const QString &_text, bool _hex, QByteArray *_pattern)
+{
+    QByteArray pattern {};
+
+    if (_hex) {
+        QByteArray digits {};
+        static const QRegularExpression separators("[\\s,:]+");
+        for (auto token : _text.split(separators, Qt::SkipEmptyParts)) {
+            if (token.startsWith("0x", Qt::CaseInsensitive))
+                token.remove(0, 2);
+            for (const auto c : token) {
+                if (c.unicode() > 0x7f || !isxdigit(c.toLatin1()))
+                    return false;
+            }
+            // a lone digit is one byte: "1 2" -> 01 02
+            digits.append(token.length() % 2 ? "0" + token.toLatin1() : token.toLatin1());
+        }
+        pattern = QByteArray::fromHex(digits);
+    } else {
+        // \n, \r, \t, \\ and \xHH escapes
+        const auto text = _text.toLatin1();
+        for (int i = 0; i < text.length(); ++i) {
+            if (text.at(i) != '\\' || i + 1 == text.length()) {
+                pattern.append(text.at(i));
+                continue;
+            }
+
+            const auto escaped = text.at(++i);
+            switch (escaped) {
+            case 'n':
+                pattern.append('\n');
+                break;
+            case 'r':
+                pattern.append('\r');
+                break;
+            case 't':
+                pattern.append('\t');
+                break;
+            case 'x': {
+                const auto hex = text.mid(i + 1, 2);
+                bool ok {};
+                const auto value = hex.toInt(&ok, 16);
+                if (!ok || hex.length() != 2)
+                    return false;
+                pattern.append(char(value));
+                i += 2;
+                break;
+            }
+            default:
+                pattern.append(escaped);
+                break;
+            }
+        }
+    }
+
+    *_pattern = pattern;
+    return true;
+}
+
+void HistorySearch::setPattern(const QByteArray &_pattern)
+{
+    {
+        QMutexLocker locker(&m_patternMutex);
+        if (_pattern == m_pattern)
+            return;
+        m_pattern = _pattern;
+    }
+    restart();
+}
+
+QByteArray HistorySearch::pattern() const
+{
+    QMutexLocker locker(&m_patternMutex);
+    return m_pattern;
+}
+
+bool HistorySearch::isSearching() const
+{
+    return m_searching;
+}
+
+void HistorySearch::update()
+{
+    if (m_scanPending.exchange(true))
+        return;
+
+    const quint32 generation = m_generation;
+    QMetaObject::invokeMethod(m_worker, [this, generation](){ scan(generation); }, Qt::QueuedConnection);
+}
+
+void HistorySearch::restart()
+{
+    const quint32 generation = ++m_generation;
+    emit restarted();
+
+    m_scanPending = true;
+    QMetaObject::invokeMethod(m_worker, [this, generation](){ scan(generation); }, Qt::QueuedConnection);
+}
+
+void HistorySearch::scan(quint32 _generation)
+{
+    m_scanPending = false;
+    if (_generation != m_generation)
+        return; // a newer scan is queued
+
+    if (_generation != m_scanGeneration) {
+        m_scanGeneration = _generation;
+        m_scanPattern = pattern();
+        resetScanState();
+    }
+
+    if (m_scanPattern.isEmpty()) {
+        m_searching = false;
+        return;
+    }
+    m_searching = true;
+
+    // one lock of the rows per slice, the GUI can append in between
+    while (_generation == m_generation) {
+        QVector<qint64> matches {};
+        bool reachedNewest = true;
+        const auto end = m_history.visitRows(m_nextSerial, SLICE_BYTES, [&](qint64 _serial, HistoryModel::DataDirection _dir, qint64, const char *_data, int _length, bool _newest) {
+            visitRow(_serial, _dir, _data, _length, _newest, &matches);
+            reachedNewest = _newest;
+        });
+
+        if (!matches.isEmpty()) {
+            std::sort(matches.begin(), matches.end());
+            matches.erase(std::unique(matches.begin(), matches.end()), matches.end());
+            QMetaObject::invokeMethod(this, [this, _generation, matches](){
+                if (_generation == m_generation)
+                    emit matchesFound(matches);
+            }, Qt::QueuedConnection);
+        }
+
+        // a capture has no growing row, it is done once everything was visited
+        if (reachedNewest || m_nextSerial >= end)
+            break;
+    }
+
+    m_searching = false;
+    QMetaObject::invokeMethod(this, [this, _generation](){
+        if (_generation == m_generation)
+            emit finished();
+    }, Qt::QueuedConnection);
+}
+
+void HistorySearch::visitRow(qint64 _serial, HistoryModel::DataDirection _dir, const char *_data, int _length, bool _newest, QVector<qint64> *_matches)
+{
+    const auto &pattern = m_scanPattern;
+    const int overlap = pattern.length() - 1; // bytes a match can reach back into earlier rows
+
+    // the stream breaks where rows were evicted and where the direction changes
+    if (_serial != m_nextSerial || _dir != m_carryDirection) {
+        m_carry.clear();
+        m_carrySerials.clear();
+        m_carryDirection = _dir;
+    }
+
+    // the newest row is searched again as it grows, only its new bytes and the overlap
+    const auto grown = _serial == m_newestSerial;
+    const auto from = grown ? std::max(0, m_newestScanned - overlap) : 0;
+
+    // matches starting in the carry and ending in this row, or in a later one if this row is short
+    if (!m_carry.isEmpty() && (!grown || m_newestScanned < overlap)) {
+        const auto window = m_carry + QByteArray::fromRawData(_data, std::min(_length, overlap));
+        auto start = window.constData();
+        const auto carryEnd = window.constData() + m_carry.length();
+        const auto windowEnd = window.constData() + window.length();
+        while (start < carryEnd) {
+            const auto match = bytesearch::find(start, size_t(windowEnd - start), pattern.constData(), size_t(pattern.length()));
+            if (!match || match >= carryEnd)
+                break;
+            for (auto i = int(match - window.constData()); i < m_carrySerials.length(); ++i)
+                _matches->append(m_carrySerials.at(i));
+            _matches->append(_serial);
+            start = match + 1;
+        }
+    }
+
+    // one match is enough to report the row
+    if (bytesearch::find(_data + from, size_t(_length - from), pattern.constData(), size_t(pattern.length())))
+        _matches->append(_serial);
+
+    if (_newest) {
+        m_newestSerial = _serial;
+        m_newestScanned = _length;
+        return;
+    }
+
+    // keep the end of the stream for matches crossing into the next row
+    if (_length >= overlap) {
+        m_carry = QByteArray(_data + _length - overlap, overlap);
+        m_carrySerials.fill(_serial, overlap);
+    } else {
+        m_carry.append(_data, _length);
+        for (int i = 0; i < _length; ++i)
+            m_carrySerials.append(_serial);
+        const auto excess = m_carry.length() - overlap;
+        if (excess > 0) {
+            m_carry.remove(0, excess);
+            m_carrySerials.remove(0, excess);
+        }
+    }
+    m_nextSerial = _serial + 1;
+    m_newestSerial = -1;
+}
+
+void HistorySearch::resetScanState()
+{
+    m_nextSerial = 0;
+    m_newestSerial = -1;
+    m_newestScanned = 0;
+    m_carry.clear();
+    m_carrySerials.clear();
+}
@@ -0,0 +1,68 @@
+#ifndef HISTORYSEARCH_H
+#define HISTORYSEARCH_H
+
+#include <QObject>
+#include <QThread>
+#include <QMutex>
+#include <QVector>
+#include <atomic>
+
+#include "historymodel.h"
+
+// Searches the raw row payloads of a HistoryModel for a byte pattern on a worker thread.
+// Consecutive rows of the same direction are searched as one stream, so a match may
+// span several rows; every row it touches is reported. New rows are searched
+// incrementally after update(), a model reset or setPattern() starts over.
+class HistorySearch : public QObject
+{
+    Q_OBJECT
+public:
+    explicit HistorySearch(const HistoryModel &_history, QObject *parent = nullptr);
+    ~HistorySearch();
+
+    // "48 65 6c" / "48656c" in hex mode, the bytes of the Latin-1 text otherwise
+    static bool parsePattern(const QString &_text, bool _hex, QByteArray *_pattern);
+
+    void setPattern(const QByteArray &_pattern); // an empty pattern stops searching
+    QByteArray pattern() const;
+    bool isSearching() const;
+
+public slots:
+    void update(); // rows were added, coalesced until the worker picks it up
+    void restart();
+
+signals:
+    void restarted(); // previously reported matches are void
+    void matchesFound(const QVector<qint64> &_serials); // sorted, may repeat serials reported before
+    void finished(); // caught up with the newest row
+
+private:
+    void scan(quint32 _generation); // worker thread
+    void visitRow(qint64 _serial, HistoryModel::DataDirection _dir, const char *_data, int _length, bool _newest, QVector<qint64> *_matches);
+    void resetScanState();
+
+private:
+    static constexpr qint64 SLICE_BYTES = 1024 * 1024; // scanned per lock of the rows
+
+    const HistoryModel &m_history;
+    QThread m_thread {};
+    QObject *m_worker {nullptr}; // lives on m_thread, runs scan()
+
+    mutable QMutex m_patternMutex {};
+    QByteArray m_pattern {};
+    std::atomic<quint32> m_generation {0}; // bumped on every restart
+    std::atomic<bool> m_scanPending {false};
+    std::atomic<bool> m_searching {false};
+
+    // worker thread only
+    quint32 m_scanGeneration {};
+    QByteArray m_scanPattern {};
+    qint64 m_nextSerial {}; // first row not searched completely
+    qint64 m_newestSerial {-1}; // the newest row can still grow
+    int m_newestScanned {};
+    QByteArray m_carry {}; // last bytes of the stream before m_nextSerial, shorter than the pattern
+    QVector<qint64> m_carrySerials {}; // row of every carry byte
+    HistoryModel::DataDirection m_carryDirection {};
+};
+
+#endif // HISTORYSEARCH_H
@@ -0,0 +1,316 @@
+#include "historystore.h"
+#include <cstring>
+#include <algorithm>
+
+constexpr qint64 HistoryStore::MIN_ARENA_SIZE;
+constexpr qint64 HistoryStore::MAX_ARENA_SIZE;
+
+HistoryStore::HistoryStore(int _capacity)
+{
+    setCapacity(_capacity);
+}
+
+int HistoryStore::count() const
+{
+    return m_count;
+}
+
+int HistoryStore::capacity() const
+{
+    return m_createdAt.size();
+}
+
+void HistoryStore::setCapacity(int _capacity)
+{
+    if (_capacity < 0)
+        _capacity = 0;
+
+    if (_capacity == capacity())
+        return;
+
+    if (m_count > _capacity)
+        removeFirst(m_count - _capacity);
+
+    // re-layout the columns so the oldest row is at slot 0
+    QVector<qint64> createdAt(_capacity);
+    QVector<qint64> updatedAt(_capacity);
+    QVector<qint64> offset(_capacity);
+    QVector<int> length(_capacity);
+    QVector<quint8> direction(_capacity);
+
+    for (int row = 0; row < m_count; ++row) {
+        const auto s = slot(row);
+        createdAt[row] = m_createdAt.at(s);
+        updatedAt[row] = m_updatedAt.at(s);
+        offset[row] = m_offset.at(s);
+        length[row] = m_length.at(s);
+        direction[row] = m_direction.at(s);
+    }
+
+    m_createdAt.swap(createdAt);
+    m_updatedAt.swap(updatedAt);
+    m_offset.swap(offset);
+    m_length.swap(length);
+    m_direction.swap(direction);
+    m_first = 0;
+}
+
+void HistoryStore::clear()
+{
+    m_first = 0;
+    m_count = 0;
+    m_firstSerial = 0;
+    m_arenaHead = 0;
+    m_arenaTail = 0;
+    m_arena.clear();
+    m_arena.squeeze();
+}
+
+qint64 HistoryStore::serial(int _row) const
+{
+    return m_firstSerial + _row;
+}
+
+void HistoryStore::setFirstSerial(qint64 _serial)
+{
+    Q_ASSERT(m_count == 0);
+    m_firstSerial = _serial;
+}
+
+quint8 HistoryStore::direction(int _row) const
+{
+    return m_direction.at(slot(_row));
+}
+
+qint64 HistoryStore::createdAt(int _row) const
+{
+    return m_createdAt.at(slot(_row));
+}
+
+qint64 HistoryStore::updatedAt(int _row) const
+{
+    return m_updatedAt.at(slot(_row));
+}
+
+const char *HistoryStore::data(int _row) const
+{
+    const auto s = slot(_row);
+    if (m_length.at(s) == 0)
+        return "";
+    return m_arena.constData() + (m_offset.at(s) & (m_arena.size() - 1));
+}
+
+int HistoryStore::length(int _row) const
+{
+    return m_length.at(slot(_row));
+}
+
+int HistoryStore::reserve(const int *_lengths, int _rows, int _extendLast)
+{
+    // where would the tail end up after writing everything?
+    const auto extending = _extendLast > 0 && m_count > 0;
+    const auto simulateTail = [&](qint64 _arenaSize) {
+        auto tail = m_arenaTail;
+        if (extending)
+            tail = lastRowPosition(_arenaSize, _extendLast) + m_length.at(slot(m_count - 1)) + _extendLast;
+        for (int i = 0; i < _rows; ++i) {
+            const auto physical = tail & (_arenaSize - 1);
+            if (physical + _lengths[i] > _arenaSize)
+                tail += _arenaSize - physical;
+            tail += _lengths[i];
+        }
+        return tail;
+    };
+
+    auto arenaSize = std::max<qint64>(m_arena.size(), MIN_ARENA_SIZE);
+    while (simulateTail(arenaSize) - m_arenaHead > arenaSize && arenaSize * 2 <= m_maxArenaSize)
+        arenaSize *= 2;
+
+    if (arenaSize != m_arena.size()) {
+        growArena(arenaSize);
+        arenaSize = m_arena.size();
+    }
+
+    // arena is at its limit, the oldest rows have to go
+    const auto tail = simulateTail(arenaSize);
+    int evict = 0;
+    auto head = m_arenaHead;
+    while (tail - head > arenaSize && evict < m_count) {
+        evict++;
+        if (evict == m_count)
+            head = m_arenaTail;
+        else if (evict == m_count - 1 && extending)
+            head = lastRowPosition(arenaSize, _extendLast); // it moves before it grows
+        else
+            head = m_offset.at(slot(evict));
+    }
+
+    return evict;
+}
+
+void HistoryStore::append(quint8 _direction, qint64 _createdAt, qint64 _updatedAt, const char *_data, int _length)
+{
+    const auto destination = append(_direction, _createdAt, _updatedAt, _length);
+    if (_length > 0)
+        memcpy(destination, _data, size_t(_length));
+}
+
+char *HistoryStore::append(quint8 _direction, qint64 _createdAt, qint64 _updatedAt, int _length)
+{
+    Q_ASSERT(m_count < capacity());
+
+    const auto position = appendPosition(_length);
+    Q_ASSERT(position + _length - m_arenaHead <= m_arena.size());
+
+    if (m_count == 0)
+        m_arenaHead = position;
+    m_arenaTail = position + _length;
+
+    const auto s = slot(m_count);
+    m_createdAt[s] = _createdAt;
+    m_updatedAt[s] = _updatedAt;
+    m_offset[s] = position;
+    m_length[s] = _length;
+    m_direction[s] = _direction;
+    m_count++;
+
+    return m_arena.isEmpty() ? nullptr : m_arena.data() + (position & (m_arena.size() - 1));
+}
+
+bool HistoryStore::canExtendLast(int _length) const
+{
+    if (m_count == 0 || m_arena.isEmpty())
+        return false;
+
+    // the row is moved if it has to, it only has to fit
+    return m_length.at(slot(m_count - 1)) + qint64(_length) <= m_maxArenaSize;
+}
+
+void HistoryStore::extendLast(qint64 _timestamp, const char *_data, int _length)
+{
+    const auto destination = extendLast(_timestamp, _length);
+    if (_length > 0)
+        memcpy(destination, _data, size_t(_length));
+}
+
+char *HistoryStore::extendLast(qint64 _timestamp, int _length)
+{
+    Q_ASSERT(canExtendLast(_length));
+
+    // the row stays contiguous: it moves to the start of the arena rather than wrap
+    const auto s = slot(m_count - 1);
+    const auto position = lastRowPosition(m_arena.size(), _length);
+    if (position != m_offset.at(s)) {
+        memcpy(m_arena.data(), m_arena.constData() + (m_offset.at(s) & (m_arena.size() - 1)), size_t(m_length.at(s)));
+        if (m_count == 1)
+            m_arenaHead = position;
+        m_offset[s] = position;
+        m_arenaTail = position + m_length.at(s);
+    }
+    Q_ASSERT(m_arenaTail + _length - m_arenaHead <= m_arena.size());
+
+    const auto destination = m_arena.data() + (m_arenaTail & (m_arena.size() - 1));
+    m_arenaTail += _length;
+    m_length[s] += _length;
+    m_updatedAt[s] = _timestamp;
+    return destination;
+}
+
+void HistoryStore::removeFirst(int _count)
+{
+    _count = std::min(_count, m_count);
+    if (_count <= 0)
+        return;
+
+    m_first = slot(_count);
+    m_count -= _count;
+    m_firstSerial += _count;
+
+    if (m_count == 0) {
+        m_first = 0;
+        m_arenaHead = m_arenaTail;
+    } else {
+        m_arenaHead = m_offset.at(m_first);
+    }
+}
+
+qint64 HistoryStore::arenaSize() const
+{
+    return m_arena.size();
+}
+
+qint64 HistoryStore::maxArenaSize() const
+{
+    return m_maxArenaSize;
+}
+
+void HistoryStore::setMaxArenaSize(qint64 _bytes)
+{
+    // the arena only grows by doubling, and a QByteArray holds less than 2 GiB
+    auto size = MIN_ARENA_SIZE;
+    while (size * 2 <= std::min<qint64>(_bytes, MAX_ARENA_SIZE))
+        size *= 2;
+    m_maxArenaSize = size;
+}
+
+qint64 HistoryStore::memoryUsage() const
+{
+    constexpr auto bytesPerRow = sizeof(qint64) * 3 + sizeof(int) + sizeof(quint8);
+    return qint64(capacity() * bytesPerRow) + m_arena.size();
+}
+
+int HistoryStore::slot(int _row) const
+{
+    Q_ASSERT(_row >= 0 && _row <= m_count);
+    auto s = m_first + _row;
+    if (s >= capacity())
+        s -= capacity();
+    return s;
+}
+
+qint64 HistoryStore::usedBytes() const
+{
+    return m_arenaTail - m_arenaHead;
+}
+
+qint64 HistoryStore::appendPosition(int _length) const
+{
+    const auto physical = m_arenaTail & (m_arena.size() - 1);
+    if (physical + _length > m_arena.size())
+        return m_arenaTail + (m_arena.size() - physical);
+    return m_arenaTail;
+}
+
+qint64 HistoryStore::lastRowPosition(qint64 _arenaSize, int _extendLast) const
+{
+    const auto s = slot(m_count - 1);
+    const auto physical = m_offset.at(s) & (_arenaSize - 1);
+    if (physical + m_length.at(s) + _extendLast <= _arenaSize)
+        return m_offset.at(s);
+    return m_offset.at(s) + _arenaSize - physical; // the start of the next lap
+}
+
+void HistoryStore::growArena(qint64 _size)
+{
+    Q_ASSERT((_size & (_size - 1)) == 0);
+
+    // never past the budget, and never smaller, the rows have to fit
+    _size = std::min(_size, m_maxArenaSize);
+    if (_size <= m_arena.size())
+        return;
+
+    QByteArray arena(int(_size), Qt::Uninitialized);
+
+    // rows never cross a multiple of the old size, so they don't cross one of the new size either
+    if (!m_arena.isEmpty()) {
+        const auto oldSize = qint64(m_arena.size());
+        auto position = m_arenaHead;
+        while (position < m_arenaTail) {
+            const auto end = std::min(m_arenaTail, (position / oldSize + 1) * oldSize);
+            memcpy(arena.data() + (position & (_size - 1)), m_arena.constData() + (position & (oldSize - 1)), size_t(end - position));
+            position = end;
+        }
+    }
+
+    m_arena.swap(arena);
+}
@@ -0,0 +1,82 @@
+#ifndef HISTORYSTORE_H
+#define HISTORYSTORE_H
+
+#include <QVector>
+#include <QByteArray>
+
+// Fixed-capacity circular row storage, kept as columns (structure of arrays).
+// Row payloads live in one shared byte arena, itself a ring addressed by logical
+// offsets, so evicting the oldest rows only moves two indices.
+// Every row is contiguous in the arena: a row that would cross the physical end
+// starts at offset 0 instead, the skipped tail is reclaimed with the oldest rows.
+// The newest row growing across the end is moved to offset 0 whole, so where the
+// arena wraps never splits a row. The arena grows up to maxArenaSize().
+// Copies are cheap (implicitly shared), a copy is a consistent snapshot.
+class HistoryStore
+{
+public:
+    explicit HistoryStore(int _capacity = 0);
+
+    int count() const;
+    int capacity() const;
+    void setCapacity(int _capacity); // keeps the newest rows
+    void clear();
+
+    // row 0 is the oldest one
+    qint64 serial(int _row) const; // running row number since clear()
+    void setFirstSerial(qint64 _serial); // an empty store continues rows kept elsewhere
+    quint8 direction(int _row) const;
+    qint64 createdAt(int _row) const; // timestamps as given to append(), the model uses the capture clock
+    qint64 updatedAt(int _row) const;
+    const char *data(int _row) const;
+    int length(int _row) const;
+
+    // Makes room for _extendLast bytes appended to the newest row followed by _rows new rows
+    // of the given lengths, growing the arena up to its limit. Returns how many of the oldest
+    // rows must be removed (removeFirst) before writing.
+    int reserve(const int *_lengths, int _rows, int _extendLast = 0);
+
+    // The caller must have reserve()d the bytes and made room for the row.
+    // The overloads without _data return where the _length bytes go, for callers that
+    // gather a row from several pieces; the pointer is valid until the next change.
+    void append(quint8 _direction, qint64 _createdAt, qint64 _updatedAt, const char *_data, int _length);
+    char *append(quint8 _direction, qint64 _createdAt, qint64 _updatedAt, int _length);
+    bool canExtendLast(int _length) const; // the row would still fit into the largest arena
+    void extendLast(qint64 _timestamp, const char *_data, int _length);
+    char *extendLast(qint64 _timestamp, int _length);
+    void removeFirst(int _count);
+
+    qint64 arenaSize() const;
+    qint64 maxArenaSize() const; // a power of two
+    void setMaxArenaSize(qint64 _bytes); // rounded down to a power of two, applies as the arena grows
+    qint64 memoryUsage() const;
+
+private:
+    int slot(int _row) const;
+    qint64 usedBytes() const;
+    qint64 appendPosition(int _length) const;
+    qint64 lastRowPosition(qint64 _arenaSize, int _extendLast) const; // where extendLast() leaves the newest row
+    void growArena(qint64 _size);
+
+private:
+    static constexpr qint64 MIN_ARENA_SIZE = 64 * 1024;
+    static constexpr qint64 MAX_ARENA_SIZE = 1024 * 1024 * 1024;
+
+    int m_first {};  // slot of the oldest row
+    int m_count {};
+    qint64 m_firstSerial {};
+
+    // columns, indexed by slot
+    QVector<qint64> m_createdAt {};
+    QVector<qint64> m_updatedAt {};
+    QVector<qint64> m_offset {}; // logical arena offset
+    QVector<int> m_length {};
+    QVector<quint8> m_direction {};
+
+    QByteArray m_arena {};
+    qint64 m_arenaHead {}; // logical offset of the oldest row
+    qint64 m_arenaTail {}; // logical offset after the newest row
+    qint64 m_maxArenaSize {256 * 1024 * 1024};
+};
+
+#endif // HISTORYSTORE_H
@@ -0,0 +1,181 @@
+#include "bytesearch.h"
+#include <cstring>
+#include <cstdint>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BYTESEARCH_X86
+#define BYTESEARCH_TARGET(name) __attribute__((target(name)))
+#include <immintrin.h>
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define BYTESEARCH_X86
+#define BYTESEARCH_TARGET(name)
+#include <immintrin.h>
+#include <intrin.h>
+#endif
+
+#include "cpufeatures.h"
+
+namespace bytesearch {
+
+namespace {
+
+// the needle is at least 2 bytes long in the kernels, shorter ones go to memchr()
+const char *findScalar(const char *_haystack, size_t _length, const char *_needle, size_t _needleLength)
+{
+    if (_length < _needleLength)
+        return nullptr;
+
+    const auto first = _needle[0];
+    const auto end = _haystack + _length - _needleLength + 1;
+
+    auto candidate = _haystack;
+    while (candidate < end) {
+        candidate = static_cast<const char *>(memchr(candidate, first, size_t(end - candidate)));
+        if (!candidate)
+            return nullptr;
+        if (memcmp(candidate + 1, _needle + 1, _needleLength - 1) == 0)
+            return candidate;
+        candidate++;
+    }
+    return nullptr;
+}
+
+#ifdef BYTESEARCH_X86
+
+inline int lowestBit(uint32_t _mask)
+{
+#if defined(__GNUC__)
+    return __builtin_ctz(_mask);
+#else
+    unsigned long index {};
+    _BitScanForward(&index, _mask);
+    return int(index);
+#endif
+}
+
+BYTESEARCH_TARGET("sse2")
+const char *findSse2(const char *_haystack, size_t _length, const char *_needle, size_t _needleLength)
+{
+    const __m128i first = _mm_set1_epi8(_needle[0]);
+    const __m128i last = _mm_set1_epi8(_needle[_needleLength - 1]);
+
+    // i is the candidate start, the last byte of the needle sits _needleLength - 1 bytes later
+    size_t i = 0;
+    for (; i + _needleLength - 1 + 16 <= _length; i += 16) {
+        const __m128i blockFirst = _mm_loadu_si128(reinterpret_cast<const __m128i *>(_haystack + i));
+        const __m128i blockLast = _mm_loadu_si128(reinterpret_cast<const __m128i *>(_haystack + i + _needleLength - 1));
+        const __m128i eq = _mm_and_si128(_mm_cmpeq_epi8(first, blockFirst), _mm_cmpeq_epi8(last, blockLast));
+
+        auto mask = uint32_t(_mm_movemask_epi8(eq));
+        while (mask != 0) {
+            const auto bit = lowestBit(mask);
+            if (memcmp(_haystack + i + bit + 1, _needle + 1, _needleLength - 2) == 0)
+                return _haystack + i + bit;
+            mask &= mask - 1;
+        }
+    }
+
+    return findScalar(_haystack + i, _length - i, _needle, _needleLength);
+}
+
+BYTESEARCH_TARGET("avx2")
+const char *findAvx2(const char *_haystack, size_t _length, const char *_needle, size_t _needleLength)
+{
+    const __m256i first = _mm256_set1_epi8(_needle[0]);
+    const __m256i last = _mm256_set1_epi8(_needle[_needleLength - 1]);
+
+    size_t i = 0;
+    for (; i + _needleLength - 1 + 32 <= _length; i += 32) {
+        const __m256i blockFirst = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(_haystack + i));
+        const __m256i blockLast = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(_haystack + i + _needleLength - 1));
+        const __m256i eq = _mm256_and_si256(_mm256_cmpeq_epi8(first, blockFirst), _mm256_cmpeq_epi8(last, blockLast));
+
+        auto mask = uint32_t(_mm256_movemask_epi8(eq));
+        while (mask != 0) {
+            const auto bit = lowestBit(mask);
+            if (memcmp(_haystack + i + bit + 1, _needle + 1, _needleLength - 2) == 0)
+                return _haystack + i + bit;
+            mask &= mask - 1;
+        }
+    }
+
+    return findSse2(_haystack + i, _length - i, _needle, _needleLength);
+}
+
+#endif // BYTESEARCH_X86
+
+using FindFunction = const char *(*)(const char *, size_t, const char *, size_t);
+
+FindFunction findFunction(Kernel _kernel)
+{
+    if (_kernel == Kernel::Auto || !isSupported(_kernel))
+        _kernel = bestKernel();
+
+    switch (_kernel) {
+#ifdef BYTESEARCH_X86
+    case Kernel::Avx2:
+        return &findAvx2;
+    case Kernel::Sse:
+        return &findSse2;
+#endif
+    default:
+        return &findScalar;
+    }
+}
+
+} // namespace
+
+const char *find(const char *_haystack, size_t _length, const char *_needle, size_t _needleLength, Kernel _kernel)
+{
+    if (_needleLength == 0)
+        return _haystack;
+    if (_needleLength > _length)
+        return nullptr;
+    if (_needleLength == 1)
+        return static_cast<const char *>(memchr(_haystack, _needle[0], _length));
+
+    return findFunction(_kernel)(_haystack, _length, _needle, _needleLength);
+}
+
+bool isSupported(Kernel _kernel)
+{
+    switch (_kernel) {
+    case Kernel::Scalar:
+    case Kernel::Auto:
+        return true;
+#ifdef BYTESEARCH_X86
+    case Kernel::Sse:
+        return cpufeatures::hasSse2();
+    case Kernel::Avx2:
+        return cpufeatures::hasAvx2();
+#endif
+    default:
+        return false;
+    }
+}
+
+Kernel bestKernel()
+{
+    if (isSupported(Kernel::Avx2))
+        return Kernel::Avx2;
+    if (isSupported(Kernel::Sse))
+        return Kernel::Sse;
+    return Kernel::Scalar;
+}
+
+const char *toString(Kernel _kernel)
+{
+    switch (_kernel) {
+    case Kernel::Scalar:
+        return "scalar";
+    case Kernel::Sse:
+        return "sse";
+    case Kernel::Avx2:
+        return "avx2";
+    case Kernel::Auto:
+        return "auto";
+    }
+    return "invalid";
+}
+
+} // namespace bytesearch
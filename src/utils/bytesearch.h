@@ -0,0 +1,30 @@
+#ifndef BYTESEARCH_H
+#define BYTESEARCH_H
+
+#include <cstddef>
+
+// Substring search over raw bytes.
+//
+// The vector kernels compare the first and the last byte of the needle against
+// a whole register of candidate positions at once and only memcmp() the positions
+// where both match, which skips most of the haystack at 16 or 32 bytes per step.
+// The kernels keep no state and are thread-safe.
+namespace bytesearch {
+
+enum class Kernel {
+    Scalar,
+    Sse, // SSE2
+    Avx2,
+    Auto // best one the CPU supports
+};
+
+// first occurrence of _needle, or nullptr; an empty needle matches at _haystack
+const char *find(const char *_haystack, size_t _length, const char *_needle, size_t _needleLength, Kernel _kernel = Kernel::Auto);
+
+bool isSupported(Kernel _kernel);
+Kernel bestKernel();
+const char *toString(Kernel _kernel);
+
+} // namespace bytesearch
+
+#endif // BYTESEARCH_H
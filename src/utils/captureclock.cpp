@@ -0,0 +1,55 @@
+#include "captureclock.h"
+#include <QElapsedTimer>
+#include <QDateTime>
+
+namespace captureclock {
+
+namespace {
+
+struct Origin {
+    Origin()
+    {
+        timer.start();
+        wallClockMs = QDateTime::currentMSecsSinceEpoch();
+    }
+
+    QElapsedTimer timer;
+    qint64 wallClockMs;
+};
+
+const Origin &origin()
+{
+    static const Origin instance {};
+    return instance;
+}
+
+} // namespace
+
+qint64 now()
+{
+    return origin().timer.nsecsElapsed();
+}
+
+qint64 toMSecsSinceEpoch(qint64 _timestamp)
+{
+    return origin().wallClockMs + _timestamp / 1000000;
+}
+
+qint64 toNSecsSinceEpoch(qint64 _timestamp)
+{
+    return origin().wallClockMs * 1000000 + _timestamp;
+}
+
+qint64 fromMSecsSinceEpoch(qint64 _msecs)
+{
+    return (_msecs - origin().wallClockMs) * 1000000;
+}
+
+qint64 byteDuration(qint32 _baudRate, int _bitsPerByte)
+{
+    if (_baudRate <= 0)
+        return 0;
+    return qint64(_bitsPerByte) * 1000000000 / _baudRate;
+}
+
+} // namespace captureclock
@@ -0,0 +1,21 @@
+#ifndef CAPTURECLOCK_H
+#define CAPTURECLOCK_H
+
+#include <QtGlobal>
+
+// Monotonic capture time in nanoseconds, shared by every reader.
+// The wall-clock time is sampled once, together with the monotonic origin,
+// so converting a capture timestamp for display never goes backwards.
+namespace captureclock {
+
+qint64 now();
+qint64 toMSecsSinceEpoch(qint64 _timestamp);
+qint64 toNSecsSinceEpoch(qint64 _timestamp);
+qint64 fromMSecsSinceEpoch(qint64 _msecs);
+
+// duration of one character on the wire: start bit, data bits, parity and stop bits
+qint64 byteDuration(qint32 _baudRate, int _bitsPerByte = 10);
+
+} // namespace captureclock
+
+#endif // CAPTURECLOCK_H
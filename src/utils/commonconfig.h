@@ -2,5 +2,6 @@
 #define COMMONCONFIG_H
 
 #define TIME_FORMAT "HH:mm:ss.zzz"
+#define CAPTURE_FILE_FILTER "Serial Spy capture (*.ssidx)"
 
 #endif // COMMONCONFIG_H
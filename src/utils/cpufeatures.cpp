@@ -0,0 +1,80 @@
+#include "cpufeatures.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CPUFEATURES_X86
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define CPUFEATURES_X86
+#include <immintrin.h>
+#include <intrin.h>
+#endif
+
+namespace cpufeatures {
+
+namespace {
+
+#ifdef CPUFEATURES_X86
+
+bool querySse2()
+{
+#if defined(__GNUC__)
+    return __builtin_cpu_supports("sse2");
+#else
+    int info[4] {};
+    __cpuid(info, 1);
+    return info[3] & (1 << 26);
+#endif
+}
+
+bool querySsse3()
+{
+#if defined(__GNUC__)
+    return __builtin_cpu_supports("ssse3");
+#else
+    int info[4] {};
+    __cpuid(info, 1);
+    return info[2] & (1 << 9);
+#endif
+}
+
+bool queryAvx2()
+{
+#if defined(__GNUC__)
+    return __builtin_cpu_supports("avx2");
+#else
+    int info[4] {};
+    __cpuid(info, 1);
+    const bool osSavesYmm = (info[2] & (1 << 27)) && (_xgetbv(0) & 0x6) == 0x6;
+    __cpuidex(info, 7, 0);
+    return osSavesYmm && (info[1] & (1 << 5));
+#endif
+}
+
+#else
+
+bool querySse2() { return false; }
+bool querySsse3() { return false; }
+bool queryAvx2() { return false; }
+
+#endif // CPUFEATURES_X86
+
+} // namespace
+
+bool hasSse2()
+{
+    static const bool supported = querySse2();
+    return supported;
+}
+
+bool hasSsse3()
+{
+    static const bool supported = querySsse3();
+    return supported;
+}
+
+bool hasAvx2()
+{
+    static const bool supported = queryAvx2();
+    return supported;
+}
+
+} // namespace cpufeatures
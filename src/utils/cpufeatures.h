@@ -0,0 +1,14 @@
+#ifndef CPUFEATURES_H
+#define CPUFEATURES_H
+
+// The x86 instruction set extensions the SIMD kernels dispatch on, asked once per
+// process. Everything is false on other architectures.
+namespace cpufeatures {
+
+bool hasSse2();
+bool hasSsse3();
+bool hasAvx2(); // and the OS saves the YMM registers
+
+} // namespace cpufeatures
+
+#endif // CPUFEATURES_H
@@ -0,0 +1,412 @@
+#include "framedecoder.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+// RFC 1055, frames end with END, END and ESC inside a frame are escaped
+class SlipDecoder : public FrameDecoder
+{
+public:
+    QString name() const override
+    {
+        return "slip";
+    }
+
+    void decode(const char *_data, int _length, qint64 _gap, QVector<int> *_frameStarts) override
+    {
+        Q_UNUSED(_gap)
+
+        for (int i = 0; i < _length; ++i) {
+            const auto byte = quint8(_data[i]);
+            if (byte == END) {
+                // ENDs in a row are padding, they stay on the row of the previous frame
+                if (m_length > 0) {
+                    countFrame(!m_error && !m_escaped);
+                    m_startPending = true;
+                }
+                m_length = 0;
+                m_escaped = false;
+                m_error = false;
+                continue;
+            }
+
+            if (m_startPending) {
+                _frameStarts->append(i);
+                m_startPending = false;
+            }
+            m_length++;
+
+            if (m_escaped) {
+                m_error |= byte != ESC_END && byte != ESC_ESC;
+                m_escaped = false;
+            } else if (byte == ESC) {
+                m_escaped = true;
+            }
+        }
+    }
+
+private:
+    static constexpr quint8 END = 0xC0;
+    static constexpr quint8 ESC = 0xDB;
+    static constexpr quint8 ESC_END = 0xDC;
+    static constexpr quint8 ESC_ESC = 0xDD;
+
+    bool m_startPending {true};
+    int m_length {};
+    bool m_escaped {};
+    bool m_error {};
+};
+
+// consistent overhead byte stuffing, frames end with a zero byte; only the code
+// bytes are looked at, the data bytes between them are skipped
+class CobsDecoder : public FrameDecoder
+{
+public:
+    QString name() const override
+    {
+        return "cobs";
+    }
+
+    void decode(const char *_data, int _length, qint64 _gap, QVector<int> *_frameStarts) override
+    {
+        Q_UNUSED(_gap)
+
+        int i = 0;
+        while (i < _length) {
+            const auto zero = static_cast<const char *>(memchr(_data + i, 0, size_t(_length - i)));
+            const auto end = zero ? int(zero - _data) : _length;
+
+            if (i < end) {
+                if (m_startPending) {
+                    _frameStarts->append(i);
+                    m_startPending = false;
+                }
+                m_inFrame = true;
+            }
+
+            while (i < end) {
+                if (m_untilCode == 0) {
+                    m_untilCode = quint8(_data[i]) - 1;
+                    ++i;
+                } else {
+                    const auto skipped = std::min(m_untilCode, end - i);
+                    m_untilCode -= skipped;
+                    i += skipped;
+                }
+            }
+
+            if (!zero)
+                break;
+
+            // zeros in a row are padding, like SLIP's ENDs; a frame has to end on a code byte
+            if (m_inFrame) {
+                countFrame(m_untilCode == 0);
+                m_startPending = true;
+            }
+            m_inFrame = false;
+            m_untilCode = 0;
+            i = end + 1;
+        }
+    }
+
+private:
+    bool m_startPending {true};
+    bool m_inFrame {};
+    int m_untilCode {}; // data bytes before the next code byte
+};
+
+// Modbus RTU, frames are separated by 3.5 characters of silence and end with a CRC.
+// The port dates reads, not bytes, so a silence is only seen in front of a read. Frames
+// the driver buffered back to back are split after a correct CRC instead. A frame's own
+// bytes fake one about once in 65536 positions, the frames after it then run together
+// until the next silence. A frame is checked once the next one starts.
+class ModbusRtuDecoder : public FrameDecoder
+{
+public:
+    QString name() const override
+    {
+        return "modbus-rtu";
+    }
+
+    void setCharacterTime(qint64 _ns) override
+    {
+        // the specification fixes 1.75 ms above 19200 baud
+        m_silence = std::max<qint64>(_ns * 7 / 2, 1750000);
+    }
+
+    void decode(const char *_data, int _length, qint64 _gap, QVector<int> *_frameStarts) override
+    {
+        if (m_length == 0 || _gap >= m_silence || frameComplete()) {
+            if (m_length > 0)
+                countFrame(frameComplete());
+            _frameStarts->append(0);
+            m_length = 0;
+            m_crc = 0xFFFF;
+        }
+
+        // a frame followed by its CRC, low byte first, has a CRC of 0
+        const auto table = crcTable().values;
+        for (int i = 0; i < _length; ++i) {
+            m_crc = quint16((m_crc >> 8) ^ table[(m_crc ^ quint8(_data[i])) & 0xFF]);
+            m_length = std::min(m_length + 1, MAX_FRAME + 1);
+
+            // frames the driver buffered back to back
+            if (frameComplete() && i + 1 < _length) {
+                countFrame(true);
+                _frameStarts->append(i + 1);
+                m_length = 0;
+                m_crc = 0xFFFF;
+            }
+        }
+    }
+
+private:
+    bool frameComplete() const
+    {
+        return m_length >= MIN_FRAME && m_length <= MAX_FRAME && m_crc == 0;
+    }
+
+    struct CrcTable {
+        CrcTable()
+        {
+            for (int i = 0; i < 256; ++i) {
+                quint16 crc = quint16(i);
+                for (int bit = 0; bit < 8; ++bit)
+                    crc = (crc & 1) ? quint16((crc >> 1) ^ 0xA001) : quint16(crc >> 1);
+                values[i] = crc;
+            }
+        }
+        quint16 values[256];
+    };
+
+    static const CrcTable &crcTable()
+    {
+        static const CrcTable table {};
+        return table;
+    }
+
+    static constexpr int MIN_FRAME = 4; // address, function and CRC
+    static constexpr int MAX_FRAME = 256;
+
+    qint64 m_silence {1750000}; // ns
+    int m_length {};
+    quint16 m_crc {0xFFFF};
+};
+
+// A header holding the length of the frame. The frame is header + length + adjust
+// bytes long, a length out of range makes the header a frame of its own, counted
+// as an error, and the search starts over after it.
+class LengthPrefixDecoder : public FrameDecoder
+{
+public:
+    struct Options {
+        int size {1}; // bytes of the length field, 1, 2 or 4
+        int offset {}; // of the length field in the header
+        bool bigEndian {true};
+        int header {-1}; // bytes, -1 for the end of the length field
+        int adjust {}; // added to the length
+        int max {65536}; // longest valid frame, header included
+    };
+
+    static FrameDecoder *create(const QString &_options, QString *_error)
+    {
+        Options options {};
+        for (const auto &option : _options.split(',', Qt::SkipEmptyParts)) {
+            const auto key = option.section('=', 0, 0).trimmed();
+            const auto value = option.section('=', 1).trimmed();
+            bool ok = true;
+            if (key == "size")
+                options.size = value.toInt(&ok);
+            else if (key == "offset")
+                options.offset = value.toInt(&ok);
+            else if (key == "endian") {
+                options.bigEndian = value == "big";
+                ok = options.bigEndian || value == "little";
+            } else if (key == "header")
+                options.header = value.toInt(&ok);
+            else if (key == "adjust")
+                options.adjust = value.toInt(&ok);
+            else if (key == "max")
+                options.max = value.toInt(&ok);
+            else
+                ok = false;
+
+            if (!ok) {
+                *_error = QString("invalid length decoder option \"%1\"").arg(option);
+                return nullptr;
+            }
+        }
+
+        const auto lengthEnd = options.offset + options.size;
+        if (options.header < 0)
+            options.header = lengthEnd;
+        if ((options.size != 1 && options.size != 2 && options.size != 4) || options.offset < 0 || lengthEnd > MAX_LENGTH_END
+                || options.header < lengthEnd || options.max <= 0) {
+            *_error = QString("invalid length decoder options \"%1\"").arg(_options);
+            return nullptr;
+        }
+        return new LengthPrefixDecoder(options);
+    }
+
+    QString name() const override
+    {
+        return "length";
+    }
+
+    void decode(const char *_data, int _length, qint64 _gap, QVector<int> *_frameStarts) override
+    {
+        Q_UNUSED(_gap)
+
+        int i = 0;
+        while (i < _length) {
+            if (m_frameLength == 0)
+                _frameStarts->append(i);
+
+            if (m_frameLength < m_options.header) {
+                const auto count = std::min(m_options.header - m_frameLength, _length - i);
+                const auto kept = std::max(0, std::min(count, MAX_LENGTH_END - m_frameLength));
+                memcpy(m_header + m_frameLength, _data + i, size_t(kept));
+                m_frameLength += count;
+                i += count;
+                if (m_frameLength < m_options.header)
+                    continue; // the rest comes with the next read
+
+                const auto frameLength = qint64(m_options.header) + lengthField() + m_options.adjust;
+                if (frameLength < m_options.header || frameLength > m_options.max) {
+                    countFrame(false);
+                    m_frameLength = 0;
+                    continue;
+                }
+                m_remaining = int(frameLength - m_options.header);
+            } else {
+                const auto count = std::min(m_remaining, _length - i);
+                m_remaining -= count;
+                m_frameLength += count;
+                i += count;
+            }
+
+            if (m_remaining == 0) {
+                countFrame(true);
+                m_frameLength = 0;
+            }
+        }
+    }
+
+private:
+    explicit LengthPrefixDecoder(const Options &_options)
+        : m_options(_options)
+    {
+    }
+
+    quint32 lengthField() const
+    {
+        quint32 value = 0;
+        for (int i = 0; i < m_options.size; ++i) {
+            const auto byte = quint8(m_header[m_options.offset + (m_options.bigEndian ? i : m_options.size - 1 - i)]);
+            value = (value << 8) | byte;
+        }
+        return value;
+    }
+
+    static constexpr int MAX_LENGTH_END = 16;
+
+    const Options m_options;
+    char m_header[MAX_LENGTH_END] {};
+    int m_frameLength {}; // bytes of the current frame so far
+    int m_remaining {}; // after the header
+};
+
+struct Registration {
+    QString name;
+    FrameDecoder::Factory factory;
+};
+
+template<typename Decoder>
+FrameDecoder *createWithoutOptions(const QString &_name, const QString &_options, QString *_error)
+{
+    if (!_options.isEmpty()) {
+        *_error = QString("the %1 decoder has no options").arg(_name);
+        return nullptr;
+    }
+    return new Decoder();
+}
+
+// GUI thread only
+QVector<Registration> &registry()
+{
+    static QVector<Registration> registrations {
+        {"slip", [](const QString &_options, QString *_error) { return createWithoutOptions<SlipDecoder>("slip", _options, _error); }},
+        {"cobs", [](const QString &_options, QString *_error) { return createWithoutOptions<CobsDecoder>("cobs", _options, _error); }},
+        {"modbus-rtu", [](const QString &_options, QString *_error) { return createWithoutOptions<ModbusRtuDecoder>("modbus-rtu", _options, _error); }},
+        {"length", &LengthPrefixDecoder::create},
+    };
+    return registrations;
+}
+
+} // namespace
+
+void FrameDecoder::setCharacterTime(qint64 _ns)
+{
+    Q_UNUSED(_ns)
+}
+
+FrameDecoder::Stats FrameDecoder::takeStats()
+{
+    const quint64 frames = m_frames;
+    const quint64 errors = m_errors;
+    const Stats stats {frames - m_takenFrames, errors - m_takenErrors, frames, errors};
+    m_takenFrames = frames;
+    m_takenErrors = errors;
+    return stats;
+}
+
+FrameDecoder *FrameDecoder::create(const QString &_spec, QString *_error)
+{
+    QString error {};
+    const auto name = _spec.section(':', 0, 0).trimmed().toLower();
+    const auto options = _spec.section(':', 1).trimmed();
+
+    FrameDecoder *decoder = nullptr;
+    if (!name.isEmpty() && name != "none") {
+        const auto &registrations = registry();
+        const auto it = std::find_if(registrations.cbegin(), registrations.cend(), [&](const Registration &_registration) {
+            return _registration.name == name;
+        });
+        if (it == registrations.cend())
+            error = QString("unknown frame decoder \"%1\"").arg(name);
+        else
+            decoder = it->factory(options, &error);
+    }
+
+    if (_error)
+        *_error = error;
+    return decoder;
+}
+
+void FrameDecoder::registerDecoder(const QString &_name, const Factory &_factory)
+{
+    auto &registrations = registry();
+    for (auto &registration : registrations) {
+        if (registration.name == _name) {
+            registration.factory = _factory;
+            return;
+        }
+    }
+    registrations.append(Registration {_name, _factory});
+}
+
+QStringList FrameDecoder::names()
+{
+    QStringList names {};
+    for (const auto &registration : qAsConst(registry()))
+        names.append(registration.name);
+    return names;
+}
+
+void FrameDecoder::countFrame(bool _valid)
+{
+    m_frames.fetch_add(1, std::memory_order_relaxed);
+    if (!_valid)
+        m_errors.fetch_add(1, std::memory_order_relaxed);
+}
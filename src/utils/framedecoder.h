@@ -0,0 +1,59 @@
+#ifndef FRAMEDECODER_H
+#define FRAMEDECODER_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <atomic>
+#include <functional>
+
+// Finds the frames of a framing protocol in a received byte stream, so the history
+// shows one row per frame. A decoder belongs to one port and runs on its reader
+// thread: decode() sees every read in order and must neither block nor allocate.
+// The rows keep the bytes as they were on the wire, delimiters and escapes included.
+//
+// Decoders are created by name, "slip", "cobs", "modbus-rtu" and "length" are built in,
+// more can be registered. Options follow the name: "length:size=2,endian=little".
+class FrameDecoder
+{
+public:
+    struct Stats {
+        quint64 frames; // since the last takeStats()
+        quint64 errors;
+        quint64 totalFrames;
+        quint64 totalErrors;
+    };
+
+    // _options is what follows the ':' of the spec, empty without one
+    using Factory = std::function<FrameDecoder *(const QString &_options, QString *_error)>;
+
+    virtual ~FrameDecoder() = default;
+
+    virtual QString name() const = 0;
+
+    // time of one character on the wire at the current port settings, ns
+    virtual void setCharacterTime(qint64 _ns);
+
+    // Appends to _frameStarts the offsets of _data where a frame starts, 0 if _data
+    // starts one. _gap is how long the line was idle before _data[0], ns.
+    virtual void decode(const char *_data, int _length, qint64 _gap, QVector<int> *_frameStarts) = 0;
+
+    // thread-safe, for the GUI
+    Stats takeStats();
+
+    // nullptr and *_error set for an unknown name or bad options
+    static FrameDecoder *create(const QString &_spec, QString *_error = nullptr);
+    static void registerDecoder(const QString &_name, const Factory &_factory);
+    static QStringList names();
+
+protected:
+    void countFrame(bool _valid); // reader thread, once per complete frame
+
+private:
+    std::atomic<quint64> m_frames {0};
+    std::atomic<quint64> m_errors {0};
+    quint64 m_takenFrames {}; // takeStats() only
+    quint64 m_takenErrors {};
+};
+
+#endif // FRAMEDECODER_H
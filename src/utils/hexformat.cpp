@@ -0,0 +1,353 @@
+#include "hexformat.h"
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HEXFORMAT_X86
+#define HEXFORMAT_TARGET(name) __attribute__((target(name)))
+#include <immintrin.h>
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define HEXFORMAT_X86
+#define HEXFORMAT_TARGET(name)
+#include <immintrin.h>
+#include <intrin.h>
+#endif
+
+#include "cpufeatures.h"
+
+namespace hexformat {
+
+namespace {
+
+constexpr int GROUP_SIZE = 8;
+constexpr int GROUP_STRIDE = GROUP_SIZE * 3 + 1; // "XX " per byte and the group separator
+
+// "XX" for every byte value
+struct HexPairs {
+    HexPairs()
+    {
+        const char *const digits = "0123456789ABCDEF";
+        for (int i = 0; i < 256; ++i) {
+            pairs[i][0] = digits[i >> 4];
+            pairs[i][1] = digits[i & 0x0F];
+        }
+    }
+    char pairs[256][2];
+};
+
+const HexPairs &hexPairs()
+{
+    static const HexPairs table {};
+    return table;
+}
+
+inline char printableOrDot(uint8_t _c)
+{
+    return (_c >= 32 && _c < 127) ? char(_c) : '.';
+}
+
+// writes _count bytes as "XX "
+void hexBytesScalar(const uint8_t *_in, int _count, char *_out)
+{
+    const auto &table = hexPairs();
+    for (int i = 0; i < _count; ++i) {
+        _out[0] = table.pairs[_in[i]][0];
+        _out[1] = table.pairs[_in[i]][1];
+        _out[2] = ' ';
+        _out += 3;
+    }
+}
+
+// writes _groups full groups of 8 bytes, GROUP_STRIDE apart, separators excluded
+void hexGroupsScalar(const uint8_t *_in, int _groups, char *_out)
+{
+    for (int g = 0; g < _groups; ++g)
+        hexBytesScalar(_in + g * GROUP_SIZE, GROUP_SIZE, _out + g * GROUP_STRIDE);
+}
+
+void asciiScalar(const uint8_t *_in, int _count, char *_out)
+{
+    for (int i = 0; i < _count; ++i)
+        _out[i] = printableOrDot(_in[i]);
+}
+
+#ifdef HEXFORMAT_X86
+
+// _hex holds 16 hex digits of 8 bytes, spread them to "XX XX .. XX " (24 chars)
+HEXFORMAT_TARGET("ssse3")
+inline void storeHexGroup(__m128i _hex, char *_out)
+{
+    const __m128i spread0 = _mm_setr_epi8(0, 1, -128, 2, 3, -128, 4, 5, -128, 6, 7, -128, 8, 9, -128, 10);
+    const __m128i spread1 = _mm_setr_epi8(11, -128, 12, 13, -128, 14, 15, -128, -128, -128, -128, -128, -128, -128, -128, -128);
+    const __m128i spaces0 = _mm_setr_epi8(0, 0, ' ', 0, 0, ' ', 0, 0, ' ', 0, 0, ' ', 0, 0, ' ', 0);
+    const __m128i spaces1 = _mm_setr_epi8(0, ' ', 0, 0, ' ', 0, 0, ' ', 0, 0, 0, 0, 0, 0, 0, 0);
+
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(_out), _mm_or_si128(_mm_shuffle_epi8(_hex, spread0), spaces0));
+    _mm_storel_epi64(reinterpret_cast<__m128i *>(_out + 16), _mm_or_si128(_mm_shuffle_epi8(_hex, spread1), spaces1));
+}
+
+HEXFORMAT_TARGET("ssse3")
+inline __m128i hexDigits(__m128i _nibbles)
+{
+    const __m128i digits = _mm_setr_epi8('0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F');
+    return _mm_shuffle_epi8(digits, _nibbles);
+}
+
+HEXFORMAT_TARGET("ssse3")
+void hexGroupsSsse3(const uint8_t *_in, int _groups, char *_out)
+{
+    const __m128i lowNibble = _mm_set1_epi8(0x0F);
+
+    int g = 0;
+    for (; g + 2 <= _groups; g += 2) {
+        const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(_in + g * GROUP_SIZE));
+        const __m128i hi = hexDigits(_mm_and_si128(_mm_srli_epi16(x, 4), lowNibble));
+        const __m128i lo = hexDigits(_mm_and_si128(x, lowNibble));
+        storeHexGroup(_mm_unpacklo_epi8(hi, lo), _out + g * GROUP_STRIDE);
+        storeHexGroup(_mm_unpackhi_epi8(hi, lo), _out + (g + 1) * GROUP_STRIDE);
+    }
+
+    if (g < _groups) {
+        const __m128i x = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(_in + g * GROUP_SIZE));
+        const __m128i hi = hexDigits(_mm_and_si128(_mm_srli_epi16(x, 4), lowNibble));
+        const __m128i lo = hexDigits(_mm_and_si128(x, lowNibble));
+        storeHexGroup(_mm_unpacklo_epi8(hi, lo), _out + g * GROUP_STRIDE);
+    }
+}
+
+HEXFORMAT_TARGET("avx2")
+void hexGroupsAvx2(const uint8_t *_in, int _groups, char *_out)
+{
+    const __m256i digits = _mm256_setr_epi8('0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F',
+                                            '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F');
+    const __m256i lowNibble = _mm256_set1_epi8(0x0F);
+
+    int g = 0;
+    for (; g + 4 <= _groups; g += 4) {
+        const __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(_in + g * GROUP_SIZE));
+        const __m256i hi = _mm256_shuffle_epi8(digits, _mm256_and_si256(_mm256_srli_epi16(x, 4), lowNibble));
+        const __m256i lo = _mm256_shuffle_epi8(digits, _mm256_and_si256(x, lowNibble));
+
+        // unpack works per 128-bit lane: the low one holds groups 0/1, the high one groups 2/3
+        const __m256i even = _mm256_unpacklo_epi8(hi, lo);
+        const __m256i odd = _mm256_unpackhi_epi8(hi, lo);
+        char *out = _out + g * GROUP_STRIDE;
+        storeHexGroup(_mm256_castsi256_si128(even), out);
+        storeHexGroup(_mm256_castsi256_si128(odd), out + GROUP_STRIDE);
+        storeHexGroup(_mm256_extracti128_si256(even, 1), out + 2 * GROUP_STRIDE);
+        storeHexGroup(_mm256_extracti128_si256(odd, 1), out + 3 * GROUP_STRIDE);
+    }
+
+    hexGroupsSsse3(_in + g * GROUP_SIZE, _groups - g, _out + g * GROUP_STRIDE);
+}
+
+HEXFORMAT_TARGET("sse2")
+void asciiSse2(const uint8_t *_in, int _count, char *_out)
+{
+    const __m128i belowPrintable = _mm_set1_epi8(31);
+    const __m128i del = _mm_set1_epi8(127);
+    const __m128i dots = _mm_set1_epi8('.');
+
+    int i = 0;
+    for (; i + 16 <= _count; i += 16) {
+        const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(_in + i));
+        // signed compare, bytes >= 0x80 are negative and fail the first test
+        const __m128i printable = _mm_and_si128(_mm_cmpgt_epi8(x, belowPrintable), _mm_cmplt_epi8(x, del));
+        const __m128i result = _mm_or_si128(_mm_and_si128(printable, x), _mm_andnot_si128(printable, dots));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(_out + i), result);
+    }
+
+    asciiScalar(_in + i, _count - i, _out + i);
+}
+
+HEXFORMAT_TARGET("avx2")
+void asciiAvx2(const uint8_t *_in, int _count, char *_out)
+{
+    const __m256i belowPrintable = _mm256_set1_epi8(31);
+    const __m256i del = _mm256_set1_epi8(127);
+    const __m256i dots = _mm256_set1_epi8('.');
+
+    int i = 0;
+    for (; i + 32 <= _count; i += 32) {
+        const __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(_in + i));
+        const __m256i printable = _mm256_and_si256(_mm256_cmpgt_epi8(x, belowPrintable), _mm256_cmpgt_epi8(del, x));
+        const __m256i result = _mm256_blendv_epi8(dots, x, printable);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(_out + i), result);
+    }
+
+    asciiSse2(_in + i, _count - i, _out + i);
+}
+
+#endif // HEXFORMAT_X86
+
+using HexGroupsFunction = void (*)(const uint8_t *, int, char *);
+using AsciiFunction = void (*)(const uint8_t *, int, char *);
+
+Kernel resolve(Kernel _kernel)
+{
+    if (_kernel == Kernel::Auto || !isSupported(_kernel))
+        return bestKernel();
+    return _kernel;
+}
+
+HexGroupsFunction hexGroupsFunction(Kernel _kernel)
+{
+    switch (resolve(_kernel)) {
+#ifdef HEXFORMAT_X86
+    case Kernel::Avx2:
+        return &hexGroupsAvx2;
+    case Kernel::Sse:
+        return &hexGroupsSsse3;
+#endif
+    default:
+        return &hexGroupsScalar;
+    }
+}
+
+AsciiFunction asciiFunction(Kernel _kernel)
+{
+    switch (resolve(_kernel)) {
+#ifdef HEXFORMAT_X86
+    case Kernel::Avx2:
+        return &asciiAvx2;
+    case Kernel::Sse:
+        return &asciiSse2;
+#endif
+    default:
+        return &asciiScalar;
+    }
+}
+
+} // namespace
+
+int hexLineWidth(int _bytesPerLine)
+{
+    if (_bytesPerLine <= 0)
+        return 0;
+    return _bytesPerLine * 3 + (_bytesPerLine - 1) / GROUP_SIZE;
+}
+
+int hexColumn(int _byteInLine)
+{
+    return _byteInLine * 3 + _byteInLine / GROUP_SIZE;
+}
+
+int hexBufferSize(int _length, int _bytesPerLine)
+{
+    if (_length <= 0)
+        return 0;
+    if (_bytesPerLine <= 0)
+        _bytesPerLine = _length;
+
+    const auto lines = (_length + _bytesPerLine - 1) / _bytesPerLine;
+    return lines * (hexLineWidth(_bytesPerLine) + 1);
+}
+
+int asciiBufferSize(int _length, int _bytesPerLine)
+{
+    if (_length <= 0)
+        return 0;
+    if (_bytesPerLine <= 0)
+        return _length;
+    return _length + (_length - 1) / _bytesPerLine;
+}
+
+int formatHex(const char *_data, int _length, int _bytesPerLine, char *_out, Kernel _kernel)
+{
+    if (_length <= 0)
+        return 0;
+
+    const auto groupsFunction = hexGroupsFunction(_kernel);
+    const auto in = reinterpret_cast<const uint8_t *>(_data);
+    const auto perLine = (_bytesPerLine > 0) ? _bytesPerLine : _length;
+    const auto width = hexLineWidth(perLine);
+    char *out = _out;
+
+    for (int from = 0; from < _length; from += perLine) {
+        if (from > 0)
+            *out++ = '\n';
+
+        const auto count = std::min(perLine, _length - from);
+        const auto groups = count / GROUP_SIZE;
+        const auto remainder = count % GROUP_SIZE;
+
+        groupsFunction(in + from, groups, out);
+        for (int g = 0; g < groups; ++g) {
+            if (g + 1 < groups || remainder > 0)
+                out[g * GROUP_STRIDE + GROUP_STRIDE - 1] = ' ';
+        }
+        hexBytesScalar(in + from + groups * GROUP_SIZE, remainder, out + groups * GROUP_STRIDE);
+
+        const auto written = groups * GROUP_STRIDE + remainder * 3 - (remainder == 0 ? 1 : 0);
+        memset(out + written, ' ', size_t(width - written));
+        out += width;
+    }
+
+    return int(out - _out);
+}
+
+int formatAscii(const char *_data, int _length, int _bytesPerLine, char *_out, Kernel _kernel)
+{
+    if (_length <= 0)
+        return 0;
+
+    const auto function = asciiFunction(_kernel);
+    const auto in = reinterpret_cast<const uint8_t *>(_data);
+    const auto perLine = (_bytesPerLine > 0) ? _bytesPerLine : _length;
+    char *out = _out;
+
+    for (int from = 0; from < _length; from += perLine) {
+        if (from > 0)
+            *out++ = '\n';
+
+        const auto count = std::min(perLine, _length - from);
+        function(in + from, count, out);
+        out += count;
+    }
+
+    return int(out - _out);
+}
+
+bool isSupported(Kernel _kernel)
+{
+    switch (_kernel) {
+    case Kernel::Scalar:
+    case Kernel::Auto:
+        return true;
+#ifdef HEXFORMAT_X86
+    case Kernel::Sse:
+        return cpufeatures::hasSsse3();
+    case Kernel::Avx2:
+        return cpufeatures::hasAvx2();
+#endif
+    default:
+        return false;
+    }
+}
+
+Kernel bestKernel()
+{
+    if (isSupported(Kernel::Avx2))
+        return Kernel::Avx2;
+    if (isSupported(Kernel::Sse))
+        return Kernel::Sse;
+    return Kernel::Scalar;
+}
+
+const char *toString(Kernel _kernel)
+{
+    switch (_kernel) {
+    case Kernel::Scalar:
+        return "scalar";
+    case Kernel::Sse:
+        return "sse";
+    case Kernel::Avx2:
+        return "avx2";
+    case Kernel::Auto:
+        return "auto";
+    }
+    return "invalid";
+}
+
+} // namespace hexformat
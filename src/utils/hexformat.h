@@ -0,0 +1,37 @@
+#ifndef HEXFORMAT_H
+#define HEXFORMAT_H
+
+// Formatting kernels for the Hex and String columns.
+//
+// Hex lines hold _bytesPerLine bytes as "XX " with one more space between groups
+// of 8 bytes, and are right padded with spaces to hexLineWidth(_bytesPerLine).
+// String lines hold the printable ASCII bytes and '.' for everything else.
+// Lines are separated by '\n'. _bytesPerLine <= 0 puts everything on one line.
+//
+// The kernels write into a caller provided buffer of at least *BufferSize() bytes,
+// they keep no state and are thread-safe.
+namespace hexformat {
+
+enum class Kernel {
+    Scalar,
+    Sse, // SSE2 for String, SSSE3 for Hex
+    Avx2,
+    Auto // best one the CPU supports
+};
+
+int hexLineWidth(int _bytesPerLine);
+int hexColumn(int _byteInLine); // first character of a byte's "XX" in its line
+int hexBufferSize(int _length, int _bytesPerLine);
+int asciiBufferSize(int _length, int _bytesPerLine);
+
+// return the number of characters written
+int formatHex(const char *_data, int _length, int _bytesPerLine, char *_out, Kernel _kernel = Kernel::Auto);
+int formatAscii(const char *_data, int _length, int _bytesPerLine, char *_out, Kernel _kernel = Kernel::Auto);
+
+bool isSupported(Kernel _kernel);
+Kernel bestKernel();
+const char *toString(Kernel _kernel);
+
+} // namespace hexformat
+
+#endif // HEXFORMAT_H
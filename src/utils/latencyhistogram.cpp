@@ -0,0 +1,85 @@
+#include "latencyhistogram.h"
+#include <QtAlgorithms>
+#include <algorithm>
+#include <cmath>
+
+constexpr int LatencyHistogram::SUB_BUCKETS;
+constexpr int LatencyHistogram::BUCKETS;
+
+void LatencyHistogram::record(qint64 _ns)
+{
+    _ns = std::max<qint64>(_ns, 0);
+    m_counts[bucketOf(_ns)]++;
+    m_count++;
+    m_total += _ns;
+    m_max = std::max(m_max, _ns);
+}
+
+void LatencyHistogram::merge(const LatencyHistogram &_other)
+{
+    for (int i = 0; i < BUCKETS; ++i)
+        m_counts[i] += _other.m_counts[i];
+    m_count += _other.m_count;
+    m_total += _other.m_total;
+    m_max = std::max(m_max, _other.m_max);
+}
+
+void LatencyHistogram::clear()
+{
+    *this = LatencyHistogram {};
+}
+
+quint64 LatencyHistogram::count() const
+{
+    return m_count;
+}
+
+qint64 LatencyHistogram::total() const
+{
+    return m_total;
+}
+
+qint64 LatencyHistogram::max() const
+{
+    return m_max;
+}
+
+qint64 LatencyHistogram::mean() const
+{
+    return m_count > 0 ? m_total / qint64(m_count) : 0;
+}
+
+qint64 LatencyHistogram::percentile(double _fraction) const
+{
+    if (m_count == 0)
+        return 0;
+
+    const auto rank = std::max<quint64>(1, quint64(std::ceil(qBound(0.0, _fraction, 1.0) * m_count)));
+    quint64 seen = 0;
+    for (int i = 0; i < BUCKETS; ++i) {
+        seen += m_counts[i];
+        if (seen >= rank)
+            return std::min(upperBound(i), m_max);
+    }
+    return m_max;
+}
+
+int LatencyHistogram::bucketOf(qint64 _ns)
+{
+    // 0..3 have a bucket each, then 4 per power of two
+    if (_ns < SUB_BUCKETS)
+        return int(_ns);
+    const auto msb = 63 - int(qCountLeadingZeroBits(quint64(_ns)));
+    const auto sub = int(_ns >> (msb - 2)) & (SUB_BUCKETS - 1);
+    return (msb - 1) * SUB_BUCKETS + sub;
+}
+
+qint64 LatencyHistogram::upperBound(int _bucket)
+{
+    if (_bucket < SUB_BUCKETS)
+        return _bucket;
+    const auto msb = _bucket / SUB_BUCKETS + 1;
+    const auto sub = _bucket % SUB_BUCKETS;
+    const auto lower = qint64(SUB_BUCKETS + sub) << (msb - 2);
+    return lower + (qint64(1) << (msb - 2)) - 1;
+}
@@ -0,0 +1,38 @@
+#ifndef LATENCYHISTOGRAM_H
+#define LATENCYHISTOGRAM_H
+
+#include <QtGlobal>
+
+// Distribution of durations in ns with log-linear buckets: every power of two
+// is split into 4 buckets, so a percentile is within 25% of the real value.
+// Recording is a few instructions and never allocates. Not thread-safe.
+class LatencyHistogram
+{
+public:
+    void record(qint64 _ns); // negative values count as 0
+    void merge(const LatencyHistogram &_other);
+    void clear();
+
+    quint64 count() const;
+    qint64 total() const; // sum of the recorded values, ns
+    qint64 max() const;
+    qint64 mean() const;
+    // upper bound of the bucket holding the value below which _fraction of the
+    // values lie, never above max(); 0 without values
+    qint64 percentile(double _fraction) const;
+
+private:
+    static int bucketOf(qint64 _ns);
+    static qint64 upperBound(int _bucket);
+
+private:
+    static constexpr int SUB_BUCKETS = 4;
+    static constexpr int BUCKETS = 62 * SUB_BUCKETS;
+
+    quint64 m_counts[BUCKETS] {};
+    quint64 m_count {};
+    qint64 m_total {};
+    qint64 m_max {};
+};
+
+#endif // LATENCYHISTOGRAM_H
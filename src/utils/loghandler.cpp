@@ -1,14 +1,28 @@
 #include <QRegularExpression>
-#include <QMutex>
-#include <QThread>
+#include <QDateTime>
 #include <QDebug>
-#include <QMap>
+#include <QHash>
 #include <QTime>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <vector>
 #include <stdio.h>
 #include <cstring>
 
 #include "loghandler.h"
 #include "commonconfig.h"
+#include "captureclock.h"
+#include "ringbuffer.h"
+#include "timeformat.h"
+
+// Messages are copied into a lock-free buffer of the thread that logs them and
+// written by a background thread in batches. The logging thread never formats,
+// locks or flushes; when its buffer is full the message is dropped and counted.
 
 const char *getFileName(const char *path) {
     if (!path) return "";
@@ -27,62 +41,331 @@ const char *getFileName(const char *path) {
 
 QString trimFunctionName(const QString &longName) {
     // keep class name and function name
-    const auto matches = QRegularExpression("(\\w+::\\w+(?=\\()|(?<= )\\w+.*(?=\\())").match(longName);
+    static const QRegularExpression functionName("(\\w+::\\w+(?=\\()|(?<= )\\w+.*(?=\\())");
+    const auto matches = functionName.match(longName);
     if (!matches.hasMatch())
         return longName;
     return matches.captured(0);
 }
 
-void logHandler(QtMsgType type, const QMessageLogContext &context, const QString &msg)
-{
-    const QByteArray localMsg = msg.toLocal8Bit();
-    const char *file = getFileName(context.file);
-    const QString qfunc = trimFunctionName(context.function ? context.function : "");
-    const QByteArray bfunc = qfunc.toLocal8Bit();
-    auto threadId = (uint64_t)QThread::currentThreadId();
-    static int threadCount {0};
-    static QMap<uint64_t, int> threadMap {};
-    static QMutex mutex {};
-
-    // map long threadIds to shorter ones, the short thread ID is the order of threads that log
-    mutex.lock();
-    if (threadMap.contains(threadId)) {
-        threadId = threadMap[threadId];
-    } else {
-        threadCount++;
-        threadMap.insert(threadId, threadCount);
-        threadId = threadCount;
+namespace {
+
+constexpr int MAX_MESSAGE_LENGTH = 16 * 1024; // longer messages are cut
+constexpr int WRITE_INTERVAL_MS = 10;
+
+struct Entry {
+    qint64 timestamp; // capture clock, ns
+    uint64_t position; // text in the thread's ring
+    quint32 length;
+    bool last; // a message wrapping around the ring is split into two entries
+    QtMsgType type;
+    int line;
+    const char *file; // context strings are literals, they outlive the entry
+    const char *function;
+};
+
+// one per thread that logs, owned by the writer once the thread has finished
+struct ThreadLog {
+    explicit ThreadLog(quint64 _id) : id(_id) {}
+
+    const quint64 id; // the order of threads that log
+    SpscByteRing text {64 * 1024};
+    SpscQueue<Entry> entries {1024};
+    std::atomic<quint64> dropped {0};
+    std::atomic<bool> finished {false};
+    quint64 reportedDropped {}; // writer only
+};
+
+struct ThreadLogHolder {
+    ThreadLog *log {nullptr};
+    ~ThreadLogHolder()
+    {
+        if (log)
+            log->finished = true;
+        log = nullptr; // the writer deletes it
     }
-    mutex.unlock();
+};
 
-    const auto time = QTime::currentTime().toString(TIME_FORMAT);
-    const auto timeStr = time.toStdString().c_str();
+FILE *s_infoStream = stdout;
+std::atomic<bool> s_async {false};
+std::atomic<bool> s_running {false};
+std::atomic<quint64> s_threadCount {0};
+std::atomic<quint64> s_dropped {0};
+std::thread s_writer {};
+std::mutex s_threadsMutex {}; // registering threads, and a drain from outside the writer
+std::vector<ThreadLog *> s_threads {};
+thread_local ThreadLogHolder t_log {};
 
-    switch (type) {
+const char *typeName(QtMsgType _type)
+{
+    switch (_type) {
     case QtDebugMsg:
-        fprintf(stdout, "%s [%llu] Debug: %s (%s, %s:%u)\n", timeStr, threadId, localMsg.constData(), bfunc.constData(), file, context.line);
-        fflush(stdout);
-        break;
+        return "Debug";
     case QtInfoMsg:
-        fprintf(stdout, "%s [%llu] Info: %s (%s, %s:%u)\n", timeStr, threadId, localMsg.constData(), bfunc.constData(), file, context.line);
-        fflush(stdout);
-        break;
+        return "Info";
     case QtWarningMsg:
-        fprintf(stderr, "%s [%llu] Warning: %s (%s, %s:%u)\n", timeStr, threadId, localMsg.constData(), bfunc.constData(), file, context.line);
-        fflush(stderr);
-        break;
+        return "Warning";
     case QtCriticalMsg:
-        fprintf(stderr, "%s [%llu] Critical: %s (%s, %s:%u)\n", timeStr, threadId, localMsg.constData(), bfunc.constData(), file, context.line);
-        fflush(stderr);
-        break;
+        return "Critical";
     case QtFatalMsg:
-        fprintf(stderr, "%s [%llu] Fatal: %s (%s, %s:%u)\n", timeStr, threadId, localMsg.constData(), bfunc.constData(), file, context.line);
-        fflush(stderr);
-        break;
+        return "Fatal";
+    }
+    return "";
+}
+
+FILE *streamOf(QtMsgType _type)
+{
+    return _type == QtDebugMsg || _type == QtInfoMsg ? s_infoStream : stderr;
+}
+
+ThreadLog *threadLog()
+{
+    if (!t_log.log) {
+        t_log.log = new ThreadLog(++s_threadCount);
+        std::lock_guard<std::mutex> locker(s_threadsMutex);
+        s_threads.push_back(t_log.log);
+    }
+    return t_log.log;
+}
+
+// TIME_FORMAT of a capture timestamp
+void appendTime(QByteArray *_out, qint64 _timestamp, qint64 _utcOffsetMs)
+{
+    char text[timeformat::TIME_LENGTH];
+    timeformat::formatTime(captureclock::toMSecsSinceEpoch(_timestamp), _utcOffsetMs, text);
+    _out->append(text, sizeof(text));
+}
+
+// writer thread, or a drain under s_threadsMutex
+class LogWriter
+{
+public:
+    // moves every queued message to the streams, oldest first
+    void drain()
+    {
+        m_messages.clear();
+        m_text.resize(0);
+
+        for (auto it = s_threads.begin(); it != s_threads.end();) {
+            auto log = *it;
+            collect(log);
+
+            // a finished thread cannot log anymore, its queue is empty now
+            if (log->finished && !log->entries.front()) {
+                delete log;
+                it = s_threads.erase(it);
+            } else {
+                ++it;
+            }
+        }
+
+        if (m_messages.empty())
+            return;
+
+        std::stable_sort(m_messages.begin(), m_messages.end(), [](const Message &_a, const Message &_b) {
+            return _a.timestamp < _b.timestamp;
+        });
+
+        const auto utcOffsetMs = qint64(QDateTime::currentDateTime().offsetFromUtc()) * 1000;
+        m_info.resize(0);
+        m_errors.resize(0);
+        for (const auto &message : m_messages) {
+            auto &out = streamOf(message.type) == stderr ? m_errors : m_info;
+            appendTime(&out, message.timestamp, utcOffsetMs);
+            out.append(" [").append(QByteArray::number(message.threadId)).append("] ");
+            out.append(typeName(message.type)).append(": ");
+            if (message.length >= 0)
+                out.append(m_text.constData() + message.offset, message.length);
+            else
+                out.append(QByteArray::number(-message.length)).append(" log messages dropped, the log could not keep up");
+            out.append(" (").append(functionName(message.function)).append(", ");
+            out.append(getFileName(message.file)).append(':').append(QByteArray::number(message.line)).append(")\n");
+        }
+
+        write(s_infoStream, m_info);
+        write(stderr, m_errors);
+    }
+
+private:
+    struct Message {
+        qint64 timestamp;
+        quint64 threadId;
+        QtMsgType type;
+        int offset; // in m_text
+        int length; // minus the number of dropped messages for a drop report
+        int line;
+        const char *file;
+        const char *function;
+    };
+
+    void collect(ThreadLog *_log)
+    {
+        int start = m_text.size();
+        while (const auto entry = _log->entries.front()) {
+            if (!entry->last && _log->entries.size() < 2)
+                break; // the second piece is not queued yet
+
+            m_text.append(_log->text.data(entry->position), int(entry->length));
+            if (entry->last) {
+                m_messages.push_back(Message {entry->timestamp, _log->id, entry->type, start, m_text.size() - start,
+                                              entry->line, entry->file, entry->function});
+                start = m_text.size();
+            }
+            _log->text.release(entry->position + entry->length);
+            _log->entries.pop();
+        }
+
+        const auto dropped = _log->dropped.load();
+        if (dropped != _log->reportedDropped) {
+            m_messages.push_back(Message {captureclock::now(), _log->id, QtWarningMsg, 0, -int(std::min<quint64>(dropped - _log->reportedDropped, INT_MAX)),
+                                          __LINE__, __FILE__, "logHandler"});
+            _log->reportedDropped = dropped;
+        }
+    }
+
+    // trimming is a regular expression, done once per call site
+    const QByteArray &functionName(const char *_function)
+    {
+        auto it = m_functionNames.find(_function);
+        if (it == m_functionNames.end())
+            it = m_functionNames.insert(_function, trimFunctionName(_function ? _function : "").toLocal8Bit());
+        return it.value();
+    }
+
+    static void write(FILE *_stream, const QByteArray &_text)
+    {
+        if (_text.isEmpty())
+            return;
+        fwrite(_text.constData(), 1, size_t(_text.size()), _stream);
+        fflush(_stream);
+    }
+
+private:
+    std::vector<Message> m_messages {};
+    QByteArray m_text {};
+    QByteArray m_info {};
+    QByteArray m_errors {};
+    QHash<const char *, QByteArray> m_functionNames {};
+};
+
+LogWriter s_logWriter {};
+
+void drainLog()
+{
+    std::lock_guard<std::mutex> locker(s_threadsMutex);
+    s_logWriter.drain();
+}
+
+void runWriter()
+{
+    while (s_running) {
+        drainLog();
+        std::this_thread::sleep_for(std::chrono::milliseconds(WRITE_INTERVAL_MS));
+    }
+    drainLog();
+}
+
+// before initLog(), after the writer stopped, and for fatal messages
+void writeSynchronously(QtMsgType type, const QMessageLogContext &context, const QString &msg)
+{
+    const QByteArray localMsg = msg.toLocal8Bit();
+    const QByteArray bfunc = trimFunctionName(context.function ? context.function : "").toLocal8Bit();
+    const auto threadId = threadLog()->id;
+    const QByteArray time = QTime::currentTime().toString(TIME_FORMAT).toLatin1();
+
+    const auto stream = streamOf(type);
+    fprintf(stream, "%s [%llu] %s: %s (%s, %s:%u)\n", time.constData(), threadId, typeName(type), localMsg.constData(),
+            bfunc.constData(), getFileName(context.file), context.line);
+    fflush(stream);
+}
+
+// copies the message into the ring of the calling thread, ASCII without a conversion
+bool enqueue(ThreadLog *_log, QtMsgType type, const QMessageLogContext &context, const QString &msg)
+{
+    const auto timestamp = captureclock::now();
+
+    QByteArray converted {};
+    const auto ascii = std::all_of(msg.cbegin(), msg.cend(), [](QChar _c) { return _c.unicode() < 0x80; });
+    if (!ascii)
+        converted = msg.toLocal8Bit();
+    const auto length = size_t(std::min(ascii ? msg.size() : converted.size(), MAX_MESSAGE_LENGTH));
+
+    // room for the message in at most two pieces, like the capture recorder
+    if (_log->text.capacity() - _log->text.used() < 2 * length + 2 || _log->entries.capacity() - _log->entries.size() < 2)
+        return false;
+
+    size_t copied = 0;
+    do {
+        size_t regionLength {};
+        uint64_t position {};
+        const auto region = _log->text.acquire(std::max<size_t>(length - copied, 1), &regionLength, &position);
+        if (!region)
+            return false;
+
+        regionLength = std::min(regionLength, length - copied);
+        if (ascii) {
+            for (size_t i = 0; i < regionLength; ++i)
+                region[i] = char(msg.at(int(copied + i)).unicode());
+        } else {
+            memcpy(region, converted.constData() + copied, regionLength);
+        }
+        _log->text.commit(regionLength);
+        copied += regionLength;
+
+        _log->entries.push(Entry {timestamp, position, quint32(regionLength), copied == length, type, context.line,
+                                  context.file, context.function});
+    } while (copied < length);
+
+    return true;
+}
+
+void stopLog()
+{
+    // messages are written right away from here on, the writer drains what was queued
+    if (!s_async.exchange(false))
+        return;
+    s_running = false;
+    s_writer.join();
+    drainLog(); // from threads that saw s_async just before it was cleared
+}
+
+} // namespace
+
+void logHandler(QtMsgType type, const QMessageLogContext &context, const QString &msg)
+{
+    if (!s_async) {
+        writeSynchronously(type, context, msg);
+        return;
     }
+
+    // the process is about to abort, everything queued goes out first
+    if (type == QtFatalMsg) {
+        drainLog();
+        writeSynchronously(type, context, msg);
+        return;
+    }
+
+    const auto log = threadLog();
+    if (!enqueue(log, type, context, msg)) {
+        log->dropped++;
+        s_dropped++;
+    }
+}
+
+quint64 droppedLogMessages()
+{
+    return s_dropped;
 }
 
-void initLog() {
+void initLog(bool _stderrOnly) {
+    s_infoStream = _stderrOnly ? stderr : stdout;
+
+    if (!s_running.exchange(true)) {
+        s_writer = std::thread(&runWriter);
+        s_async = true;
+        atexit(&stopLog);
+    }
+
     qInstallMessageHandler(&logHandler);
     qDebug("init");
 }
@@ -1,6 +1,12 @@
 #ifndef LOGHANDLER_H
 #define LOGHANDLER_H
 
-void initLog();
+#include <QtGlobal>
+
+// _stderrOnly keeps stdout free for captured data
+void initLog(bool _stderrOnly = false);
+
+// messages lost because a thread logged faster than the writer could keep up
+quint64 droppedLogMessages();
 
 #endif // LOGHANDLER_H
@@ -0,0 +1,180 @@
+#ifndef RINGBUFFER_H
+#define RINGBUFFER_H
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace ringbuffer {
+
+inline size_t roundUpToPowerOfTwo(size_t _value)
+{
+    size_t ret = 1;
+    while (ret < _value)
+        ret <<= 1;
+    return ret;
+}
+
+} // namespace ringbuffer
+
+// Lock-free single-producer/single-consumer queue of fixed capacity.
+// push() may only be called from one thread, front()/pop() from one other thread.
+template <typename T>
+class SpscQueue
+{
+public:
+    explicit SpscQueue(size_t _capacity = 1024)
+        : m_items(ringbuffer::roundUpToPowerOfTwo(_capacity))
+        , m_mask(m_items.size() - 1)
+    {
+    }
+
+    SpscQueue(const SpscQueue &) = delete;
+    SpscQueue &operator=(const SpscQueue &) = delete;
+
+    // producer side, returns false if the queue is full
+    bool push(const T &_item)
+    {
+        const auto tail = m_tail.load(std::memory_order_relaxed);
+        if (tail - m_head.load(std::memory_order_acquire) == m_items.size())
+            return false;
+
+        m_items[tail & m_mask] = _item;
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer side, returns nullptr if the queue is empty
+    T *front()
+    {
+        const auto head = m_head.load(std::memory_order_relaxed);
+        if (head == m_tail.load(std::memory_order_acquire))
+            return nullptr;
+
+        return &m_items[head & m_mask];
+    }
+
+    // consumer side, _index counts from the front and must be below size()
+    T *at(size_t _index)
+    {
+        return &m_items[(m_head.load(std::memory_order_relaxed) + _index) & m_mask];
+    }
+
+    // consumer side, must only be called after front() returned an item
+    void pop()
+    {
+        m_head.store(m_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    size_t size() const
+    {
+        return m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire);
+    }
+
+    size_t capacity() const
+    {
+        return m_items.size();
+    }
+
+private:
+    std::vector<T> m_items;
+    const size_t m_mask;
+
+    // keep producer and consumer indices on separate cache lines
+    char m_pad0[64] {};
+    std::atomic<size_t> m_head {0}; // written by the consumer
+    char m_pad1[64] {};
+    std::atomic<size_t> m_tail {0}; // written by the producer
+    char m_pad2[64] {};
+};
+
+// Lock-free single-producer/single-consumer byte ring with contiguous write regions.
+// Positions are logical and grow monotonically, the physical offset is position & mask.
+// The producer asks for a contiguous region, fills it and commits. The consumer reads
+// committed bytes in place and releases them in order, so nothing is copied in between.
+class SpscByteRing
+{
+public:
+    explicit SpscByteRing(size_t _capacity = 4 * 1024 * 1024)
+        : m_buffer(ringbuffer::roundUpToPowerOfTwo(_capacity))
+        , m_mask(m_buffer.size() - 1)
+    {
+    }
+
+    SpscByteRing(const SpscByteRing &) = delete;
+    SpscByteRing &operator=(const SpscByteRing &) = delete;
+
+    // producer side: returns the start of a contiguous writable region of at most _wanted bytes,
+    // or nullptr if the ring is full. *_position receives the logical position of the region.
+    // If the space left before the physical end is too small for _wanted bytes and the beginning
+    // of the buffer has room, the tail is skipped; skipped bytes are released together with the
+    // next region the consumer releases.
+    char *acquire(size_t _wanted, size_t *_length, uint64_t *_position)
+    {
+        auto tail = m_tail.load(std::memory_order_relaxed);
+        const auto head = m_head.load(std::memory_order_acquire);
+        const auto capacity = m_buffer.size();
+
+        auto freeBytes = capacity - size_t(tail - head);
+        auto contiguous = std::min(freeBytes, capacity - size_t(tail & m_mask));
+
+        if (contiguous < _wanted && contiguous < freeBytes) {
+            const auto wrapped = freeBytes - contiguous;
+            if (wrapped > contiguous) {
+                // skip the tail of the buffer, continue at physical offset 0
+                tail += contiguous;
+                m_tail.store(tail, std::memory_order_release);
+                contiguous = wrapped;
+            }
+        }
+
+        if (contiguous == 0)
+            return nullptr;
+
+        *_length = std::min(contiguous, _wanted);
+        *_position = tail;
+        return m_buffer.data() + (tail & m_mask);
+    }
+
+    // producer side: publishes _length bytes written to the region returned by acquire()
+    void commit(size_t _length)
+    {
+        m_tail.store(m_tail.load(std::memory_order_relaxed) + _length, std::memory_order_release);
+    }
+
+    // consumer side: pointer to committed bytes at a logical position
+    const char *data(uint64_t _position) const
+    {
+        return m_buffer.data() + (_position & m_mask);
+    }
+
+    // consumer side: frees every byte before the logical position _end
+    void release(uint64_t _end)
+    {
+        m_head.store(_end, std::memory_order_release);
+    }
+
+    size_t used() const
+    {
+        return size_t(m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire));
+    }
+
+    size_t capacity() const
+    {
+        return m_buffer.size();
+    }
+
+private:
+    std::vector<char> m_buffer;
+    const size_t m_mask;
+
+    char m_pad0[64] {};
+    std::atomic<uint64_t> m_head {0}; // written by the consumer
+    char m_pad1[64] {};
+    std::atomic<uint64_t> m_tail {0}; // written by the producer
+    char m_pad2[64] {};
+};
+
+#endif // RINGBUFFER_H
@@ -0,0 +1,31 @@
+#include "timeformat.h"
+
+namespace timeformat {
+
+char *formatTime(qint64 _msecsSinceEpoch, qint64 _utcOffsetMs, char *_out)
+{
+    constexpr qint64 DAY = 24 * 3600 * 1000;
+    auto time = (_msecsSinceEpoch + _utcOffsetMs) % DAY;
+    if (time < 0)
+        time += DAY;
+
+    const auto hours = time / 3600000;
+    const auto minutes = time / 60000 % 60;
+    const auto seconds = time / 1000 % 60;
+    const auto msecs = time % 1000;
+    _out[0] = char('0' + hours / 10);
+    _out[1] = char('0' + hours % 10);
+    _out[2] = ':';
+    _out[3] = char('0' + minutes / 10);
+    _out[4] = char('0' + minutes % 10);
+    _out[5] = ':';
+    _out[6] = char('0' + seconds / 10);
+    _out[7] = char('0' + seconds % 10);
+    _out[8] = '.';
+    _out[9] = char('0' + msecs / 100);
+    _out[10] = char('0' + msecs / 10 % 10);
+    _out[11] = char('0' + msecs % 10);
+    return _out + TIME_LENGTH;
+}
+
+} // namespace timeformat
@@ -0,0 +1,18 @@
+#ifndef TIMEFORMAT_H
+#define TIMEFORMAT_H
+
+#include <QtGlobal>
+
+// TIME_FORMAT without going through QTime, for formatting many rows or log
+// messages in a row. Thread-safe.
+namespace timeformat {
+
+constexpr int TIME_LENGTH = 12; // "HH:mm:ss.zzz"
+
+// the time of day _msecsSinceEpoch is at _utcOffsetMs from UTC,
+// writes TIME_LENGTH characters and returns the end
+char *formatTime(qint64 _msecsSinceEpoch, qint64 _utcOffsetMs, char *_out);
+
+} // namespace timeformat
+
+#endif // TIMEFORMAT_H
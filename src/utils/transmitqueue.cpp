@@ -0,0 +1,199 @@
+#include "transmitqueue.h"
+#include <algorithm>
+
+namespace {
+
+int hexDigit(QChar _c)
+{
+    const auto c = _c.toLatin1();
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+} // namespace
+
+TransmitQueue::~TransmitQueue()
+{
+    clear();
+}
+
+QByteArray TransmitQueue::parseInput(const QString &_text, const QString &_hexPrefix, QString *_error)
+{
+    QByteArray data {};
+    data.reserve(_text.size());
+
+    if (!_hexPrefix.isEmpty() && _text.startsWith(_hexPrefix)) {
+        // every token may start with the prefix, spaces and commas separate them;
+        // a token is whole bytes, "0x1 0x2" is an error rather than 0x12
+        const auto oddDigits = [&]() {
+            if (_error)
+                *_error = "Odd number of hex digits";
+            return QByteArray();
+        };
+        auto tokenStart = true;
+        auto nibbles = 0;
+        auto byte = 0;
+        for (int i = 0; i < _text.size();) {
+            if (tokenStart && _text.midRef(i).startsWith(_hexPrefix)) {
+                i += _hexPrefix.size();
+                tokenStart = false;
+                continue;
+            }
+
+            const auto c = _text.at(i++);
+            if (c.isSpace() || c == ',') {
+                if (nibbles != 0)
+                    return oddDigits();
+                tokenStart = true;
+                byte = 0;
+                continue;
+            }
+            tokenStart = false;
+
+            const auto digit = hexDigit(c);
+            if (digit < 0) {
+                if (_error)
+                    *_error = QString("'%1' is not a hex digit").arg(c);
+                return QByteArray();
+            }
+            byte = byte << 4 | digit;
+            if (++nibbles == 2) {
+                data.append(char(byte));
+                nibbles = 0;
+                byte = 0;
+            }
+        }
+
+        if (nibbles != 0)
+            return oddDigits();
+        return data;
+    }
+
+    for (int i = 0; i < _text.size(); ++i) {
+        const auto c = _text.at(i).toLatin1();
+        if (c != '\\' || i + 1 == _text.size()) {
+            data.append(c);
+            continue;
+        }
+
+        switch (_text.at(++i).toLatin1()) {
+        case 'n':
+            data.append('\n');
+            break;
+        case 'r':
+            data.append('\r');
+            break;
+        case 't':
+            data.append('\t');
+            break;
+        case 'x':
+            if (i + 2 < _text.size() && hexDigit(_text.at(i + 1)) >= 0 && hexDigit(_text.at(i + 2)) >= 0) {
+                data.append(char(hexDigit(_text.at(i + 1)) << 4 | hexDigit(_text.at(i + 2))));
+                i += 2;
+            } else {
+                data.append("\\x");
+            }
+            break;
+        case '\\':
+            data.append('\\');
+            break;
+        default:
+            // not an escape, kept as typed
+            data.append('\\');
+            data.append(_text.at(i).toLatin1());
+            break;
+        }
+    }
+    return data;
+}
+
+void TransmitQueue::append(const QByteArray &_data, qint64 _repeat)
+{
+    if (_data.isEmpty() || _repeat <= 0)
+        return;
+
+    const auto left = _data.size() * _repeat;
+    m_items.enqueue(Item {_data, _repeat, 0, nullptr, left});
+    m_queuedBytes += left;
+}
+
+bool TransmitQueue::appendFile(const QString &_fileName, QString *_error)
+{
+    auto file = new QFile(_fileName);
+    if (!file->open(QIODevice::ReadOnly)) {
+        if (_error)
+            *_error = file->errorString();
+        delete file;
+        return false;
+    }
+
+    m_items.enqueue(Item {QByteArray(), 1, 0, file, file->size()});
+    m_queuedBytes += file->size();
+    return true;
+}
+
+void TransmitQueue::clear()
+{
+    while (!m_items.isEmpty())
+        removeFront();
+}
+
+bool TransmitQueue::isEmpty() const
+{
+    return m_items.isEmpty();
+}
+
+qint64 TransmitQueue::queuedBytes() const
+{
+    return m_queuedBytes;
+}
+
+qint64 TransmitQueue::take(QByteArray *_batch, qint64 _maxBytes)
+{
+    qint64 taken = 0;
+    while (taken < _maxBytes && !m_items.isEmpty()) {
+        auto &item = m_items.head();
+        const auto wanted = _maxBytes - taken;
+        qint64 length = 0;
+
+        if (item.file) {
+            // straight into the batch, the file may have changed size since it was queued
+            const auto start = _batch->size();
+            _batch->resize(int(start + wanted));
+            length = std::max<qint64>(item.file->read(_batch->data() + start, wanted), 0);
+            _batch->resize(int(start + length));
+            if (length == 0) {
+                removeFront();
+                continue;
+            }
+        } else {
+            length = std::min<qint64>(wanted, item.data.size() - item.offset);
+            _batch->append(item.data.constData() + item.offset, int(length));
+            item.offset += length;
+            if (item.offset == item.data.size()) {
+                item.offset = 0;
+                item.repeat--;
+            }
+        }
+
+        taken += length;
+        const auto accounted = std::min(length, item.left);
+        item.left -= accounted;
+        m_queuedBytes -= accounted;
+        if (!item.file && item.repeat == 0)
+            removeFront();
+    }
+    return taken;
+}
+
+void TransmitQueue::removeFront()
+{
+    const auto item = m_items.dequeue();
+    m_queuedBytes -= item.left;
+    delete item.file;
+}
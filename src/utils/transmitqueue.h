@@ -0,0 +1,52 @@
+#ifndef TRANSMITQUEUE_H
+#define TRANSMITQUEUE_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QQueue>
+#include <QString>
+
+// Data waiting to be written to a port, in order: byte strings sent any number of
+// times and files, read as they go out. take() fills a batch from the front, so
+// a port gets one write per batch whatever the items look like.
+//
+// Typed input parses with parseInput(): with a hex prefix, input that starts with
+// it is hex digits, e.g. "0x01 02 0x0A0B", each token whole bytes; anything else is
+// Latin-1 text with the escapes \n, \r, \t, \\ and \xHH.
+class TransmitQueue
+{
+public:
+    TransmitQueue() = default;
+    ~TransmitQueue();
+    TransmitQueue(const TransmitQueue &) = delete;
+    TransmitQueue &operator=(const TransmitQueue &) = delete;
+
+    static QByteArray parseInput(const QString &_text, const QString &_hexPrefix, QString *_error);
+
+    void append(const QByteArray &_data, qint64 _repeat = 1);
+    bool appendFile(const QString &_fileName, QString *_error);
+    void clear();
+
+    bool isEmpty() const;
+    qint64 queuedBytes() const; // files count with what is left of them
+
+    // appends up to _maxBytes from the front to _batch, returns how many
+    qint64 take(QByteArray *_batch, qint64 _maxBytes);
+
+private:
+    struct Item {
+        QByteArray data;
+        qint64 repeat; // copies of data left, the first one from offset on
+        qint64 offset;
+        QFile *file; // owned, instead of data
+        qint64 left; // bytes
+    };
+
+    void removeFront();
+
+private:
+    QQueue<Item> m_items {};
+    qint64 m_queuedBytes {};
+};
+
+#endif // TRANSMITQUEUE_H
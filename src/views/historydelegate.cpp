@@ -0,0 +1,214 @@
+#include "historydelegate.h"
+#include <QAbstractProxyModel>
+#include <QApplication>
+#include <QFontMetricsF>
+#include <algorithm>
+#include <cmath>
+
+#include "utils/captureclock.h"
+#include "utils/hexformat.h"
+
+constexpr int HistoryDelegate::MAX_ATLASES;
+
+HistoryDelegate::HistoryDelegate(QObject *parent)
+    : QStyledItemDelegate(parent)
+{
+}
+
+void HistoryDelegate::paint(QPainter *painter, const QStyleOptionViewItem &option, const QModelIndex &index) const
+{
+    int row {};
+    const auto history = isByteColumn(index.column()) ? sourceRow(index, &row) : nullptr;
+    if (!history) {
+        QStyledItemDelegate::paint(painter, option, index);
+        return;
+    }
+
+    // the cells never go through data(), their time counts with the model's format times
+    const auto start = captureclock::now();
+    const auto widget = option.widget;
+    const auto style = widget ? widget->style() : QApplication::style();
+
+    // background and selection like the default delegate, without asking for the text
+    QStyleOptionViewItem opt(option);
+    opt.index = index;
+    style->drawPrimitive(QStyle::PE_PanelItemViewItem, &opt, painter, widget);
+
+    const auto group = !(opt.state & QStyle::State_Enabled) ? QPalette::Disabled
+            : (opt.state & QStyle::State_Active) ? QPalette::Normal : QPalette::Inactive;
+    const auto color = (opt.state & QStyle::State_Selected) ? opt.palette.color(group, QPalette::HighlightedText)
+                                                           : HistoryModel::foregroundColor(index.column());
+
+    const auto view = history->rowView(row);
+    const auto hex = index.column() == HistoryModel::toColumn(HistoryModel::HexRole);
+    const auto bytesPerLine = history->newLineAfterCountEnabled() ? history->newlineAfterCount() : 0;
+    const auto perLine = bytesPerLine > 0 ? bytesPerLine : std::max(view.length, 1);
+    const auto lines = std::max(1, (view.length + perLine - 1) / perLine);
+
+    const auto &atlas = glyphAtlas(opt.font, color.rgba(), painter->device()->devicePixelRatioF());
+    const auto margin = style->pixelMetric(QStyle::PM_FocusFrameHMargin, nullptr, widget) + 1;
+    const auto textRect = QRectF(opt.rect).adjusted(margin, 0, -margin, 0);
+    const auto top = textRect.top() + (textRect.height() - lines * atlas.lineHeight) / 2;
+
+    // only the glyphs in the exposed part of the cell, a row can hold thousands of bytes
+    auto visible = textRect;
+    if (painter->hasClipping())
+        visible &= painter->clipBoundingRect();
+
+    if (!visible.isEmpty() && view.length > 0) {
+        const auto firstLine = std::max(0, int(std::floor((visible.top() - top) / atlas.lineHeight)));
+        const auto lastLine = std::min(lines - 1, int(std::floor((visible.bottom() - top) / atlas.lineHeight)));
+        const auto firstColumn = std::max<qreal>(0, (visible.left() - textRect.left()) / atlas.charWidth);
+        const auto lastColumn = (visible.right() - textRect.left()) / atlas.charWidth;
+
+        // a hex byte takes 3 characters, plus one between groups of 8
+        const auto firstByte = hex ? std::max(0, int(firstColumn / 3.125) - 1) : int(firstColumn);
+        const auto lastByte = std::min(perLine - 1, hex ? int(lastColumn / 3) : int(lastColumn));
+
+        const auto scale = 1 / atlas.pixelRatio;
+        m_fragments.clear();
+        for (int line = firstLine; line <= lastLine; ++line) {
+            const auto lineStart = line * perLine;
+            const auto end = std::min(view.length - lineStart, lastByte + 1);
+            const auto y = top + line * atlas.lineHeight;
+
+            for (int i = firstByte; i < end; ++i) {
+                const auto byte = quint8(view.data[lineStart + i]);
+                const auto &source = hex ? atlas.hex[byte] : atlas.ascii[byte];
+                const auto x = textRect.left() + (hex ? hexformat::hexColumn(i) : i) * atlas.charWidth;
+                m_fragments.append(QPainter::PixmapFragment::create(
+                    QPointF(x + source.width() * scale / 2, y + source.height() * scale / 2), source, scale, scale));
+            }
+        }
+
+        painter->save();
+        painter->setClipRect(opt.rect, Qt::IntersectClip);
+        painter->drawPixmapFragments(m_fragments.constData(), m_fragments.size(), atlas.pixmap);
+        painter->restore();
+    }
+
+    if (opt.state & QStyle::State_HasFocus) {
+        QStyleOptionFocusRect focus {};
+        focus.QStyleOption::operator=(opt);
+        focus.state |= QStyle::State_KeyboardFocusChange | QStyle::State_Item;
+        focus.backgroundColor = opt.palette.color(group, (opt.state & QStyle::State_Selected) ? QPalette::Highlight : QPalette::Window);
+        style->drawPrimitive(QStyle::PE_FrameFocusRect, &focus, painter, widget);
+    }
+
+    history->recordFormatTime(captureclock::now() - start);
+}
+
+QSize HistoryDelegate::sizeHint(const QStyleOptionViewItem &option, const QModelIndex &index) const
+{
+    int row {};
+    const auto history = isByteColumn(index.column()) ? sourceRow(index, &row) : nullptr;
+    if (!history)
+        return QStyledItemDelegate::sizeHint(option, index);
+
+    const auto length = history->rowView(row).length;
+    const auto bytesPerLine = history->newLineAfterCountEnabled() ? history->newlineAfterCount() : 0;
+    const auto perLine = bytesPerLine > 0 ? bytesPerLine : std::max(length, 1);
+    const auto lines = std::max(1, (length + perLine - 1) / perLine);
+    const auto count = std::min(length, perLine);
+
+    int characters = count;
+    if (index.column() == HistoryModel::toColumn(HistoryModel::HexRole))
+        characters = count > 0 ? hexformat::hexColumn(count - 1) + 2 : 0;
+
+    const auto widget = option.widget;
+    const auto style = widget ? widget->style() : QApplication::style();
+    const auto margin = style->pixelMetric(QStyle::PM_FocusFrameHMargin, nullptr, widget) + 1;
+    const auto layout = cellLayout(option.font);
+    return QSize(int(std::ceil(characters * layout.charWidth)) + 2 * margin, int(std::ceil(lines * layout.lineHeight)));
+}
+
+const HistoryModel *HistoryDelegate::sourceRow(const QModelIndex &_index, int *_row)
+{
+    auto index = _index;
+    while (const auto proxy = qobject_cast<const QAbstractProxyModel *>(index.model()))
+        index = proxy->mapToSource(index);
+
+    const auto history = qobject_cast<const HistoryModel *>(index.model());
+    if (!history || index.row() < 0 || index.row() >= history->rowCount())
+        return nullptr;
+
+    *_row = index.row();
+    return history;
+}
+
+bool HistoryDelegate::isByteColumn(int _column)
+{
+    return _column == HistoryModel::toColumn(HistoryModel::HexRole)
+            || _column == HistoryModel::toColumn(HistoryModel::StringRole);
+}
+
+HistoryDelegate::CellLayout HistoryDelegate::cellLayout(const QFont &_font) const
+{
+    if (m_layoutValid && _font == m_layoutFont)
+        return m_layout;
+
+    // one cell per character, wide enough for every glyph in case the font is not fixed pitch
+    const QFontMetricsF metrics(_font);
+    qreal width = 0;
+    for (int c = 32; c < 127; ++c)
+        width = std::max(width, metrics.horizontalAdvance(QLatin1Char(char(c))));
+
+    m_layoutFont = _font;
+    m_layout = CellLayout {std::ceil(width), std::ceil(metrics.height())};
+    m_layoutValid = true;
+    return m_layout;
+}
+
+const HistoryDelegate::GlyphAtlas &HistoryDelegate::glyphAtlas(const QFont &_font, QRgb _color, qreal _pixelRatio) const
+{
+    for (const auto &atlas : m_atlases) {
+        if (atlas.color == _color && qFuzzyCompare(atlas.pixelRatio, _pixelRatio) && atlas.font == _font)
+            return atlas;
+    }
+
+    if (m_atlases.size() == MAX_ATLASES)
+        m_atlases.removeFirst();
+
+    const auto layout = cellLayout(_font);
+    m_atlases.append(GlyphAtlas {});
+    auto &atlas = m_atlases.last();
+    atlas.font = _font;
+    atlas.color = _color;
+    atlas.pixelRatio = _pixelRatio;
+    atlas.charWidth = layout.charWidth;
+    atlas.lineHeight = layout.lineHeight;
+
+    // the characters hexformat writes for every byte value
+    char bytes[256];
+    for (int i = 0; i < 256; ++i)
+        bytes[i] = char(i);
+    QByteArray hexText(hexformat::hexBufferSize(256, 0), Qt::Uninitialized);
+    QByteArray asciiText(hexformat::asciiBufferSize(256, 0), Qt::Uninitialized);
+    hexformat::formatHex(bytes, 256, 0, hexText.data());
+    hexformat::formatAscii(bytes, 256, 0, asciiText.data());
+
+    // 16x16 single characters on the left, 16x16 pairs on the right, in device pixels
+    const auto cellWidth = std::ceil(layout.charWidth * _pixelRatio);
+    const auto pairWidth = std::ceil(2 * layout.charWidth * _pixelRatio);
+    const auto cellHeight = std::ceil(layout.lineHeight * _pixelRatio);
+    atlas.pixmap = QPixmap(int(16 * (cellWidth + pairWidth)), int(16 * cellHeight));
+    atlas.pixmap.fill(Qt::transparent);
+
+    QPainter painter(&atlas.pixmap);
+    painter.setFont(_font);
+    painter.setPen(QColor::fromRgba(_color));
+    painter.scale(_pixelRatio, _pixelRatio);
+
+    for (int i = 0; i < 256; ++i) {
+        const auto y = (i / 16) * cellHeight;
+        atlas.ascii[i] = QRectF((i % 16) * cellWidth, y, cellWidth, cellHeight);
+        atlas.hex[i] = QRectF(16 * cellWidth + (i % 16) * pairWidth, y, pairWidth, cellHeight);
+
+        const auto asciiRect = QRectF(atlas.ascii[i].topLeft() / _pixelRatio, atlas.ascii[i].size() / _pixelRatio);
+        const auto hexRect = QRectF(atlas.hex[i].topLeft() / _pixelRatio, atlas.hex[i].size() / _pixelRatio);
+        painter.drawText(asciiRect, Qt::AlignLeft | Qt::AlignVCenter, QString(QLatin1Char(asciiText.at(i))));
+        painter.drawText(hexRect, Qt::AlignLeft | Qt::AlignVCenter, QString::fromLatin1(hexText.constData() + hexformat::hexColumn(i), 2));
+    }
+
+    return atlas;
+}
@@ -0,0 +1,58 @@
+#ifndef HISTORYDELEGATE_H
+#define HISTORYDELEGATE_H
+
+#include <QStyledItemDelegate>
+#include <QPainter>
+#include <QPixmap>
+#include <QVector>
+
+#include "models/historymodel.h"
+
+// Paints the Hex and String columns of the history straight from the row bytes.
+// Glyphs come from an atlas rendered once per font, color and pixel ratio, so a cell
+// costs one drawPixmapFragments() call and no QVariant, QString or text layout.
+// The layout is the one of hexformat, other columns use the default delegate.
+class HistoryDelegate : public QStyledItemDelegate
+{
+    Q_OBJECT
+public:
+    explicit HistoryDelegate(QObject *parent = nullptr);
+
+    void paint(QPainter *painter, const QStyleOptionViewItem &option, const QModelIndex &index) const override;
+    QSize sizeHint(const QStyleOptionViewItem &option, const QModelIndex &index) const override;
+
+private:
+    // "XX" of every byte value and the printable character or '.' of every byte value
+    struct GlyphAtlas {
+        QFont font;
+        QRgb color;
+        qreal pixelRatio;
+        qreal charWidth;
+        qreal lineHeight;
+        QPixmap pixmap;
+        QRectF hex[256]; // source rects, in pixmap pixels
+        QRectF ascii[256];
+    };
+
+    struct CellLayout {
+        qreal charWidth;
+        qreal lineHeight;
+    };
+
+    // the history row behind _index, through the search results proxy too
+    static const HistoryModel *sourceRow(const QModelIndex &_index, int *_row);
+    static bool isByteColumn(int _column);
+    CellLayout cellLayout(const QFont &_font) const; // cached for the last font
+    const GlyphAtlas &glyphAtlas(const QFont &_font, QRgb _color, qreal _pixelRatio) const;
+
+private:
+    static constexpr int MAX_ATLASES = 8;
+
+    mutable QVector<GlyphAtlas> m_atlases {}; // oldest first
+    mutable QVector<QPainter::PixmapFragment> m_fragments {}; // reused by every cell
+    mutable QFont m_layoutFont {};
+    mutable CellLayout m_layout {};
+    mutable bool m_layoutValid {};
+};
+
+#endif // HISTORYDELEGATE_H
@@ -0,0 +1,280 @@
+#include <QCoreApplication>
+#include <QEventLoop>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <random>
+#include <vector>
+
+#include "models/historymodel.h"
+
+// HistoryModel checks, one JSON object per line; any failed check exits with 1.
+// usage: historymodel_test
+
+namespace {
+
+std::atomic<unsigned long long> s_allocations {0};
+
+} // namespace
+
+// counted like in benchmarks/historymodel, Qt containers allocate with malloc()
+#if defined(__GLIBC__)
+extern "C" {
+void *__libc_malloc(size_t _size);
+void *__libc_calloc(size_t _count, size_t _size);
+void *__libc_realloc(void *_ptr, size_t _size);
+void __libc_free(void *_ptr);
+
+void *malloc(size_t _size)
+{
+    s_allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_malloc(_size);
+}
+
+void *calloc(size_t _count, size_t _size)
+{
+    s_allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_calloc(_count, _size);
+}
+
+void *realloc(void *_ptr, size_t _size)
+{
+    s_allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_realloc(_ptr, _size);
+}
+
+void free(void *_ptr)
+{
+    __libc_free(_ptr);
+}
+}
+#else
+void *operator new(size_t _size)
+{
+    s_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *ptr = std::malloc(_size ? _size : 1))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *_ptr) noexcept
+{
+    std::free(_ptr);
+}
+#endif
+
+namespace {
+
+constexpr qint64 SECOND = 1000000000;
+constexpr qint64 BATCH_INTERVAL = 16 * 1000000; // the UpdateScheduler flush interval, ns
+
+struct Read {
+    HistoryModel::DataDirection direction;
+    QByteArray data;
+    qint64 timestamp; // last byte, ns from the start
+};
+
+struct Profile {
+    const char *name;
+    std::vector<Read> reads;
+};
+
+// reads of _minRead.._maxRead bytes from _byte(), timed by the baud rate,
+// switching the direction every _burst reads
+template <typename Byte>
+Profile makeProfile(const char *_name, int _baudRate, int _reads, int _minRead, int _maxRead, int _burst, Byte _byte,
+                    std::mt19937 &_random)
+{
+    const qint64 byteTime = 10 * SECOND / _baudRate;
+    std::uniform_int_distribution<int> readLength(_minRead, _maxRead);
+
+    Profile profile {_name, {}};
+    qint64 time = 0;
+    auto direction = HistoryModel::A_TO_PC;
+    for (int i = 0; i < _reads; ++i) {
+        QByteArray data {};
+        const auto length = readLength(_random);
+        for (int j = 0; j < length; ++j)
+            data.append(_byte());
+
+        time += length * byteTime;
+        profile.reads.push_back(Read {direction, data, time});
+
+        if ((i + 1) % _burst == 0) {
+            time += 5 * 1000000;
+            direction = direction == HistoryModel::A_TO_PC ? HistoryModel::B_TO_PC : HistoryModel::A_TO_PC;
+        }
+    }
+    return profile;
+}
+
+std::vector<Profile> makeProfiles()
+{
+    std::mt19937 random(42);
+    std::uniform_int_distribution<int> printable(0x20, 0x7e);
+    std::uniform_int_distribution<int> newline(0, 40);
+
+    std::vector<Profile> profiles {};
+    // line oriented ASCII at 115200 baud
+    profiles.push_back(makeProfile("lines", 115200, 20000, 1, 64, 1000, [&]() {
+        return newline(random) ? char(printable(random)) : '\n';
+    }, random));
+    // binary bursts at 921600 baud
+    profiles.push_back(makeProfile("binary", 921600, 20000, 512, 4096, 4, [&]() {
+        return char(random());
+    }, random));
+    return profiles;
+}
+
+// the MainWindow defaults
+void configure(HistoryModel &_model, int _capacity)
+{
+    _model.setHistoryCapacity(_capacity);
+    _model.setNewlineAfterCount(16);
+    _model.setNewlineAfterCountEnabled(true);
+    _model.setNewlineAfterDuration(500);
+    _model.setNewlineAfterDurationEnabled(true);
+}
+
+// the same settings again, so the model rebuilds its rows from the chunk log
+void resegment(HistoryModel &_model)
+{
+    QEventLoop loop {};
+    const auto connection = QObject::connect(&_model, &HistoryModel::resegmented, &loop, &QEventLoop::quit);
+    _model.setNewlineAfterCount(_model.newlineAfterCount() + 1);
+    _model.setNewlineAfterCount(_model.newlineAfterCount() - 1);
+    loop.exec();
+    QObject::disconnect(connection);
+}
+
+struct RowCopy {
+    HistoryModel::DataDirection direction;
+    qint64 createdAt;
+    qint64 updatedAt;
+    QByteArray data;
+
+    bool operator==(const RowCopy &_other) const
+    {
+        return direction == _other.direction && createdAt == _other.createdAt && updatedAt == _other.updatedAt
+               && data == _other.data;
+    }
+};
+
+std::vector<RowCopy> copyRows(const HistoryModel &_model)
+{
+    std::vector<RowCopy> rows {};
+    for (int row = 0; row < _model.rowCount(); ++row) {
+        const auto data = _model.rowData(row);
+        rows.push_back(RowCopy {_model.rowDirection(row), _model.rowCreatedAt(row), _model.rowUpdatedAt(row),
+                                QByteArray(data.constData(), data.length())});
+    }
+    return rows;
+}
+
+// Unframed reads mixed with frames, added items and dropped chunks, then rebuilt:
+// the rows have to come out as they were appended live.
+bool checkResegmenting(const Profile &_profile)
+{
+    HistoryModel model {};
+    configure(model, 100000);
+    model.setChunkLogSize(64 * 1024 * 1024);
+
+    // below the capacity, live and rebuilt rows are evicted differently
+    for (size_t i = 0; i < _profile.reads.size() && model.rowCount() < 50000; ++i) {
+        const auto &read = _profile.reads[i];
+        if (i % 53 == 0)
+            model.addItems(read.direction, {read.data, read.data});
+
+        auto framing = HistoryModel::Unframed;
+        if (i % 31 == 0)
+            framing = HistoryModel::FrameStarted;
+        else if (i % 31 < 3)
+            framing = HistoryModel::FrameContinued;
+        model.appendChunks({HistoryModel::Chunk {read.direction, read.data.constData(), read.data.length(), read.timestamp, 0,
+                                                 framing, i % 97 == 0}});
+    }
+
+    const auto live = copyRows(model);
+    resegment(model);
+    const auto rebuilt = copyRows(model);
+
+    size_t mismatch = 0;
+    while (mismatch < std::min(live.size(), rebuilt.size()) && live[mismatch] == rebuilt[mismatch])
+        mismatch++;
+    const auto equal = live.size() == rebuilt.size() && mismatch == live.size();
+    printf("{\"check\":\"resegment\",\"profile\":\"%s\",\"live_rows\":%zu,\"rebuilt_rows\":%zu,\"equal\":%s,\"first_mismatch\":%lld}\n",
+           _profile.name, live.size(), rebuilt.size(), equal ? "true" : "false", equal ? -1LL : (long long)mismatch);
+    fflush(stdout);
+    return equal;
+}
+
+// the reads grouped by flush interval, as the UpdateScheduler hands them over,
+// _lap profiles after the start
+std::vector<QVector<HistoryModel::Chunk>> makeBatches(const Profile &_profile, int _lap)
+{
+    const auto duration = _profile.reads.back().timestamp + SECOND;
+    std::vector<QVector<HistoryModel::Chunk>> batches {};
+    qint64 batchEnd = 0;
+    for (const auto &read : _profile.reads) {
+        const auto timestamp = read.timestamp + _lap * duration;
+        if (batches.empty() || timestamp >= batchEnd) {
+            batches.emplace_back();
+            batchEnd = timestamp + BATCH_INTERVAL;
+        }
+        batches.back().append(HistoryModel::Chunk {read.direction, read.data.constData(), read.data.length(), timestamp, 0,
+                                                   HistoryModel::Unframed, false});
+    }
+    return batches;
+}
+
+// Once the history is full and the arena went round, appendChunks() and commitStaged()
+// reuse what they have: a steady stream must not allocate at all.
+bool checkSteadyAllocations(const Profile &_profile)
+{
+    constexpr int ROWS = 10000;
+
+    HistoryModel model {};
+    configure(model, ROWS);
+    model.setColdHistoryBudget(0);
+    const auto warmUp = makeBatches(_profile, 0);
+    const auto steady = makeBatches(_profile, 1);
+
+    // the first lap fills the history and grows the staging vectors and the arena
+    for (const auto &batch : warmUp)
+        model.appendChunks(batch);
+
+    qint64 bytes = 0;
+    const auto allocations = s_allocations.load();
+    for (const auto &batch : steady) {
+        model.appendChunks(batch);
+        for (const auto &chunk : batch)
+            bytes += chunk.length;
+    }
+    const auto counted = s_allocations - allocations;
+
+    const auto perByte = bytes ? double(counted) / bytes : 0.0;
+    const auto full = model.rowCount() == ROWS;
+    printf("{\"check\":\"steady_allocations\",\"profile\":\"%s\",\"rows\":%d,\"bytes\":%lld,\"allocations\":%llu,"
+           "\"allocs_per_byte\":%.6f}\n",
+           _profile.name, model.rowCount(), (long long)bytes, counted, perByte);
+    fflush(stdout);
+    return full && counted == 0;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    // re-segmenting finishes through the event loop
+    QCoreApplication app(argc, argv);
+    auto failed = false;
+
+    for (const auto &profile : makeProfiles()) {
+        failed = !checkResegmenting(profile) || failed;
+        failed = !checkSteadyAllocations(profile) || failed;
+    }
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,5 @@
+# qmake tests.pro && make check
+TEMPLATE = subdirs
+
+SUBDIRS += \
+    historymodel